@@ -0,0 +1,231 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * SPDX-FileCopyrightText: 2020-2021 grommunio GmbH
+ */
+#include <cerrno>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "MockServer.h"
+#include "exceptions.h"
+
+namespace exmdbpp::bench
+{
+
+/**
+ * @brief      Receive exactly the specified number of bytes
+ *
+ * @param      sock    Socket to read from
+ * @param      data    Destination buffer
+ * @param      length  Number of bytes to read
+ *
+ * @return     true if successful, false if the connection was closed or failed
+ */
+static bool recvAll(int sock, void* data, size_t length)
+{
+	for(size_t offset = 0; offset < length;)
+	{
+		ssize_t bytes = recv(sock, static_cast<uint8_t*>(data)+offset, length-offset, 0);
+		if(bytes < 0 && errno == EINTR)
+			continue;
+		if(bytes <= 0)
+			return false;
+		offset += size_t(bytes);
+	}
+	return true;
+}
+
+/**
+ * @brief      Send complete buffer
+ *
+ * @param      sock    Socket to write to
+ * @param      data    Data to send
+ * @param      length  Number of bytes to send
+ *
+ * @return     true if successful, false if the connection failed
+ */
+static bool sendAll(int sock, const void* data, size_t length)
+{
+	for(size_t offset = 0; offset < length;)
+	{
+		ssize_t bytes = send(sock, static_cast<const uint8_t*>(data)+offset, length-offset, MSG_NOSIGNAL);
+		if(bytes < 0 && errno == EINTR)
+			continue;
+		if(bytes <= 0)
+			return false;
+		offset += size_t(bytes);
+	}
+	return true;
+}
+
+/**
+ * @brief      Start server
+ *
+ * @param      port  Port to listen on (0 to choose a free port)
+ *
+ * @throws     ConnectionError  Socket could not be created or bound
+ */
+MockServer::MockServer(uint16_t port)
+{
+	if((listenSock = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+		throw ConnectionError("Could not create socket: "+std::string(strerror(errno)));
+	int one = 1;
+	setsockopt(listenSock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addrlen = sizeof(addr);
+	if(bind(listenSock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) ||
+	   listen(listenSock, SOMAXCONN) ||
+	   getsockname(listenSock, reinterpret_cast<sockaddr*>(&addr), &addrlen))
+	{
+		int error = errno;
+		close(listenSock);
+		throw ConnectionError("Could not start server: "+std::string(strerror(error)));
+	}
+	boundPort = ntohs(addr.sin_port);
+	acceptor = std::thread(&MockServer::acceptLoop, this);
+}
+
+/**
+ * @brief      Destructor
+ *
+ * Stops the server.
+ */
+MockServer::~MockServer()
+{stop();}
+
+/**
+ * @brief      Register response for a call ID
+ *
+ * @param      callId   Call ID to respond to
+ * @param      payload  Response data (without status and length)
+ * @param      status   Response code (if not 0, the payload is not sent)
+ */
+void MockServer::respond(uint8_t callId, const IOBuffer& payload, uint8_t status)
+{
+	auto reply = std::make_shared<std::vector<uint8_t>>(1, status);
+	if(!status)
+	{
+		uint32_t length = htole32(uint32_t(payload.size()));
+		reply->resize(1+sizeof(length));
+		memcpy(reply->data()+1, &length, sizeof(length));
+		reply->insert(reply->end(), payload.begin(), payload.end());
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	replies[callId] = std::move(reply);
+}
+
+/**
+ * @brief      Set artificial processing delay
+ *
+ * @param      d     Time to wait before answering each request
+ */
+void MockServer::setDelay(std::chrono::microseconds d) noexcept
+{delay = d.count();}
+
+/**
+ * @brief      Stop server and close all connections
+ *
+ * Blocks until all connection threads have terminated.
+ */
+void MockServer::stop()
+{
+	if(!running.exchange(false))
+		return;
+	shutdown(listenSock, SHUT_RDWR);
+	acceptor.join();
+	close(listenSock);
+	std::vector<std::thread> threads;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for(int sock : socks)
+			shutdown(sock, SHUT_RDWR);
+		threads.swap(workers);
+	}
+	for(std::thread& thread : threads)
+		thread.join();
+}
+
+/**
+ * @brief      Return port the server is listening on
+ */
+std::string MockServer::port() const
+{return std::to_string(boundPort);}
+
+/**
+ * @brief      Return number of requests answered so far
+ */
+uint64_t MockServer::requests() const noexcept
+{return count.load(std::memory_order_relaxed);}
+
+/**
+ * @brief      Accept connections until the server is stopped
+ */
+void MockServer::acceptLoop()
+{
+	while(running)
+	{
+		int sock = accept(listenSock, nullptr, nullptr);
+		if(sock < 0)
+		{
+			if(errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break;
+		}
+		int one = 1;
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		std::lock_guard<std::mutex> lock(mutex);
+		if(!running)
+		{
+			close(sock);
+			break;
+		}
+		socks.emplace_back(sock);
+		workers.emplace_back(&MockServer::serve, this, sock);
+	}
+}
+
+/**
+ * @brief      Answer requests of a connection until it is closed
+ *
+ * @param      sock  Connection socket
+ */
+void MockServer::serve(int sock)
+{
+	static const std::vector<uint8_t> empty = {0, 0, 0, 0, 0};
+	std::vector<uint8_t> request;
+	uint32_t length;
+	while(recvAll(sock, &length, sizeof(length)))
+	{
+		request.resize(le32toh(length));
+		if(request.empty() || !recvAll(sock, request.data(), request.size()))
+			break;
+		if(int64_t us = delay.load(std::memory_order_relaxed))
+			std::this_thread::sleep_for(std::chrono::microseconds(us));
+		Reply reply;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			reply = replies[request[0]];
+		}
+		const std::vector<uint8_t>& data = reply? *reply : empty;
+		if(!sendAll(sock, data.data(), data.size()))
+			break;
+		count.fetch_add(1, std::memory_order_relaxed);
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	for(auto it = socks.begin(); it != socks.end(); ++it)
+		if(*it == sock)
+		{
+			socks.erase(it);
+			break;
+		}
+	close(sock);
+}
+
+}
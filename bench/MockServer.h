@@ -0,0 +1,64 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "IOBuffer.h"
+
+namespace exmdbpp::bench
+{
+
+/**
+ * @brief      Loopback server speaking the exmdb framing
+ *
+ * Accepts connections on 127.0.0.1 and answers each request with the
+ * canned response registered for its call ID, allowing the complete client
+ * path to be measured without a gromox backend. Requests are not parsed
+ * beyond the call ID.
+ *
+ * Requests with a call ID without registered response are answered with
+ * an empty success response.
+ *
+ * Each connection is served by a dedicated thread, responses of a
+ * connection are sent in request order.
+ */
+class MockServer
+{
+public:
+	explicit MockServer(uint16_t=0);
+	~MockServer();
+	MockServer(const MockServer&) = delete;
+	MockServer& operator=(const MockServer&) = delete;
+
+	void respond(uint8_t, const IOBuffer&, uint8_t=0);
+	void setDelay(std::chrono::microseconds) noexcept;
+	void stop();
+
+	std::string port() const;
+	uint64_t requests() const noexcept;
+
+private:
+	using Reply = std::shared_ptr<const std::vector<uint8_t>>; ///< Serialized status, length and payload
+
+	void acceptLoop();
+	void serve(int);
+
+	int listenSock = -1; ///< Listening socket
+	uint16_t boundPort = 0; ///< Port the server is listening on
+	std::atomic<bool> running{true}; ///< Whether the server accepts connections
+	std::atomic<int64_t> delay{0}; ///< Processing delay per request in microseconds
+	std::atomic<uint64_t> count{0}; ///< Number of requests answered
+	std::thread acceptor; ///< Thread accepting new connections
+	mutable std::mutex mutex; ///< Mutex protecting replies and connection lists
+	std::array<Reply, 256> replies; ///< Responses by call ID
+	std::vector<int> socks; ///< Sockets of accepted connections
+	std::vector<std::thread> workers; ///< Connection threads
+};
+
+}
@@ -0,0 +1,152 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * SPDX-FileCopyrightText: 2020-2021 grommunio GmbH
+ */
+#include <benchmark/benchmark.h>
+
+#include "AsyncClient.h"
+#include "fixtures.h"
+#include "MessageReader.h"
+#include "MockServer.h"
+#include "queries.h"
+
+using namespace exmdbpp;
+using namespace exmdbpp::requests;
+
+static const std::string homedir = "/var/lib/gromox/user/0/1/bench"; ///< Home directory sent with requests
+static const std::vector<uint32_t> proptags = {constants::PropTag::FOLDERID, constants::PropTag::DISPLAYNAME,
+                                               constants::PropTag::CREATIONTIME};
+
+/**
+ * @brief      Return shared mock server
+ *
+ * @param      rows  Number of rows in canned table responses
+ */
+static bench::MockServer& server(uint32_t rows=100)
+{
+	static bench::MockServer server;
+	bench::cannedResponses(server, rows);
+	return server;
+}
+
+/**
+ * @brief      Measure synchronous request round trip
+ */
+static void BM_Client_send(benchmark::State& state)
+{
+	ExmdbClient client("127.0.0.1", server().port(), homedir, true);
+	for(auto _ : state)
+	{
+		auto response = client.send<GetFolderPropertiesRequest>(homedir, 0, uint64_t(1), proptags);
+		benchmark::DoNotOptimize(response.propvals.data());
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+
+/**
+ * @brief      Measure pipelined requests
+ */
+static void BM_Client_pipeline(benchmark::State& state)
+{
+	ExmdbClient client("127.0.0.1", server().port(), homedir, true);
+	ExmdbClient::Pipeline pipeline(client);
+	for(auto _ : state)
+	{
+		pipeline.clear();
+		for(int64_t i = 0; i < state.range(0); ++i)
+			pipeline.add<GetFolderPropertiesRequest>(homedir, uint32_t(0), uint64_t(1), proptags);
+		pipeline.execute();
+		for(int64_t i = 0; i < state.range(0); ++i)
+			benchmark::DoNotOptimize(pipeline.get<GetFolderPropertiesRequest>(size_t(i)).propvals.data());
+	}
+	state.SetItemsProcessed(state.iterations()*state.range(0));
+}
+
+/**
+ * @brief      Measure asynchronous requests
+ *
+ * range(0) requests are kept in flight, distributed over range(1) connections.
+ */
+static void BM_AsyncClient(benchmark::State& state)
+{
+	AsyncClient client("127.0.0.1", server().port(), homedir, true, size_t(state.range(1)));
+	size_t done = 0;
+	AsyncClient::Callback<GetFolderPropertiesRequest> callback = [&](PropvalResponse* response, std::exception_ptr)
+	{
+		++done;
+		benchmark::DoNotOptimize(response);
+	};
+	for(auto _ : state)
+	{
+		done = 0;
+		for(int64_t i = 0; i < state.range(0); ++i)
+			client.submit<GetFolderPropertiesRequest>(callback, homedir, uint32_t(0), uint64_t(1), proptags);
+		client.run();
+		if(done != size_t(state.range(0)))
+			state.SkipWithError("Requests lost");
+	}
+	state.SetItemsProcessed(state.iterations()*state.range(0));
+}
+
+/**
+ * @brief      Measure ExmdbQueries::listFolders (load, query and unload table)
+ */
+static void BM_Queries_listFolders(benchmark::State& state)
+{
+	queries::ExmdbQueries client("127.0.0.1", server(uint32_t(state.range(0))).port(), homedir, true);
+	for(auto _ : state)
+		benchmark::DoNotOptimize(client.listFolders(homedir, 1).size());
+	state.SetItemsProcessed(state.iterations()*state.range(0));
+}
+/**
+ * @brief      Register message response with range(0) attachments of range(1) bytes
+ */
+static const std::string& messageServer(benchmark::State& state)
+{
+	static bench::MockServer server;
+	IOBuffer buff;
+	bench::pushMessage(buff, 0, uint16_t(state.range(0)), uint32_t(state.range(1)));
+	server.respond(constants::CallId::READ_MESSAGE_INSTANCE, buff);
+	static std::string port = server.port();
+	return port;
+}
+
+/**
+ * @brief      Measure reading a message into MessageContent
+ */
+static void BM_Message_decoded(benchmark::State& state)
+{
+	ExmdbClient client("127.0.0.1", messageServer(state), homedir, true);
+	for(auto _ : state)
+		benchmark::DoNotOptimize(client.send<ReadMessageInstanceRequest>(homedir, uint32_t(1)).content.attachments.size());
+	state.SetBytesProcessed(state.iterations()*state.range(0)*state.range(1));
+}
+
+/**
+ * @brief      Measure streaming a message with MessageReader
+ */
+static void BM_Message_streamed(benchmark::State& state)
+{
+	struct Sink : MessageHandler
+	{
+		size_t bytes = 0;
+		void blobChunk(const uint8_t*, size_t length) override {bytes += length;}
+	} sink;
+	ExmdbClient client("127.0.0.1", messageServer(state), homedir, true);
+	for(auto _ : state)
+	{
+		auto response = client.stream<ReadMessageInstanceRequest>(homedir, uint32_t(1));
+		MessageReader(sink).read(response);
+	}
+	benchmark::DoNotOptimize(sink.bytes);
+	state.SetBytesProcessed(state.iterations()*state.range(0)*state.range(1));
+}
+
+BENCHMARK(BM_Client_send)->UseRealTime();
+BENCHMARK(BM_Client_pipeline)->ArgName("depth")->RangeMultiplier(4)->Range(1, 256)->UseRealTime();
+// Batches exceeding the socket buffers, requests and responses must be interleaved
+BENCHMARK(BM_Client_pipeline)->ArgName("depth")->Arg(1<<18)->Iterations(3)->UseRealTime();
+BENCHMARK(BM_AsyncClient)->ArgNames({"depth", "connections"})->Args({16, 1})->Args({64, 4})->Args({256, 4})->UseRealTime();
+BENCHMARK(BM_Message_decoded)->ArgNames({"attachments", "blobSize"})->Args({4, 1<<20})->Args({16, 4<<20})->UseRealTime();
+BENCHMARK(BM_Message_streamed)->ArgNames({"attachments", "blobSize"})->Args({4, 1<<20})->Args({16, 4<<20})->UseRealTime();
+BENCHMARK(BM_Queries_listFolders)->ArgName("rows")->Arg(10)->Arg(1000)->UseRealTime();
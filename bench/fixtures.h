@@ -0,0 +1,204 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+#include "IOBufferImpl.h"
+#include "MockServer.h"
+#include "structures.h"
+
+/**
+ * @brief      Test data generators shared by the benchmarks
+ */
+namespace exmdbpp::bench
+{
+
+/// Property types supported by TaggedPropval (de-)serialization
+static constexpr std::array<uint16_t, 20> propvalTypes =
+{constants::PropvalType::BYTE, constants::PropvalType::SHORT, constants::PropvalType::LONG,
+ constants::PropvalType::FLOAT, constants::PropvalType::DOUBLE, constants::PropvalType::CURRENCY,
+ constants::PropvalType::FLOATINGTIME, constants::PropvalType::ERROR, constants::PropvalType::LONGLONG,
+ constants::PropvalType::STRING, constants::PropvalType::WSTRING, constants::PropvalType::FILETIME,
+ constants::PropvalType::BINARY, constants::PropvalType::SHORT_ARRAY, constants::PropvalType::LONG_ARRAY,
+ constants::PropvalType::FLOAT_ARRAY, constants::PropvalType::DOUBLE_ARRAY, constants::PropvalType::LONGLONG_ARRAY,
+ constants::PropvalType::STRING_ARRAY, constants::PropvalType::BINARY_ARRAY};
+
+/**
+ * @brief      Serialize a sample value of the given type
+ *
+ * Variable length values contain `length` bytes or elements, array
+ * elements of variable length are 16 bytes long.
+ *
+ * @param      buff    Buffer to write to
+ * @param      type    Property type
+ * @param      length  Number of elements for variable length types
+ */
+inline void pushSample(IOBuffer& buff, uint16_t type, uint32_t length=16)
+{
+	using namespace constants;
+	using structures::TaggedPropval;
+	uint32_t tag = 0x80000000 | type;
+	std::string str(length, 'x'), elem(16, 'y');
+	switch(type)
+	{
+	case PropvalType::BYTE:
+		return buff.push(TaggedPropval(tag, uint8_t(1)));
+	case PropvalType::SHORT:
+		return buff.push(TaggedPropval(tag, uint16_t(2)));
+	case PropvalType::LONG:
+	case PropvalType::ERROR:
+		return buff.push(TaggedPropval(tag, uint32_t(3)));
+	case PropvalType::LONGLONG:
+	case PropvalType::CURRENCY:
+	case PropvalType::FILETIME:
+		return buff.push(TaggedPropval(tag, uint64_t(4)));
+	case PropvalType::FLOAT:
+		return buff.push(TaggedPropval(tag, 5.0f));
+	case PropvalType::DOUBLE:
+	case PropvalType::FLOATINGTIME:
+		return buff.push(TaggedPropval(tag, 6.0));
+	case PropvalType::STRING:
+	case PropvalType::WSTRING:
+		return buff.push(TaggedPropval(tag, str.c_str(), false));
+	case PropvalType::BINARY:
+		return buff.push(TaggedPropval(tag, str.data(), length, false));
+	case PropvalType::SHORT_ARRAY:
+		return buff.push(TaggedPropval(tag, std::vector<uint16_t>(length, 7).data(), length));
+	case PropvalType::LONG_ARRAY:
+		return buff.push(TaggedPropval(tag, std::vector<uint32_t>(length, 8).data(), length));
+	case PropvalType::LONGLONG_ARRAY:
+		return buff.push(TaggedPropval(tag, std::vector<uint64_t>(length, 9).data(), length));
+	case PropvalType::FLOAT_ARRAY:
+		return buff.push(TaggedPropval(tag, std::vector<float>(length, 10.0f).data(), length));
+	case PropvalType::DOUBLE_ARRAY:
+		return buff.push(TaggedPropval(tag, std::vector<double>(length, 11.0).data(), length));
+	case PropvalType::STRING_ARRAY:
+		return buff.push(TaggedPropval(tag, std::vector<const char*>(length, elem.c_str()).data(), length));
+	case PropvalType::BINARY_ARRAY:
+		buff.push(tag, length);
+		for(uint32_t i = 0; i < length; ++i)
+		{
+			buff.push(uint32_t(elem.size()));
+			buff.push_raw(elem.data(), elem.size());
+		}
+		return;
+	}
+}
+
+/**
+ * @brief      Serialize table response
+ *
+ * Each row contains a LONGLONG (ID), STRING (name), LONG (flags) and
+ * FILETIME (timestamp) column.
+ *
+ * @param      rows  Number of rows
+ *
+ * @return     Buffer containing the response data
+ */
+inline IOBuffer tableData(uint32_t rows)
+{
+	using namespace constants;
+	IOBuffer buff;
+	buff.push(rows);
+	for(uint32_t row = 0; row < rows; ++row)
+	{
+		std::string name = "Folder "+std::to_string(row);
+		buff.push(uint16_t(4));
+		buff.push(structures::TaggedPropval(PropTag::FOLDERID, uint64_t(row)));
+		buff.push(structures::TaggedPropval(PropTag::DISPLAYNAME, name.c_str(), false));
+		buff.push(structures::TaggedPropval(PropTag::FOLDERFLAGS, row));
+		buff.push(structures::TaggedPropval(PropTag::CREATIONTIME, uint64_t(row)*1000));
+	}
+	return buff;
+}
+
+/**
+ * @brief      Build restriction tree
+ *
+ * Each level combines a property comparison with the next level in an
+ * AND or OR node, alternating between levels.
+ *
+ * @param      depth  Number of levels
+ *
+ * @return     Restriction
+ */
+inline structures::Restriction deepRestriction(size_t depth)
+{
+	using structures::Restriction;
+	Restriction res = Restriction::EXIST(constants::PropTag::DISPLAYNAME);
+	for(size_t level = 0; level < depth; ++level)
+	{
+		std::vector<Restriction> children;
+		children.emplace_back(Restriction::PROPERTY(Restriction::EQ, 0,
+		                                            structures::TaggedPropval(constants::PropTag::FOLDERID, uint64_t(level))));
+		children.emplace_back(std::move(res));
+		res = level%2? Restriction::OR(std::move(children)) : Restriction::AND(std::move(children));
+	}
+	return res;
+}
+
+/**
+ * @brief      Serialize message content
+ *
+ * Each message has a subject, two recipients and `attachments` attachments,
+ * carrying `blobSize` bytes of data each. Every attachment embeds another
+ * message down to the given nesting depth.
+ *
+ * @param      buff         Buffer to write to
+ * @param      depth        Nesting depth of embedded messages
+ * @param      attachments  Number of attachments per message
+ * @param      blobSize     Size of attachment data
+ */
+inline void pushMessage(IOBuffer& buff, size_t depth, uint16_t attachments, uint32_t blobSize)
+{
+	using namespace constants;
+	std::string blob(blobSize, 'a');
+	buff.push(uint16_t(2));
+	buff.push(structures::TaggedPropval(PropTag::DISPLAYNAME, "Subject", false));
+	buff.push(structures::TaggedPropval(PropTag::CREATIONTIME, uint64_t(0)));
+	buff.push(uint8_t(1), uint32_t(2));
+	for(int i = 0; i < 2; ++i)
+	{
+		buff.push(uint16_t(1));
+		buff.push(structures::TaggedPropval(PropTag::SMTPADDRESS, "user@example.com", false));
+	}
+	buff.push(uint8_t(1), attachments);
+	for(uint16_t i = 0; i < attachments; ++i)
+	{
+		buff.push(uint16_t(1));
+		buff.push(structures::TaggedPropval(PropTag::ATTACHDATABINARY, blob.data(), blobSize, false));
+		buff.push(uint8_t(depth > 0));
+		if(depth > 0)
+			pushMessage(buff, depth-1, attachments, blobSize);
+	}
+}
+
+/**
+ * @brief      Register canned responses for common requests
+ *
+ * Hierarchy and content tables contain `rows` rows as generated by
+ * tableData(), folder property requests return the folder ID, display name
+ * and creation time.
+ *
+ * @param      server  Server to configure
+ * @param      rows    Number of table rows
+ */
+inline void cannedResponses(MockServer& server, uint32_t rows)
+{
+	using namespace constants;
+	IOBuffer buff;
+	buff.push(uint32_t(1), rows);
+	server.respond(CallId::LOAD_HIERARCHY_TABLE, buff);
+	server.respond(CallId::LOAD_CONTENT_TABLE, buff);
+	server.respond(CallId::QUERY_TABLE, tableData(rows));
+	buff.clear();
+	buff.push(uint16_t(3));
+	buff.push(structures::TaggedPropval(PropTag::FOLDERID, uint64_t(1)));
+	buff.push(structures::TaggedPropval(PropTag::DISPLAYNAME, "Benchmark folder", false));
+	buff.push(structures::TaggedPropval(PropTag::CREATIONTIME, uint64_t(0)));
+	server.respond(CallId::GET_FOLDER_PROPERTIES, buff);
+}
+
+}
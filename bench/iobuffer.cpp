@@ -0,0 +1,111 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * SPDX-FileCopyrightText: 2020-2021 grommunio GmbH
+ */
+#include <benchmark/benchmark.h>
+
+#include "IOBufferImpl.h"
+#include "structures.h"
+
+using namespace exmdbpp;
+
+/**
+ * @brief      Number of values (de-)serialized per iteration
+ */
+static constexpr size_t batch = 1024;
+
+/**
+ * @brief      Sample value of type T
+ */
+template<typename T>
+static T sample()
+{
+	if constexpr(std::is_same_v<T, const char*>)
+		return "The quick brown fox jumps over the lazy dog";
+	else if constexpr(std::is_same_v<T, std::string>)
+		return "The quick brown fox jumps over the lazy dog";
+	else if constexpr(std::is_same_v<T, std::array<uint8_t, 16>>)
+		return T{};
+	else
+		return T(42);
+}
+
+/**
+ * @brief      Measure IOBuffer::push
+ */
+template<typename T>
+static void BM_push(benchmark::State& state)
+{
+	T value = sample<T>();
+	IOBuffer buff;
+	for(auto _ : state)
+	{
+		buff.clear();
+		for(size_t i = 0; i < batch; ++i)
+			buff.push(value);
+		benchmark::DoNotOptimize(buff.data());
+	}
+	state.SetItemsProcessed(state.iterations()*batch);
+	state.SetBytesProcessed(state.iterations()*buff.size());
+}
+
+/**
+ * @brief      Measure IOBuffer::pop
+ */
+template<typename T>
+static void BM_pop(benchmark::State& state)
+{
+	IOBuffer buff;
+	for(size_t i = 0; i < batch; ++i)
+		buff.push(sample<T>());
+	T value;
+	for(auto _ : state)
+	{
+		buff.reset();
+		for(size_t i = 0; i < batch; ++i)
+		{
+			buff.pop(value);
+			benchmark::DoNotOptimize(value);
+		}
+	}
+	state.SetItemsProcessed(state.iterations()*batch);
+	state.SetBytesProcessed(state.iterations()*buff.size());
+}
+
+/**
+ * @brief      Measure GUID serialization
+ */
+static void BM_push_GUID(benchmark::State& state)
+{
+	IOBuffer buff;
+	for(auto _ : state)
+	{
+		buff.clear();
+		for(size_t i = 0; i < batch; ++i)
+			buff.push(structures::GUID::PSETID_GROMOX);
+		benchmark::DoNotOptimize(buff.data());
+	}
+	state.SetItemsProcessed(state.iterations()*batch);
+}
+
+BENCHMARK_TEMPLATE(BM_push, bool);
+BENCHMARK_TEMPLATE(BM_push, uint8_t);
+BENCHMARK_TEMPLATE(BM_push, uint16_t);
+BENCHMARK_TEMPLATE(BM_push, uint32_t);
+BENCHMARK_TEMPLATE(BM_push, uint64_t);
+BENCHMARK_TEMPLATE(BM_push, float);
+BENCHMARK_TEMPLATE(BM_push, double);
+BENCHMARK_TEMPLATE(BM_push, const char*);
+BENCHMARK_TEMPLATE(BM_push, std::string);
+BENCHMARK_TEMPLATE(BM_push, std::array<uint8_t, 16>);
+BENCHMARK(BM_push_GUID);
+
+BENCHMARK_TEMPLATE(BM_pop, bool);
+BENCHMARK_TEMPLATE(BM_pop, uint8_t);
+BENCHMARK_TEMPLATE(BM_pop, uint16_t);
+BENCHMARK_TEMPLATE(BM_pop, uint32_t);
+BENCHMARK_TEMPLATE(BM_pop, uint64_t);
+BENCHMARK_TEMPLATE(BM_pop, float);
+BENCHMARK_TEMPLATE(BM_pop, double);
+BENCHMARK_TEMPLATE(BM_pop, const char*);
+BENCHMARK_TEMPLATE(BM_pop, std::string);
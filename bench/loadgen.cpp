@@ -0,0 +1,338 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * SPDX-FileCopyrightText: 2020-2021 grommunio GmbH
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AsyncClient.h"
+#include "fixtures.h"
+#include "MockServer.h"
+#include "queries.h"
+
+using namespace exmdbpp;
+using namespace exmdbpp::requests;
+using exmdbpp::queries::ExmdbQueries;
+using exmdbpp::queries::QueriesPool;
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * @brief      Load generator configuration
+ */
+struct Options
+{
+	enum Mode : uint8_t {SYNC, POOL, PIPELINE, ASYNC};
+	enum Query : uint8_t {PROPS, LIST};
+
+	Mode mode = SYNC; ///< Client mode
+	Query query = PROPS; ///< Query to run
+	size_t threads = 1; ///< Number of worker threads
+	size_t connections = 0; ///< Number of connections (0 for one per thread)
+	size_t requests = 10000; ///< Total number of operations
+	size_t depth = 16; ///< Pipeline batch size / asynchronous requests in flight per thread
+	std::string host; ///< Server host (empty to use the built-in mock server)
+	std::string port = "5000"; ///< Server port
+	std::string prefix = "/var/lib/gromox/user"; ///< Data area prefix
+	std::string homedir = "/var/lib/gromox/user/0/1/bench"; ///< Store to query
+	bool isPrivate = true; ///< Whether to access private stores
+	uint64_t folderId = constants::PrivateFid::ROOT; ///< Folder to query
+	uint32_t rows = 100; ///< Number of table rows returned by the mock server
+	unsigned delay = 0; ///< Mock server processing delay in microseconds
+};
+
+/**
+ * @brief      Latencies recorded by a worker
+ */
+struct Samples
+{
+	std::vector<uint64_t> latencies; ///< Operation latencies in nanoseconds
+	size_t errors = 0; ///< Number of failed operations
+};
+
+static const std::vector<uint32_t> proptags = {constants::PropTag::FOLDERID, constants::PropTag::DISPLAYNAME,
+                                               constants::PropTag::CREATIONTIME};
+
+/**
+ * @brief      Return nanoseconds passed since start
+ */
+static uint64_t since(Clock::time_point start)
+{return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now()-start).count());}
+
+/**
+ * @brief      Run a single query with a blocking client
+ */
+static void runQuery(ExmdbQueries& client, const Options& opts)
+{
+	if(opts.query == Options::LIST)
+		client.listFolders(opts.homedir, opts.folderId);
+	else
+		client.getFolderProperties(opts.homedir, 0, opts.folderId, proptags);
+}
+
+/**
+ * @brief      Worker using a dedicated client or a leased pool client per operation
+ */
+static void syncWorker(const Options& opts, QueriesPool* pool, size_t count, Samples& samples)
+{
+	std::unique_ptr<ExmdbQueries> own;
+	if(!pool)
+		own.reset(new ExmdbQueries(opts.host, opts.port, opts.prefix, opts.isPrivate, ExmdbClient::AUTO_RECONNECT));
+	for(size_t i = 0; i < count; ++i)
+	{
+		auto start = Clock::now();
+		try
+		{
+			if(pool)
+				runQuery(*pool->lease(), opts);
+			else
+				runQuery(*own, opts);
+		}
+		catch(const std::exception&)
+		{++samples.errors;}
+		samples.latencies.emplace_back(since(start));
+	}
+}
+
+/**
+ * @brief      Worker sending batches of pipelined requests
+ *
+ * Each request is attributed the latency of its batch.
+ */
+static void pipelineWorker(const Options& opts, size_t count, Samples& samples)
+{
+	ExmdbClient client(opts.host, opts.port, opts.prefix, opts.isPrivate, ExmdbClient::AUTO_RECONNECT);
+	ExmdbClient::Pipeline pipeline(client);
+	for(size_t done = 0; done < count;)
+	{
+		size_t batch = std::min(opts.depth, count-done);
+		auto start = Clock::now();
+		pipeline.clear();
+		try
+		{
+			for(size_t i = 0; i < batch; ++i)
+				pipeline.add<GetFolderPropertiesRequest>(opts.homedir, uint32_t(0), opts.folderId, proptags);
+			pipeline.execute();
+			for(size_t i = 0; i < batch; ++i)
+				try {pipeline.get<GetFolderPropertiesRequest>(i);}
+				catch(const std::exception&) {++samples.errors;}
+		}
+		catch(const std::exception&)
+		{
+			samples.errors += batch;
+			client.reconnect();
+		}
+		samples.latencies.insert(samples.latencies.end(), batch, since(start));
+		done += batch;
+	}
+}
+
+/**
+ * @brief      Worker keeping a fixed number of asynchronous requests in flight
+ */
+static void asyncWorker(const Options& opts, size_t channels, size_t count, Samples& samples)
+{
+	AsyncClient client(opts.host, opts.port, opts.prefix, opts.isPrivate, channels);
+	size_t submitted = 0;
+	std::function<void()> submit = [&]
+	{
+		if(submitted >= count)
+			return;
+		++submitted;
+		auto start = Clock::now();
+		client.submit<GetFolderPropertiesRequest>([&, start](PropvalResponse*, std::exception_ptr err)
+		{
+			samples.latencies.emplace_back(since(start));
+			samples.errors += bool(err);
+			submit();
+		}, opts.homedir, uint32_t(0), opts.folderId, proptags);
+	};
+	for(size_t i = 0; i < opts.depth; ++i)
+		submit();
+	client.run();
+}
+
+/**
+ * @brief      Print usage information
+ */
+static void usage(const char* name)
+{
+	printf("Usage: %s [options]\n\n"
+	       "Options:\n"
+	       "  -m, --mode MODE         Client mode: sync, pool, pipeline or async (default sync)\n"
+	       "  -q, --query QUERY       Query to run: props or list (sync and pool only, default props)\n"
+	       "  -t, --threads N         Number of worker threads (default 1)\n"
+	       "  -c, --connections N     Number of connections (pool and async, default one per thread)\n"
+	       "  -n, --requests N        Total number of operations (default 10000)\n"
+	       "  -d, --depth N           Pipeline batch size / async requests in flight per thread (default 16)\n"
+	       "  -H, --host HOST         Server to connect to (default: start built-in mock server)\n"
+	       "  -p, --port PORT         Server port (default 5000)\n"
+	       "  -P, --prefix PREFIX     Data area prefix (default /var/lib/gromox/user)\n"
+	       "  -s, --homedir DIR       Store to query\n"
+	       "  -f, --folder ID         Folder to query (default 1)\n"
+	       "      --public            Access public stores\n"
+	       "  -r, --rows N            Mock server table size (default 100)\n"
+	       "  -D, --delay US          Mock server processing delay in microseconds (default 0)\n"
+	       "  -h, --help              Show this help\n", name);
+}
+
+/**
+ * @brief      Parse command line arguments
+ *
+ * Exits on invalid arguments.
+ */
+static Options parseArgs(int argc, char** argv)
+{
+	static const option longopts[] = {
+	    {"mode", required_argument, nullptr, 'm'}, {"query", required_argument, nullptr, 'q'},
+	    {"threads", required_argument, nullptr, 't'}, {"connections", required_argument, nullptr, 'c'},
+	    {"requests", required_argument, nullptr, 'n'}, {"depth", required_argument, nullptr, 'd'},
+	    {"host", required_argument, nullptr, 'H'}, {"port", required_argument, nullptr, 'p'},
+	    {"prefix", required_argument, nullptr, 'P'}, {"homedir", required_argument, nullptr, 's'},
+	    {"folder", required_argument, nullptr, 'f'}, {"public", no_argument, nullptr, 'U'},
+	    {"rows", required_argument, nullptr, 'r'}, {"delay", required_argument, nullptr, 'D'},
+	    {"help", no_argument, nullptr, 'h'}, {nullptr, 0, nullptr, 0}};
+	static const char* modes[] = {"sync", "pool", "pipeline", "async"};
+	Options opts;
+	for(int opt; (opt = getopt_long(argc, argv, "m:q:t:c:n:d:H:p:P:s:f:r:D:h", longopts, nullptr)) != -1;)
+		switch(opt)
+		{
+		case 'm': {
+			auto it = std::find_if(std::begin(modes), std::end(modes), [](const char* m){return !strcmp(m, optarg);});
+			if(it == std::end(modes))
+			{
+				fprintf(stderr, "Unknown mode '%s'\n", optarg);
+				exit(2);
+			}
+			opts.mode = Options::Mode(it-std::begin(modes));
+			break;
+		}
+		case 'q':
+			if(strcmp(optarg, "props") && strcmp(optarg, "list"))
+			{
+				fprintf(stderr, "Unknown query '%s'\n", optarg);
+				exit(2);
+			}
+			opts.query = strcmp(optarg, "list")? Options::PROPS : Options::LIST;
+			break;
+		case 't': opts.threads = std::max(1ul, strtoul(optarg, nullptr, 0)); break;
+		case 'c': opts.connections = strtoul(optarg, nullptr, 0); break;
+		case 'n': opts.requests = strtoul(optarg, nullptr, 0); break;
+		case 'd': opts.depth = std::max(1ul, strtoul(optarg, nullptr, 0)); break;
+		case 'H': opts.host = optarg; break;
+		case 'p': opts.port = optarg; break;
+		case 'P': opts.prefix = optarg; break;
+		case 's': opts.homedir = optarg; break;
+		case 'f': opts.folderId = strtoull(optarg, nullptr, 0); break;
+		case 'U': opts.isPrivate = false; break;
+		case 'r': opts.rows = uint32_t(strtoul(optarg, nullptr, 0)); break;
+		case 'D': opts.delay = unsigned(strtoul(optarg, nullptr, 0)); break;
+		case 'h': usage(argv[0]); exit(0);
+		default: usage(argv[0]); exit(2);
+		}
+	if(opts.query == Options::LIST && (opts.mode == Options::PIPELINE || opts.mode == Options::ASYNC))
+	{
+		fprintf(stderr, "Query 'list' is only supported in sync and pool mode\n");
+		exit(2);
+	}
+	if(!opts.connections)
+		opts.connections = opts.threads;
+	return opts;
+}
+
+/**
+ * @brief      Return latency quantile in microseconds
+ *
+ * @param      sorted  Sorted latencies in nanoseconds
+ * @param      q       Quantile (between 0 and 1)
+ */
+static double quantile(const std::vector<uint64_t>& sorted, double q)
+{return sorted.empty()? 0 : sorted[std::min(sorted.size()-1, size_t(q*sorted.size()))]/1000.0;}
+
+int main(int argc, char** argv)
+{
+	Options opts = parseArgs(argc, argv);
+	std::unique_ptr<bench::MockServer> server;
+	if(opts.host.empty())
+	{
+		server.reset(new bench::MockServer());
+		bench::cannedResponses(*server, opts.rows);
+		server->setDelay(std::chrono::microseconds(opts.delay));
+		opts.host = "127.0.0.1";
+		opts.port = server->port();
+	}
+	std::vector<Samples> samples(opts.threads);
+	std::vector<std::thread> workers;
+	std::unique_ptr<QueriesPool> pool;
+	Clock::time_point start;
+	try
+	{
+		if(opts.mode == Options::POOL)
+			pool.reset(new QueriesPool(opts.host, opts.port, opts.prefix, opts.isPrivate, opts.connections,
+			                           ExmdbClient::AUTO_RECONNECT));
+		start = Clock::now();
+		for(size_t i = 0; i < opts.threads; ++i)
+		{
+			size_t count = opts.requests/opts.threads+(i < opts.requests%opts.threads);
+			size_t channels = std::max<size_t>(1, opts.connections/opts.threads);
+			workers.emplace_back([&, i, count, channels]
+			{
+				try
+				{
+					switch(opts.mode)
+					{
+					case Options::SYNC:
+					case Options::POOL:
+						return syncWorker(opts, pool.get(), count, samples[i]);
+					case Options::PIPELINE:
+						return pipelineWorker(opts, count, samples[i]);
+					case Options::ASYNC:
+						return asyncWorker(opts, channels, count, samples[i]);
+					}
+				}
+				catch(const std::exception& err)
+				{
+					fprintf(stderr, "Worker %zu failed: %s\n", i, err.what());
+					samples[i].errors += count-samples[i].latencies.size();
+				}
+			});
+		}
+	}
+	catch(const std::exception& err)
+	{
+		fprintf(stderr, "Failed to start: %s\n", err.what());
+		for(std::thread& worker : workers)
+			worker.join();
+		return 1;
+	}
+	for(std::thread& worker : workers)
+		worker.join();
+	double elapsed = since(start)/1e9;
+
+	std::vector<uint64_t> latencies;
+	size_t errors = 0;
+	for(const Samples& s : samples)
+	{
+		latencies.insert(latencies.end(), s.latencies.begin(), s.latencies.end());
+		errors += s.errors;
+	}
+	std::sort(latencies.begin(), latencies.end());
+	printf("operations: %zu (%zu errors)\n"
+	       "elapsed:    %.3f s\n"
+	       "throughput: %.1f ops/s\n"
+	       "latency:    p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+	       latencies.size(), errors, elapsed, latencies.size()/elapsed, quantile(latencies, 0.5),
+	       quantile(latencies, 0.9), quantile(latencies, 0.99), quantile(latencies, 0.999), quantile(latencies, 1));
+	if(server)
+		printf("server:     %llu requests\n", (unsigned long long)server->requests());
+	return errors? 1 : 0;
+}
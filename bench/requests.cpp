@@ -0,0 +1,91 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * SPDX-FileCopyrightText: 2020-2021 grommunio GmbH
+ */
+#include <benchmark/benchmark.h>
+
+#include "fixtures.h"
+#include "requests.h"
+
+using namespace exmdbpp;
+using namespace exmdbpp::requests;
+
+/**
+ * @brief      Columns contained in the generated table data
+ */
+static const std::vector<uint32_t> columns = {constants::PropTag::FOLDERID, constants::PropTag::DISPLAYNAME,
+                                              constants::PropTag::FOLDERFLAGS, constants::PropTag::CREATIONTIME};
+
+/**
+ * @brief      Measure TableResponse decoding
+ */
+static void BM_TableResponse(benchmark::State& state)
+{
+	IOBuffer buff = bench::tableData(uint32_t(state.range(0)));
+	for(auto _ : state)
+	{
+		buff.reset();
+		TableResponse response(buff);
+		benchmark::DoNotOptimize(response.entries.data());
+	}
+	state.SetItemsProcessed(state.iterations()*state.range(0));
+	state.SetBytesProcessed(state.iterations()*buff.size());
+}
+
+/**
+ * @brief      Measure BorrowedTableResponse decoding
+ *
+ * Includes the cost of copying the response data, as the response takes
+ * ownership of the buffer.
+ */
+static void BM_BorrowedTableResponse(benchmark::State& state)
+{
+	IOBuffer data = bench::tableData(uint32_t(state.range(0)));
+	for(auto _ : state)
+	{
+		IOBuffer buff(data);
+		BorrowedTableResponse response(std::move(buff));
+		benchmark::DoNotOptimize(response.size());
+	}
+	state.SetItemsProcessed(state.iterations()*state.range(0));
+	state.SetBytesProcessed(state.iterations()*data.size());
+}
+
+/**
+ * @brief      Measure ColumnarTableResponse decoding
+ */
+static void BM_ColumnarTableResponse(benchmark::State& state)
+{
+	IOBuffer buff = bench::tableData(uint32_t(state.range(0)));
+	for(auto _ : state)
+	{
+		buff.reset();
+		ColumnarTableResponse response(buff, columns);
+		benchmark::DoNotOptimize(response.rows);
+	}
+	state.SetItemsProcessed(state.iterations()*state.range(0));
+	state.SetBytesProcessed(state.iterations()*buff.size());
+}
+
+/**
+ * @brief      Measure serialization of a table request with restriction
+ */
+static void BM_LoadContentTableRequest(benchmark::State& state)
+{
+	structures::Restriction res = bench::deepRestriction(size_t(state.range(0)));
+	IOBuffer buff;
+	for(auto _ : state)
+	{
+		buff.clear();
+		buff.start();
+		LoadContentTableRequest::write(buff, std::string("/var/lib/gromox/user/0/1/bench"), 0, 0, std::string(), 0, res);
+		buff.finalize();
+		benchmark::DoNotOptimize(buff.data());
+	}
+	state.SetBytesProcessed(state.iterations()*buff.size());
+}
+
+BENCHMARK(BM_TableResponse)->ArgName("rows")->Arg(1000)->Arg(10000)->Arg(100000);
+BENCHMARK(BM_BorrowedTableResponse)->ArgName("rows")->Arg(1000)->Arg(10000)->Arg(100000);
+BENCHMARK(BM_ColumnarTableResponse)->ArgName("rows")->Arg(1000)->Arg(10000)->Arg(100000);
+BENCHMARK(BM_LoadContentTableRequest)->ArgName("depth")->Arg(0)->Arg(16);
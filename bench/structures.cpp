@@ -0,0 +1,176 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * SPDX-FileCopyrightText: 2020-2021 grommunio GmbH
+ */
+#include <benchmark/benchmark.h>
+
+#include "fixtures.h"
+#include "structures.h"
+
+using namespace exmdbpp;
+using namespace exmdbpp::structures;
+
+/**
+ * @brief      Number of propvals decoded per iteration
+ */
+static constexpr size_t batch = 256;
+
+/**
+ * @brief      Create buffer containing `batch` sample values of a type
+ *
+ * @param      state  Benchmark state, range(0) is the type index, range(1) the value length
+ */
+static IOBuffer propvalData(const benchmark::State& state)
+{
+	uint16_t type = bench::propvalTypes[state.range(0)];
+	IOBuffer buff;
+	for(size_t i = 0; i < batch; ++i)
+		bench::pushSample(buff, type, uint32_t(state.range(1)));
+	return buff;
+}
+
+/**
+ * @brief      Register all property types as benchmark arguments
+ */
+static void propvalArgs(benchmark::internal::Benchmark* bm)
+{
+	bm->ArgNames({"type", "length"});
+	for(size_t i = 0; i < bench::propvalTypes.size(); ++i)
+		for(int64_t length : {16, 1024})
+			bm->Args({int64_t(i), length});
+}
+
+/**
+ * @brief      Measure TaggedPropval(IOBuffer&)
+ */
+static void BM_TaggedPropval_decode(benchmark::State& state)
+{
+	IOBuffer buff = propvalData(state);
+	state.SetLabel(TaggedPropval::typeName(bench::propvalTypes[state.range(0)]));
+	for(auto _ : state)
+	{
+		buff.reset();
+		for(size_t i = 0; i < batch; ++i)
+		{
+			TaggedPropval tp(buff);
+			benchmark::DoNotOptimize(tp.value);
+		}
+	}
+	state.SetItemsProcessed(state.iterations()*batch);
+	state.SetBytesProcessed(state.iterations()*buff.size());
+}
+
+/**
+ * @brief      Measure TaggedPropval(IOBuffer&, Arena&)
+ */
+static void BM_TaggedPropval_decodeBorrowed(benchmark::State& state)
+{
+	IOBuffer buff = propvalData(state);
+	Arena arena;
+	state.SetLabel(TaggedPropval::typeName(bench::propvalTypes[state.range(0)]));
+	for(auto _ : state)
+	{
+		buff.reset();
+		arena.clear();
+		for(size_t i = 0; i < batch; ++i)
+		{
+			TaggedPropval tp(buff, arena);
+			benchmark::DoNotOptimize(tp.value);
+		}
+	}
+	state.SetItemsProcessed(state.iterations()*batch);
+	state.SetBytesProcessed(state.iterations()*buff.size());
+}
+
+/**
+ * @brief      Measure TaggedPropval serialization
+ */
+static void BM_TaggedPropval_encode(benchmark::State& state)
+{
+	IOBuffer data = propvalData(state), buff;
+	std::vector<TaggedPropval> propvals;
+	for(size_t i = 0; i < batch; ++i)
+		propvals.emplace_back(data);
+	state.SetLabel(TaggedPropval::typeName(bench::propvalTypes[state.range(0)]));
+	for(auto _ : state)
+	{
+		buff.clear();
+		for(const TaggedPropval& tp : propvals)
+			buff.push(tp);
+		benchmark::DoNotOptimize(buff.data());
+	}
+	state.SetItemsProcessed(state.iterations()*batch);
+	state.SetBytesProcessed(state.iterations()*buff.size());
+}
+
+/**
+ * @brief      Measure construction and first serialization of nested trees
+ */
+static void BM_Restriction_build(benchmark::State& state)
+{
+	IOBuffer buff;
+	for(auto _ : state)
+	{
+		buff.clear();
+		bench::deepRestriction(size_t(state.range(0))).serialize(buff);
+		benchmark::DoNotOptimize(buff.data());
+	}
+	state.SetBytesProcessed(state.iterations()*buff.size());
+}
+
+/**
+ * @brief      Measure repeated Restriction::serialize on nested trees
+ */
+static void BM_Restriction_serialize(benchmark::State& state)
+{
+	Restriction res = bench::deepRestriction(size_t(state.range(0)));
+	IOBuffer buff;
+	for(auto _ : state)
+	{
+		buff.clear();
+		res.serialize(buff);
+		benchmark::DoNotOptimize(buff.data());
+	}
+	state.SetBytesProcessed(state.iterations()*buff.size());
+}
+
+/**
+ * @brief      Measure copying of nested restrictions
+ */
+static void BM_Restriction_copy(benchmark::State& state)
+{
+	Restriction res = bench::deepRestriction(size_t(state.range(0)));
+	for(auto _ : state)
+	{
+		Restriction copy(res);
+		benchmark::DoNotOptimize(copy);
+	}
+}
+
+/**
+ * @brief      Measure MessageContent decoding
+ */
+static void BM_MessageContent_decode(benchmark::State& state)
+{
+	IOBuffer buff;
+	bench::pushMessage(buff, size_t(state.range(0)), uint16_t(state.range(1)), uint32_t(state.range(2)));
+	for(auto _ : state)
+	{
+		buff.reset();
+		MessageContent content(buff);
+		benchmark::DoNotOptimize(content.attachments.data());
+	}
+	state.SetBytesProcessed(state.iterations()*buff.size());
+}
+
+BENCHMARK(BM_TaggedPropval_decode)->Apply(propvalArgs);
+BENCHMARK(BM_TaggedPropval_decodeBorrowed)->Apply(propvalArgs);
+BENCHMARK(BM_TaggedPropval_encode)->Apply(propvalArgs);
+BENCHMARK(BM_Restriction_build)->ArgName("depth")->RangeMultiplier(4)->Range(1, 256);
+BENCHMARK(BM_Restriction_serialize)->ArgName("depth")->RangeMultiplier(4)->Range(1, 256);
+BENCHMARK(BM_Restriction_copy)->ArgName("depth")->RangeMultiplier(4)->Range(1, 256);
+BENCHMARK(BM_MessageContent_decode)->ArgNames({"depth", "attachments", "blobSize"})
+                                   ->Args({0, 0, 0})
+                                   ->Args({0, 8, 4096})
+                                   ->Args({2, 4, 4096})
+                                   ->Args({3, 4, 65536});
@@ -1,8 +1,16 @@
 #include <cstdint>
+#include <string_view>
+#include <unordered_map>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
+#include "AsyncClient.h"
+#include "FolderCache.h"
+#include "FolderTree.h"
+#include "Metrics.h"
+#include "NamedPropCache.h"
 #include "queries.h"
+#include "TableCursor.h"
 
 namespace py = pybind11;
 
@@ -29,6 +37,86 @@ std::string hexstr(uint32_t value, uint8_t width)
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+// Zero-copy buffer views
+
+/**
+ * @brief      Number of live buffer views per exporting object
+ *
+ * Objects listed here must not release or reallocate the viewed memory.
+ * Only accessed with the GIL held.
+ */
+static std::unordered_map<const void*, size_t> bufferExports;
+
+/**
+ * @brief      Read-only buffer referencing memory owned by another object
+ *
+ * Exposes the buffer protocol, keeping the owning Python object alive as long
+ * as the buffer (or any memoryview or NumPy array created from it) exists.
+ *
+ * If an exporter is given, the view is registered in bufferExports for its
+ * lifetime, allowing the exporter to refuse modifications that would
+ * invalidate the memory.
+ */
+struct BufferView
+{
+	BufferView(py::object owner, const void* data, py::ssize_t itemsize, std::string format, py::ssize_t count,
+	           const void* exporter) :
+	    owner(std::move(owner)), data(data), itemsize(itemsize), format(std::move(format)), count(count), exporter(exporter)
+	{
+		if(exporter)
+			++bufferExports[exporter];
+	}
+
+	BufferView(BufferView&& other) noexcept :
+	    owner(std::move(other.owner)), data(other.data), itemsize(other.itemsize), format(std::move(other.format)),
+	    count(other.count), exporter(other.exporter)
+	{other.exporter = nullptr;}
+
+	~BufferView()
+	{
+		if(!exporter)
+			return;
+		auto it = bufferExports.find(exporter);
+		if(it != bufferExports.end() && !--it->second)
+			bufferExports.erase(it);
+	}
+
+	BufferView(const BufferView&) = delete;
+	BufferView& operator=(const BufferView&) = delete;
+	BufferView& operator=(BufferView&&) = delete;
+
+	py::object owner; ///< Object owning the memory
+	const void* data; ///< Start of the buffer
+	py::ssize_t itemsize; ///< Size of a single element
+	std::string format; ///< Struct format string of the elements
+	py::ssize_t count; ///< Number of elements
+	const void* exporter; ///< Object whose exports are tracked (or nullptr)
+};
+
+/**
+ * @brief      Create memoryview of C++ owned data
+ *
+ * The memory must remain valid and unmodified as long as the owner exists,
+ * or, if an exporter is given, as long as it has exports registered.
+ *
+ * @param      owner     Python object owning the memory
+ * @param      data      Pointer to the first element
+ * @param      count     Number of elements
+ * @param      exporter  Object to register the export for (optional)
+ *
+ * @tparam     T         Element type
+ *
+ * @return     Read-only memoryview
+ */
+template<typename T>
+py::memoryview makeView(py::object owner, const T* data, size_t count, const void* exporter=nullptr)
+{
+	static const T empty{};
+	return py::memoryview(py::cast(BufferView(std::move(owner), count? data : &empty, py::ssize_t(sizeof(T)),
+	                                          py::format_descriptor<T>::format(), py::ssize_t(count), exporter)));
+}
+
 std::string TaggedPropval_repr(const TaggedPropval& tp)
 {return "TaggedPropval("+hexstr(tp.tag, 8)+", "+tp.toString()+")";}
 
@@ -203,8 +291,33 @@ py::object TaggedPropval_getValue(const TaggedPropval& tp)
 	return py::none();
 }
 
+py::memoryview TaggedPropval_view(const py::object& self)
+{
+	const TaggedPropval& tp = self.cast<const TaggedPropval&>();
+	switch(tp.type)
+	{
+	case PropvalType::BINARY:
+		return makeView(self, static_cast<const uint8_t*>(tp.binaryData()), tp.binaryLength(), &tp);
+	case PropvalType::SHORT_ARRAY:
+		return makeView(self, tp.value.a16.first, tp.count(), &tp);
+	case PropvalType::LONG_ARRAY:
+		return makeView(self, tp.value.a32.first, tp.count(), &tp);
+	case PropvalType::LONGLONG_ARRAY:
+	case PropvalType::CURRENCY_ARRAY:
+		return makeView(self, tp.value.a64.first, tp.count(), &tp);
+	case PropvalType::FLOAT_ARRAY:
+		return makeView(self, tp.value.af.first, tp.count(), &tp);
+	case PropvalType::DOUBLE_ARRAY:
+	case PropvalType::FLOATINGTIME_ARRAY:
+		return makeView(self, tp.value.ad.first, tp.count(), &tp);
+	}
+	throw py::type_error("Cannot create buffer view of "+std::string(tp.typeName())+" tag.");
+}
+
 void TaggedPropval_setValue(TaggedPropval& tp, const py::object& value) try
 {
+	if(bufferExports.count(&tp))
+		throw py::buffer_error("Cannot assign value while buffer views of it exist");
 	switch(tp.type)
 	{
 	case PropvalType::BYTE:
@@ -274,6 +387,440 @@ struct pyRestriction
 	{return [v](const py::object&){return v;};}
 };
 
+///////////////////////////////////////////////////////////////////////////////
+// Columnar tables
+
+using Column = ColumnarTableResponse::Column;
+
+py::memoryview Column_values(const py::object& self)
+{
+	const Column& col = self.cast<const Column&>();
+	if(col.kind == Column::REAL)
+		return makeView(self, reinterpret_cast<const double*>(col.values.data()), col.values.size());
+	if(col.kind != Column::INTEGER)
+		throw py::type_error("Column does not contain scalar values");
+	return makeView(self, col.values.data(), col.values.size());
+}
+
+size_t Column_len(const Column& col)
+{
+	switch(col.kind)
+	{
+	case Column::BYTES:
+		return col.offsets.empty()? 0 : col.offsets.size()-1;
+	case Column::GENERIC:
+		return col.propvals.size();
+	default:
+		return col.values.size();
+	}
+}
+
+py::object Column_getitem(const Column& col, size_t row)
+{
+	if(row >= Column_len(col))
+		throw py::index_error();
+	if(!col.present(row))
+		return py::none();
+	switch(col.kind)
+	{
+	case Column::INTEGER:
+		return py::cast(col.value(row));
+	case Column::REAL:
+		return py::cast(col.real(row));
+	case Column::BYTES:
+		if(PropvalType::tagType(col.tag) == PropvalType::BINARY)
+		{
+			std::string_view data = col.bytes(row);
+			return py::bytes(data.data(), data.size());
+		}
+		return py::cast(col.str(row));
+	case Column::GENERIC:
+		return py::cast(col.propval(row));
+	}
+	return py::none();
+}
+
+const Column& ColumnarTableResponse_getitem(const ColumnarTableResponse& table, size_t index)
+{
+	if(index >= table.columns.size())
+		throw py::index_error();
+	return table.columns[index];
+}
+
+const Column& ColumnarTableResponse_column(const ColumnarTableResponse& table, uint32_t tag)
+{
+	const Column* col = table.column(tag);
+	if(!col)
+		throw py::key_error("No column for tag "+hexstr(tag, 8));
+	return *col;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Lazy tables
+
+/**
+ * @brief      Table result converted to Python objects on access
+ *
+ * Only the rows that are actually accessed are converted, avoiding the cost
+ * of converting the complete table up front.
+ */
+struct LazyTable
+{
+	ExmdbQueries::PropvalTable rows; ///< Table rows
+};
+
+size_t LazyTable_index(const LazyTable& table, py::ssize_t index)
+{
+	if(index < 0)
+		index += py::ssize_t(table.rows.size());
+	if(index < 0 || size_t(index) >= table.rows.size())
+		throw py::index_error();
+	return size_t(index);
+}
+
+py::list LazyTable_slice(const LazyTable& table, const py::slice& slice)
+{
+	size_t start, stop, step, length;
+	if(!slice.compute(table.rows.size(), &start, &stop, &step, &length))
+		throw py::error_already_set();
+	py::list list(length);
+	for(size_t i = 0; i < length; ++i, start += step)
+		list[i] = py::cast(table.rows[start]);
+	return list;
+}
+
+py::object TableCursor_next(TableCursor& cursor)
+{
+	const TableCursor::PropvalList* row;
+	{
+		py::gil_scoped_release release;
+		row = cursor.next();
+	}
+	if(!row)
+		throw py::stop_iteration();
+	return py::cast(*row);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Asyncio integration
+
+static py::handle pyExmdbError, pyConnectionError, pyTimeoutError, pyCancelledError, pyProtocolError,
+                  pySerializationError; ///< Registered exception types
+
+/**
+ * @brief      Convert C++ exception to Python exception object
+ *
+ * @param      err   Exception to convert
+ *
+ * @return     Python exception instance
+ */
+py::object pyException(const std::exception_ptr& err)
+{
+	try
+	{std::rethrow_exception(err);}
+	catch(const exmdbpp::TimeoutError& e)
+	{return pyTimeoutError(e.what());}
+	catch(const exmdbpp::CancelledError& e)
+	{return pyCancelledError(e.what());}
+	catch(const exmdbpp::ConnectionError& e)
+	{return pyConnectionError(e.what());}
+	catch(const exmdbpp::ExmdbProtocolError& e)
+	{return pyProtocolError(e.what());}
+	catch(const exmdbpp::SerializationError& e)
+	{return pySerializationError(e.what());}
+	catch(const exmdbpp::ExmdbError& e)
+	{return pyExmdbError(e.what());}
+	catch(const std::exception& e)
+	{return py::reinterpret_borrow<py::object>(PyExc_RuntimeError)(e.what());}
+}
+
+/**
+ * @brief      AsyncClient driven by an asyncio event loop
+ *
+ * Registers the file descriptor of the client with the event loop, which
+ * then processes the responses and resolves the asyncio futures returned by
+ * the request functions. All requests are multiplexed over a fixed number of
+ * connections, no threads are involved.
+ *
+ * All functions must be called from the thread running the event loop.
+ * Only the initial connections are established synchronously by the
+ * constructor, reconnects do not block the event loop.
+ */
+class AsyncQueries
+{
+public:
+	AsyncQueries(const std::string& host, const std::string& port, const std::string& homedir, bool isPrivate,
+	             size_t connections, py::object eventLoop) :
+	    loop(checkLoop(std::move(eventLoop))), client(host, port, homedir, isPrivate, connections)
+	{
+		loop.attr("add_reader")(client.fd(), py::cpp_function([this]
+		{
+			client.process(0);
+			schedule();
+		}));
+		registered = true;
+	}
+
+	~AsyncQueries()
+	{close();}
+
+	AsyncQueries(const AsyncQueries&) = delete;
+	AsyncQueries& operator=(const AsyncQueries&) = delete;
+
+	/**
+	 * @brief      Remove client from the event loop
+	 *
+	 * Futures of pending requests are not resolved anymore.
+	 */
+	void close()
+	{
+		if(!registered)
+			return;
+		registered = false;
+		try
+		{
+			loop.attr("remove_reader")(client.fd());
+			if(!timer.is_none())
+				timer.attr("cancel")();
+			timer = py::none();
+		}
+		catch(py::error_already_set& e)
+		{e.discard_as_unraisable(__func__);}
+	}
+
+	size_t pending() const noexcept
+	{return client.pending();}
+
+	void setTimeout(double seconds)
+	{client.setTimeout(std::chrono::milliseconds(int64_t(seconds*1000)));}
+
+	py::object deleteFolder(const std::string& homedir, uint64_t folderId)
+	{return call<DeleteFolderRequest>([](auto& r){return py::cast(r.success);}, homedir, 0, folderId, true);}
+
+	py::object getAllStoreProperties(const std::string& homedir)
+	{return call<GetAllStorePropertiesRequest>([](auto& r){return py::cast(std::move(r.proptags));}, homedir);}
+
+	py::object getFolderProperties(const std::string& homedir, uint32_t cpid, uint64_t folderId, const std::vector<uint32_t>& proptags)
+	{return call<GetFolderPropertiesRequest>([](auto& r){return py::cast(std::move(r.propvals));}, homedir, cpid, folderId, proptags);}
+
+	py::object getStoreProperties(const std::string& homedir, uint32_t cpid, const std::vector<uint32_t>& proptags)
+	{return call<GetStorePropertiesRequest>([](auto& r){return py::cast(std::move(r.propvals));}, homedir, cpid, proptags);}
+
+	py::object removeStoreProperties(const std::string& homedir, const std::vector<uint32_t>& proptags)
+	{return call<RemoveStorePropertiesRequest>([](auto&){return py::none();}, homedir, proptags);}
+
+	py::object setFolderProperties(const std::string& homedir, uint32_t cpid, uint64_t folderId,
+	                               const std::vector<TaggedPropval>& propvals)
+	{return call<SetFolderPropertiesRequest>([](auto& r){return py::cast(std::move(r.problems));}, homedir, cpid, folderId, propvals);}
+
+	py::object setStoreProperties(const std::string& homedir, uint32_t cpid, const std::vector<TaggedPropval>& propvals)
+	{return call<SetStorePropertiesRequest>([](auto& r){return py::cast(std::move(r.problems));}, homedir, cpid, propvals);}
+
+	py::object unloadStore(const std::string& homedir)
+	{return call<UnloadStoreRequest>([](auto&){return py::none();}, homedir);}
+
+	/**
+	 * @brief      List folders (see ExmdbQueries::listFolders)
+	 *
+	 * Table loading, querying and unloading are chained via callbacks
+	 * without blocking the event loop.
+	 */
+	py::object listFolders(const std::string& homedir, uint64_t folderId, bool recursive, const std::vector<uint32_t>& proptags,
+	                       uint32_t offset, uint32_t limit, const Restriction& restriction)
+	{
+		py::object future = loop.attr("create_future")();
+		client.submit<LoadHierarchyTableRequest>([=](Response_t<LoadHierarchyTableRequest>* response, std::exception_ptr err)
+		{
+			if(response)
+				query(future, homedir, response->tableId, proptags, offset,
+				      offset || limit || response->rowCount < limit? limit : response->rowCount);
+			else
+				resolve(future, []{return py::none();}, err);
+		}, homedir, folderId, "", recursive? TableFlags::DEPTH : 0, restriction);
+		schedule();
+		return future;
+	}
+
+	/**
+	 * @brief      Get folder member list (see ExmdbQueries::getFolderMemberList)
+	 */
+	py::object getFolderMemberList(const std::string& homedir, uint64_t folderId)
+	{
+		static const std::vector<uint32_t> proptags{PropTag::MEMBERID, PropTag::SMTPADDRESS, PropTag::MEMBERNAME, PropTag::MEMBERRIGHTS};
+		py::object future = loop.attr("create_future")();
+		client.submit<LoadPermissionTableRequest>([=](Response_t<LoadPermissionTableRequest>* response, std::exception_ptr err)
+		{
+			if(response)
+				query(future, homedir, response->tableId, proptags, 0, response->rowCount);
+			else
+				resolve(future, []{return py::none();}, err);
+		}, homedir, folderId, 0);
+		schedule();
+		return future;
+	}
+
+private:
+	/**
+	 * @brief      Determine event loop to use
+	 *
+	 * Defaults to the running loop of the current thread.
+	 *
+	 * @param      eventLoop  Event loop passed by the caller or None
+	 *
+	 * @throws     py::error_already_set    No loop given and no loop running
+	 * @throws     std::invalid_argument    Loop is closed or does not support file descriptor watching
+	 *
+	 * @return     Event loop
+	 */
+	static py::object checkLoop(py::object eventLoop)
+	{
+		if(eventLoop.is_none())
+			return py::module_::import("asyncio").attr("get_running_loop")();
+		if(!py::hasattr(eventLoop, "add_reader") || !py::hasattr(eventLoop, "call_later"))
+			throw std::invalid_argument("Event loop does not support file descriptor watching");
+		if(eventLoop.attr("is_closed")().cast<bool>())
+			throw std::invalid_argument("Event loop is closed");
+		return eventLoop;
+	}
+
+	/**
+	 * @brief      Submit request and return future resolved with the converted response
+	 *
+	 * @param      convert  Function converting the response to a Python object
+	 * @param      args     Request arguments
+	 *
+	 * @return     asyncio future
+	 */
+	template<class Request, typename F, typename... Args>
+	py::object call(F convert, const Args&... args)
+	{
+		py::object future = loop.attr("create_future")();
+		client.submit<Request>([future, convert](Response_t<Request>* response, std::exception_ptr err)
+		{resolve(future, [&]{return convert(*response);}, err);}, args...);
+		schedule();
+		return future;
+	}
+
+	/**
+	 * @brief      Arm event loop timer for the next client timeout
+	 *
+	 * Timed out requests and connection attempts are only detected by
+	 * process(), which must therefore also run when the file descriptor does
+	 * not become readable. An armed timer is only replaced by an earlier one.
+	 */
+	void schedule()
+	{
+		int ms = client.timeout();
+		if(!registered || ms < 0)
+			return;
+		auto due = std::chrono::steady_clock::now()+std::chrono::milliseconds(ms);
+		if(!timer.is_none())
+		{
+			if(timerDue <= due)
+				return;
+			timer.attr("cancel")();
+		}
+		timerDue = due;
+		timer = loop.attr("call_later")(ms/1000.0, py::cpp_function([this]
+		{
+			timer = py::none();
+			client.process(0);
+			schedule();
+		}));
+	}
+
+	/**
+	 * @brief      Query loaded table, unload it and resolve future with the rows
+	 *
+	 * The table is unloaded after the query completed (successfully or not).
+	 */
+	void query(const py::object& future, const std::string& homedir, uint32_t tableId, const std::vector<uint32_t>& proptags,
+	           uint32_t offset, uint32_t limit)
+	{
+		try
+		{
+			client.submit<QueryTableRequest>([=](Response_t<QueryTableRequest>* response, std::exception_ptr err)
+			{
+				try
+				{client.submit<UnloadTableRequest>([](Response_t<UnloadTableRequest>*, std::exception_ptr){}, homedir, tableId);}
+				catch(...)
+				{}
+				resolve(future, [&]{return py::cast(std::move(response->entries));}, err);
+			}, homedir, "", 0, tableId, proptags, offset, limit);
+		}
+		catch(...)
+		{resolve(future, []{return py::none();}, std::current_exception());}
+	}
+
+	/**
+	 * @brief      Resolve future with result or exception
+	 *
+	 * Does nothing if the future was already cancelled.
+	 *
+	 * @param      future  Future to resolve
+	 * @param      result  Function producing the result (only called if err is empty)
+	 * @param      err     Exception to set
+	 */
+	template<typename F>
+	static void resolve(const py::object& future, F&& result, std::exception_ptr err)
+	{
+		try
+		{
+			if(future.attr("done")().cast<bool>())
+				return;
+			if(!err)
+			{
+				future.attr("set_result")(result());
+				return;
+			}
+		}
+		catch(py::error_already_set& e)
+		{
+			e.discard_as_unraisable(__func__);
+			return;
+		}
+		catch(...)
+		{err = std::current_exception();}
+		try
+		{future.attr("set_exception")(pyException(err));}
+		catch(py::error_already_set& e)
+		{e.discard_as_unraisable(__func__);}
+	}
+
+	py::object loop; ///< Event loop the client is registered with
+	exmdbpp::AsyncClient client; ///< Client performing the requests
+	py::object timer = py::none(); ///< Handle of the armed timeout timer (None if not armed)
+	std::chrono::steady_clock::time_point timerDue; ///< Time at which the armed timer fires
+	bool registered = false; ///< Whether the file descriptor is registered with the loop
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+py::dict Histogram_toDict(const exmdbpp::Histogram& hist)
+{
+	py::dict res;
+	res["count"] = hist.count();
+	res["sum"] = hist.sum();
+	res["p50"] = hist.quantile(0.5);
+	res["p90"] = hist.quantile(0.9);
+	res["p99"] = hist.quantile(0.99);
+	return res;
+}
+
+py::dict Metrics_stats(const exmdbpp::Metrics& metrics, uint8_t callId)
+{
+	const exmdbpp::Metrics::CallStats& stats = metrics.stats(callId);
+	py::dict res;
+	res["calls"] = stats.calls.load(std::memory_order_relaxed);
+	res["errors"] = stats.errors.load(std::memory_order_relaxed);
+	res["requestBytes"] = stats.requestBytes.load(std::memory_order_relaxed);
+	res["responseBytes"] = stats.responseBytes.load(std::memory_order_relaxed);
+	res["serialize"] = Histogram_toDict(stats.serialize);
+	res["network"] = Histogram_toDict(stats.network);
+	res["deserialize"] = Histogram_toDict(stats.deserialize);
+	return res;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Module definition
 
@@ -325,11 +872,37 @@ PYBIND11_MODULE(pyexmdb, m)
 	    .def("createFolder", &ExmdbQueries::createFolder, release_gil(),
 	         py::arg("homedir"), py::arg("domainId"), py::arg("folderName"), py::arg("container"), py::arg("comment"),
 	         py::arg("parentId")=0)
+	    .def("createFolders", &ExmdbQueries::createFolders, release_gil(),
+	         py::arg("homedir"), py::arg("domainId"), py::arg("folders"))
 	    .def("deleteFolder", &ExmdbQueries::deleteFolder, release_gil(),
 	        py::arg("homedir"), py::arg("folderId"), py::arg("clear")=false)
+	    .def("deleteFolders", &ExmdbQueries::deleteFolders, release_gil(),
+	         py::arg("homedir"), py::arg("folderIds"), py::arg("clear")=false)
 	    .def("findFolder", &ExmdbQueries::findFolder, release_gil(),
 	         py::arg("homedir"), py::arg("name"), py::arg("folderId")=0, py::arg("recursive")=true, py::arg("fuzzyLevel")=0,
 	         py::arg("proptags") = ExmdbQueries::defaultFolderProps)
+	    .def("findFolderLazy", [](ExmdbQueries& queries, const std::string& homedir, const std::string& name, uint64_t folderId,
+	                              bool recursive, uint32_t fuzzyLevel, const std::vector<uint32_t>& proptags)
+	         {return LazyTable{queries.findFolder(homedir, name, folderId, recursive, fuzzyLevel, proptags)};},
+	         release_gil(),
+	         py::arg("homedir"), py::arg("name"), py::arg("folderId")=0, py::arg("recursive")=true, py::arg("fuzzyLevel")=0,
+	         py::arg("proptags") = ExmdbQueries::defaultFolderProps)
+	    .def("hierarchyCursor", [](ExmdbQueries& queries, const std::string& homedir, uint64_t folderId,
+	                               const std::vector<uint32_t>& proptags, bool recursive, uint32_t pageSize,
+	                               const Restriction& restriction)
+	         {return std::unique_ptr<TableCursor>(new TableCursor(TableCursor::hierarchy(queries, homedir, folderId, proptags,
+	                                                                                    recursive, pageSize, false, restriction)));},
+	         release_gil(), py::keep_alive<0, 1>(),
+	         py::arg("homedir"), py::arg("folderId"), py::arg("proptags") = ExmdbQueries::defaultFolderProps,
+	         py::arg("recursive")=false, py::arg("pageSize")=1000, py::arg("restriction")=Restriction::XNULL())
+	    .def("contentCursor", [](ExmdbQueries& queries, const std::string& homedir, uint64_t folderId,
+	                             const std::vector<uint32_t>& proptags, uint8_t tableFlags, uint32_t pageSize,
+	                             const Restriction& restriction)
+	         {return std::unique_ptr<TableCursor>(new TableCursor(TableCursor::content(queries, homedir, folderId, proptags,
+	                                                                                  tableFlags, pageSize, false, restriction)));},
+	         release_gil(), py::keep_alive<0, 1>(),
+	         py::arg("homedir"), py::arg("folderId"), py::arg("proptags"), py::arg("tableFlags")=0,
+	         py::arg("pageSize")=1000, py::arg("restriction")=Restriction::XNULL())
 	    .def("getAllStoreProperties", &ExmdbQueries::getAllStoreProperties,  release_gil(),
 	         py::arg("homedir"))
 	    .def("getFolderMemberList", &ExmdbQueries::getFolderMemberList, release_gil(),
@@ -344,6 +917,18 @@ PYBIND11_MODULE(pyexmdb, m)
 	         py::arg("homedir"), py::arg("folderId"), py::arg("recursive")=false,
 	         py::arg("proptags") = ExmdbQueries::defaultFolderProps, py::arg("offset")=0, py::arg("limit")=0,
 	         py::arg("restriction")=Restriction::XNULL())
+	    .def("listFoldersLazy", [](ExmdbQueries& queries, const std::string& homedir, uint64_t folderId, bool recursive,
+	                               const std::vector<uint32_t>& proptags, uint32_t offset, uint32_t limit,
+	                               const Restriction& restriction)
+	         {return LazyTable{queries.listFolders(homedir, folderId, recursive, proptags, offset, limit, restriction)};},
+	         release_gil(),
+	         py::arg("homedir"), py::arg("folderId"), py::arg("recursive")=false,
+	         py::arg("proptags") = ExmdbQueries::defaultFolderProps, py::arg("offset")=0, py::arg("limit")=0,
+	         py::arg("restriction")=Restriction::XNULL())
+	    .def("listFoldersColumnar", &ExmdbQueries::listFoldersColumnar, release_gil(),
+	         py::arg("homedir"), py::arg("folderId"), py::arg("recursive")=false,
+	         py::arg("proptags") = ExmdbQueries::defaultFolderProps, py::arg("offset")=0, py::arg("limit")=0,
+	         py::arg("restriction")=Restriction::XNULL())
 	    .def("removeStoreProperties", &ExmdbQueries::removeStoreProperties, release_gil(),
 	         py::arg("homedir"), py::arg("proptags"))
 	    .def("removeDevice", &ExmdbQueries::removeDevice, release_gil(),
@@ -354,6 +939,8 @@ PYBIND11_MODULE(pyexmdb, m)
 	         py::arg("homedir"), py::arg("create"), py::arg("propnames"))
 	    .def("resyncDevice", &ExmdbQueries::resyncDevice, release_gil(),
 	         py::arg("homedir"), py::arg("folderName"), py::arg("deviceId"), py::arg("userId"))
+	    .def("syncFolderTree", &ExmdbQueries::syncFolderTree, release_gil(),
+	         py::arg("homedir"), py::arg("tree"))
 	    .def("setFolderMember",
 	         py::overload_cast<const std::string&, uint64_t, uint64_t, uint32_t, ExmdbQueries::PermissionMode>(&ExmdbQueries::setFolderMember),
 	         py::arg("homedir"), py::arg("folderId"), py::arg("ID"), py::arg("rights"), py::arg("mode")=ExmdbQueries::ADD,
@@ -362,14 +949,117 @@ PYBIND11_MODULE(pyexmdb, m)
 	         py::overload_cast<const std::string&, uint64_t, const std::string&, uint32_t, ExmdbQueries::PermissionMode>(&ExmdbQueries::setFolderMember),
 	         py::arg("homedir"), py::arg("folderId"), py::arg("username"), py::arg("rights"), py::arg("mode")=ExmdbQueries::ADD,
 	         release_gil())
+	    .def("setFolderMemberBatch", &ExmdbQueries::setFolderMemberBatch, release_gil(),
+	         py::arg("homedir"), py::arg("folderIds"), py::arg("username"), py::arg("rights"), py::arg("mode")=ExmdbQueries::ADD)
 	    .def("setFolderMembers", &ExmdbQueries::setFolderMembers, release_gil(),
 	         py::arg("homedir"), py::arg("folderId"), py::arg("usernames"), py::arg("rights"))
 	    .def("setFolderProperties", &ExmdbQueries::setFolderProperties, release_gil(),
 	         py::arg("homedir"), py::arg("cpid"), py::arg("folderId"), py::arg("propvals"))
 	    .def("setStoreProperties", &ExmdbQueries::setStoreProperties, release_gil(),
 	         py::arg("homedir"), py::arg("cpid"), py::arg("propvals"))
+	    .def("setSubtreeMember", &ExmdbQueries::setSubtreeMember, release_gil(),
+	         py::arg("homedir"), py::arg("folderId"), py::arg("username"), py::arg("rights"), py::arg("mode")=ExmdbQueries::ADD)
 	    .def("unloadStore", &ExmdbQueries::unloadStore, release_gil(),
-	         py::arg("homedir"));
+	         py::arg("homedir"))
+	    .def("alive", &ExmdbQueries::alive, release_gil())
+	    .def("setSocketOptions", &ExmdbQueries::setSocketOptions,
+	         py::arg("options"))
+	    .def("setCancellationToken", &ExmdbQueries::setCancellationToken,
+	         py::arg("token"))
+	    .def("setConnectTimeout", [](ExmdbQueries& queries, double seconds)
+	         {queries.setConnectTimeout(std::chrono::milliseconds(int64_t(seconds*1000)));},
+	         py::arg("timeout"))
+	    .def("setTimeout", [](ExmdbQueries& queries, double seconds)
+	         {queries.setTimeout(std::chrono::milliseconds(int64_t(seconds*1000)));},
+	         py::arg("timeout"))
+	    .def("setInstrumentation", &ExmdbQueries::setInstrumentation,
+	         py::arg("instrumentation"))
+	    .def("getInstrumentation", &ExmdbQueries::getInstrumentation)
+	    .def("getFolder", &ExmdbQueries::getFolder, release_gil(),
+	         py::arg("homedir"), py::arg("folderId"))
+	    .def("setFolderCache", &ExmdbQueries::setFolderCache,
+	         py::arg("cache"))
+	    .def("getFolderCache", &ExmdbQueries::getFolderCache)
+	    .def("setNamedPropCache", &ExmdbQueries::setNamedPropCache,
+	         py::arg("cache"))
+	    .def("getNamedPropCache", &ExmdbQueries::getNamedPropCache);
+
+	py::class_<AsyncQueries>(m, "AsyncExmdbQueries", "Asyncio exmdb client interface")
+	        .def(py::init<const std::string&, const std::string&, const std::string&, bool, size_t, py::object>(),
+	             py::arg("host"), py::arg("port"), py::arg("homedir"), py::arg("isPrivate"), py::arg("connections")=1,
+	             py::arg("loop")=py::none())
+	        .def("close", &AsyncQueries::close)
+	        .def("deleteFolder", &AsyncQueries::deleteFolder, py::arg("homedir"), py::arg("folderId"))
+	        .def("getAllStoreProperties", &AsyncQueries::getAllStoreProperties, py::arg("homedir"))
+	        .def("getFolderMemberList", &AsyncQueries::getFolderMemberList, py::arg("homedir"), py::arg("folderId"))
+	        .def("getFolderProperties", &AsyncQueries::getFolderProperties,
+	             py::arg("homedir"), py::arg("cpid"), py::arg("folderId"), py::arg("proptags") = ExmdbQueries::defaultFolderProps)
+	        .def("getStoreProperties", &AsyncQueries::getStoreProperties,
+	             py::arg("homedir"), py::arg("cpid"), py::arg("proptags"))
+	        .def("listFolders", &AsyncQueries::listFolders,
+	             py::arg("homedir"), py::arg("folderId"), py::arg("recursive")=false,
+	             py::arg("proptags") = ExmdbQueries::defaultFolderProps, py::arg("offset")=0, py::arg("limit")=0,
+	             py::arg("restriction")=Restriction::XNULL())
+	        .def("removeStoreProperties", &AsyncQueries::removeStoreProperties, py::arg("homedir"), py::arg("proptags"))
+	        .def("setFolderProperties", &AsyncQueries::setFolderProperties,
+	             py::arg("homedir"), py::arg("cpid"), py::arg("folderId"), py::arg("propvals"))
+	        .def("setStoreProperties", &AsyncQueries::setStoreProperties,
+	             py::arg("homedir"), py::arg("cpid"), py::arg("propvals"))
+	        .def("setTimeout", &AsyncQueries::setTimeout, py::arg("timeout"))
+	        .def("unloadStore", &AsyncQueries::unloadStore, py::arg("homedir"))
+	        .def_property_readonly("pending", &AsyncQueries::pending);
+
+	py::class_<BufferView>(m, "BufferView", py::buffer_protocol(), "Read-only view of library owned memory")
+	        .def_buffer([](const BufferView& view)
+	             {return py::buffer_info(const_cast<void*>(view.data), view.itemsize, view.format, view.count, true);});
+
+	py::class_<exmdbpp::ExmdbClient::SocketOptions>(m, "SocketOptions", "Options applied to client sockets")
+	        .def(py::init())
+	        .def_readwrite("noDelay", &exmdbpp::ExmdbClient::SocketOptions::noDelay)
+	        .def_readwrite("keepAlive", &exmdbpp::ExmdbClient::SocketOptions::keepAlive)
+	        .def_property("keepIdle", [](const exmdbpp::ExmdbClient::SocketOptions& o){return o.keepIdle.count();},
+	                      [](exmdbpp::ExmdbClient::SocketOptions& o, int64_t v){o.keepIdle = std::chrono::seconds(v);})
+	        .def_property("keepInterval", [](const exmdbpp::ExmdbClient::SocketOptions& o){return o.keepInterval.count();},
+	                      [](exmdbpp::ExmdbClient::SocketOptions& o, int64_t v){o.keepInterval = std::chrono::seconds(v);})
+	        .def_readwrite("keepCount", &exmdbpp::ExmdbClient::SocketOptions::keepCount)
+	        .def_readwrite("sendBuffer", &exmdbpp::ExmdbClient::SocketOptions::sendBuffer)
+	        .def_readwrite("receiveBuffer", &exmdbpp::ExmdbClient::SocketOptions::receiveBuffer);
+
+	py::class_<exmdbpp::CancellationToken, std::shared_ptr<exmdbpp::CancellationToken>>(m, "CancellationToken",
+	                                                                                   "Flag to abort blocking requests")
+	        .def(py::init())
+	        .def("cancel", &exmdbpp::CancellationToken::cancel)
+	        .def("reset", &exmdbpp::CancellationToken::reset)
+	        .def_property_readonly("cancelled", &exmdbpp::CancellationToken::cancelled);
+
+	py::class_<ColumnarTableResponse> columnarTable(m, "ColumnarTable", "Column oriented table");
+	columnarTable.def_readonly("rows", &ColumnarTableResponse::rows)
+	        .def("column", &ColumnarTableResponse_column, py::return_value_policy::reference_internal, py::arg("tag"))
+	        .def("__getitem__", &ColumnarTableResponse_getitem, py::return_value_policy::reference_internal)
+	        .def("__len__", [](const ColumnarTableResponse& table){return table.columns.size();});
+
+	py::class_<Column> column(columnarTable, "Column", "Values of a single tag");
+
+	py::enum_<Column::Kind>(column, "Kind")
+	        .value("INTEGER", Column::INTEGER)
+	        .value("REAL", Column::REAL)
+	        .value("BYTES", Column::BYTES)
+	        .value("GENERIC", Column::GENERIC)
+	        .export_values();
+
+	column.def_readonly("tag", &Column::tag)
+	      .def_readonly("kind", &Column::kind)
+	      .def_property_readonly("values", &Column_values)
+	      .def_property_readonly("presence", [](const py::object& self)
+	           {const Column& col = self.cast<const Column&>(); return makeView(self, col.presence.data(), col.presence.size());})
+	      .def_property_readonly("data", [](const py::object& self)
+	           {const Column& col = self.cast<const Column&>();
+	            return makeView(self, reinterpret_cast<const uint8_t*>(col.data.data()), col.data.size());})
+	      .def_property_readonly("offsets", [](const py::object& self)
+	           {const Column& col = self.cast<const Column&>(); return makeView(self, col.offsets.data(), col.offsets.size());})
+	      .def("present", &Column::present, py::arg("row"))
+	      .def("__getitem__", &Column_getitem)
+	      .def("__len__", &Column_len);
 
 	py::class_<Folder>(m, "Folder")
 	        .def(py::init())
@@ -381,8 +1071,41 @@ PYBIND11_MODULE(pyexmdb, m)
 	        .def_readwrite("container", &Folder::container)
 	        .def_readwrite("parentId", &Folder::parentId)
 	        .def_readwrite("syncToMobile", &Folder::syncToMobile)
+	        .def_readwrite("changeNumber", &Folder::changeNumber)
+	        .def_readwrite("lastModified", &Folder::lastModified)
 	        .def("__repr__", &Folder_repr);
 
+	py::class_<FolderChanges>(m, "FolderChanges")
+	        .def_readonly("added", &FolderChanges::added)
+	        .def_readonly("modified", &FolderChanges::modified)
+	        .def_readonly("removed", &FolderChanges::removed)
+	        .def("empty", &FolderChanges::empty);
+
+	py::class_<FolderTree>(m, "FolderTree", "Client-side copy of a folder hierarchy")
+	        .def(py::init<uint64_t>(), py::arg("root"))
+	        .def_property_readonly("root", &FolderTree::root)
+	        .def_property_readonly("modifiedSince", &FolderTree::modifiedSince)
+	        .def("find", &FolderTree::find, py::arg("folderId"), py::return_value_policy::copy)
+	        .def("children", [](const FolderTree& tree, uint64_t parentId)
+	             {
+	                std::vector<Folder> folders;
+	                for(const Folder* folder : tree.children(parentId))
+	                    folders.emplace_back(*folder);
+	                return folders;
+	             }, py::arg("parentId"))
+	        .def("clear", &FolderTree::clear)
+	        .def("__len__", &FolderTree::size);
+
+	py::class_<FolderCache, std::shared_ptr<FolderCache>>(m, "FolderCache", "Shared folder hierarchy cache")
+	        .def(py::init([](double ttl)
+	             {return std::make_shared<FolderCache>(std::chrono::milliseconds(uint64_t(ttl*1000)));}),
+	             py::arg("ttl")=60.0)
+	        .def("clear", &FolderCache::clear)
+	        .def("invalidate", py::overload_cast<const std::string&>(&FolderCache::invalidate), py::arg("homedir"))
+	        .def("invalidate", py::overload_cast<const std::string&, uint64_t>(&FolderCache::invalidate),
+	             py::arg("homedir"), py::arg("folderId"))
+	        .def("size", &FolderCache::size);
+
 	py::class_<FolderList>(m, "FolderList")
 	        .def(py::init<const ExmdbQueries::PropvalTable&, uint32_t>(), py::arg("table"), py::arg("syncToMobileTag")=0)
 	        .def_readonly("folders", &FolderList::folders)
@@ -399,6 +1122,36 @@ PYBIND11_MODULE(pyexmdb, m)
 	        .def_readonly("rights", &FolderMemberList::Member::rights)
 	        .def_property_readonly("special", &FolderMemberList::Member::special);
 
+	py::class_<exmdbpp::Instrumentation, std::shared_ptr<exmdbpp::Instrumentation>>(m, "Instrumentation");
+
+	py::class_<exmdbpp::Metrics, exmdbpp::Instrumentation, std::shared_ptr<exmdbpp::Metrics>>(m, "Metrics",
+	                                                                                         "Per-call client statistics")
+	        .def(py::init())
+	        .def("errors", &exmdbpp::Metrics::errors, py::arg("status"))
+	        .def("exportText", &exmdbpp::Metrics::exportText)
+	        .def("reconnects", &exmdbpp::Metrics::reconnects)
+	        .def("reset", &exmdbpp::Metrics::reset)
+	        .def("stats", &Metrics_stats, py::arg("callId"));
+
+	py::class_<LazyTable>(m, "LazyTable", "Table result with rows converted on access")
+	        .def("__len__", [](const LazyTable& table){return table.rows.size();})
+	        .def("__getitem__", [](const LazyTable& table, py::ssize_t index)
+	             {return py::cast(table.rows[LazyTable_index(table, index)]);})
+	        .def("__getitem__", &LazyTable_slice)
+	        .def("__iter__", [](const LazyTable& table){return py::make_iterator(table.rows.begin(), table.rows.end());},
+	             py::keep_alive<0, 1>())
+	        .def("folder", [](const LazyTable& table, py::ssize_t index, uint32_t syncToMobileTag)
+	             {return Folder(table.rows[LazyTable_index(table, index)], syncToMobileTag);},
+	             py::arg("index"), py::arg("syncToMobileTag")=0)
+	        .def("folders", [](const LazyTable& table){return FolderList(table.rows);},
+	             "Convert all rows to Folder objects");
+
+	py::class_<NamedPropCache, std::shared_ptr<NamedPropCache>>(m, "NamedPropCache", "Shared named property ID cache")
+	        .def(py::init())
+	        .def("clear", &NamedPropCache::clear)
+	        .def("invalidate", &NamedPropCache::invalidate, py::arg("homedir"))
+	        .def("size", &NamedPropCache::size);
+
 	py::class_<GUID>(m, "GUID")
 	        .def_readonly_static("PSETID_GROMOX", &GUID::PSETID_GROMOX);
 
@@ -417,6 +1170,13 @@ PYBIND11_MODULE(pyexmdb, m)
 	py::class_<TableResponse>(m, "TableResponse", "Response to a query table request")
 	    .def_readonly("entries", &TableResponse::entries);
 
+	py::class_<TableCursor>(m, "TableCursor", "Iterator retrieving table rows page by page")
+	        .def("__iter__", [](TableCursor& cursor) -> TableCursor& {return cursor;}, py::return_value_policy::reference)
+	        .def("__next__", &TableCursor_next)
+	        .def("nextPage", [](TableCursor& cursor){return LazyTable{cursor.nextPage()};}, release_gil())
+	        .def("close", &TableCursor::close, release_gil())
+	        .def_property_readonly("rowCount", &TableCursor::rowCount);
+
 	py::class_<TaggedPropval>(m, "TaggedPropval")
 	        .def(py::init(&TaggedPropval_init),
 	             py::arg("tag"), py::arg("value"))
@@ -424,10 +1184,16 @@ PYBIND11_MODULE(pyexmdb, m)
 	        .def_readonly("tag", &TaggedPropval::tag)
 	        .def_readonly("type", &TaggedPropval::type)
 	        .def_property("val", TaggedPropval_getValue, TaggedPropval_setValue)
+	        .def("view", &TaggedPropval_view,
+	             "Return read-only memoryview of a binary or numeric array value (val cannot be assigned while views exist)")
 	        .def("__repr__", &TaggedPropval_repr);
 
 	auto exmdbError = py::register_exception<exmdbpp::ExmdbError>(m, "ExmdbError", PyExc_RuntimeError);
-	py::register_exception<exmdbpp::ConnectionError>(m, "ConnectionError", exmdbError.ptr());
-	py::register_exception<exmdbpp::ExmdbProtocolError>(m, "ExmdbProtocolError", exmdbError.ptr());
-	py::register_exception<exmdbpp::SerializationError>(m, "SerializationError", exmdbError.ptr());
+	pyExmdbError = exmdbError;
+	auto connectionError = py::register_exception<exmdbpp::ConnectionError>(m, "ConnectionError", exmdbError.ptr());
+	pyConnectionError = connectionError;
+	pyTimeoutError = py::register_exception<exmdbpp::TimeoutError>(m, "TimeoutError", connectionError.ptr());
+	pyCancelledError = py::register_exception<exmdbpp::CancelledError>(m, "CancelledError", connectionError.ptr());
+	pyProtocolError = py::register_exception<exmdbpp::ExmdbProtocolError>(m, "ExmdbProtocolError", exmdbError.ptr());
+	pySerializationError = py::register_exception<exmdbpp::SerializationError>(m, "SerializationError", exmdbError.ptr());
 }
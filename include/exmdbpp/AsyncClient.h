@@ -0,0 +1,214 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+
+#include "ExmdbClient.h"
+#include "IOBuffer.h"
+#include "requests.h"
+
+namespace exmdbpp
+{
+
+/**
+ * @brief      Non-blocking client multiplexing requests over multiple connections
+ *
+ * Requests are submitted without waiting for the response. Each connection
+ * processes its requests in order, so multiple requests can be in flight per
+ * connection at the same time.
+ *
+ * I/O is performed by process(), which waits for socket events and invokes
+ * the callbacks of completed requests. The file descriptor returned by fd()
+ * becomes readable whenever process() has work to do and can be integrated
+ * into external event loops.
+ *
+ * Closed connections are re-established when the next request is
+ * submitted. Reconnecting does not block: the connection is established
+ * and the handshake is performed by process(), requests submitted in the
+ * meantime are sent afterwards.
+ *
+ * Requests can be limited with setTimeout() and setDeadline(). As responses
+ * of a connection arrive in order, a request exceeding its deadline closes
+ * its connection, failing all requests pending on it with TimeoutError.
+ *
+ * The client is not thread-safe. All functions (including the callbacks,
+ * which are invoked from within process()) must be called from the same
+ * thread.
+ */
+class AsyncClient
+{
+public:
+	/**
+	 * @brief      Completion callback
+	 *
+	 * Receives a pointer to the parsed response on success. On failure, the
+	 * response pointer is null and the exception pointer contains the error.
+	 *
+	 * @tparam     Request  Request type
+	 */
+	template<class Request>
+	using Callback = std::function<void(requests::Response_t<Request>*, std::exception_ptr)>;
+
+	AsyncClient(const std::string&, const std::string&, const std::string&, bool, size_t=1);
+	~AsyncClient();
+	AsyncClient(const AsyncClient&) = delete;
+	AsyncClient& operator=(const AsyncClient&) = delete;
+
+	template<class Request, typename... Args>
+	void submit(Callback<Request>, const Args&...);
+
+	template<class Request, typename... Args>
+	std::future<requests::Response_t<Request>> send(const Args&...);
+
+	size_t process(int=-1);
+	void run();
+
+	int fd() const noexcept;
+	size_t pending() const noexcept;
+
+	int timeout() const;
+
+	void setConnectTimeout(std::chrono::milliseconds) noexcept;
+	void setTimeout(std::chrono::milliseconds) noexcept;
+	void setDeadline(std::chrono::steady_clock::time_point) noexcept;
+	void clearDeadline() noexcept;
+
+private:
+	using Handler = std::function<void(IOBuffer*, std::exception_ptr)>; ///< Type erased completion handler
+	using Clock = std::chrono::steady_clock;
+
+	/**
+	 * @brief      Resolved server address
+	 */
+	struct Address
+	{
+		int family; ///< Address family
+		sockaddr_storage addr; ///< Socket address
+		socklen_t length; ///< Length of the socket address
+	};
+
+	/**
+	 * @brief      Deadline of a submitted request
+	 */
+	struct Timer
+	{
+		Clock::time_point deadline; ///< Time at which the request fails
+		size_t channel; ///< Index of the channel the request was submitted to
+		uint64_t call; ///< Sequence number of the request on the channel
+
+		bool operator>(const Timer&) const noexcept;
+	};
+
+	struct Channel
+	{
+		int sock = -1; ///< Non-blocking socket
+		bool writing = false; ///< Whether the socket is registered for EPOLLOUT
+		bool connecting = false; ///< Whether the connection is still being established
+		bool handshake = false; ///< Whether the response to the ConnectRequest is pending
+		size_t address = 0; ///< Index of the address currently connected to
+		Clock::time_point connectDeadline; ///< Time at which the current connection attempt fails
+		IOBuffer out; ///< Serialized requests not yet sent
+		size_t sent = 0; ///< Number of bytes of `out` already sent
+		IOBuffer in; ///< Received data not yet processed
+		size_t consumed = 0; ///< Number of bytes of `in` already processed
+		std::deque<Handler> calls; ///< Handlers of requests waiting for a response
+		uint64_t submitted = 0; ///< Number of requests submitted to the channel
+		uint64_t completed = 0; ///< Number of requests completed or failed
+		std::exception_ptr error; ///< Error that caused the channel to be closed last
+	};
+
+	void resolve();
+	void open(Channel&);
+	void connect(Channel&);
+	void connected(Channel&);
+	void retry(Channel&, const std::string&);
+	void close(Channel&, const std::exception_ptr&);
+	void enqueue(Channel&, Handler&&);
+	void flush(Channel&);
+	size_t receive(Channel&);
+	void updateEvents(Channel&);
+	size_t expire();
+	int waitTime(int) const;
+	Channel& select();
+
+	std::string host, port, prefix; ///< Connection parameters
+	bool isPrivate; ///< Whether to access private or public stores
+	std::chrono::milliseconds connectTimeout{3000}; ///< Maximum time to wait for each address
+	std::chrono::milliseconds requestTimeout{0}; ///< Maximum duration of a single request (0 for unlimited)
+	Clock::time_point deadline = Clock::time_point::max(); ///< Deadline for all requests
+	std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers; ///< Deadlines of pending requests
+	std::vector<Address> addresses; ///< Server addresses resolved at construction
+	int epfd = -1; ///< epoll instance
+	std::vector<Channel> channels; ///< Connections
+	size_t calls = 0; ///< Number of requests waiting for a response
+};
+
+/**
+ * @brief      Submit a request
+ *
+ * The request is serialized immediately, sent as soon as the socket is
+ * writable and the callback is invoked by process() once the response
+ * arrived.
+ *
+ * See documentation of the specific Request for a description of the
+ * parameters.
+ *
+ * @param      callback  Function to call on completion
+ * @param      args      Values to serialize
+ *
+ * @tparam     Request   Type of the request
+ * @tparam     Args      Request arguments
+ */
+template<class Request, typename... Args>
+inline void AsyncClient::submit(Callback<Request> callback, const Args&... args)
+{
+	Channel& channel = select();
+	ExmdbClient::writeFramed<Request>(channel.out, args...);
+	enqueue(channel, [cb = std::move(callback)](IOBuffer* buff, std::exception_ptr err)
+	{
+		std::optional<requests::Response_t<Request>> response;
+		if(!err)
+			try {response.emplace(*buff);}
+			catch(...) {err = std::current_exception();}
+		cb(response? &*response : nullptr, err);
+	});
+}
+
+/**
+ * @brief      Submit a request and return future
+ *
+ * The future is only satisfied while process() is being called.
+ *
+ * @param      args     Values to serialize
+ *
+ * @tparam     Request  Type of the request
+ * @tparam     Args     Request arguments
+ *
+ * @return     Future providing the parsed response
+ */
+template<class Request, typename... Args>
+inline std::future<requests::Response_t<Request>> AsyncClient::send(const Args&... args)
+{
+	using Response = requests::Response_t<Request>;
+	auto promise = std::make_shared<std::promise<Response>>();
+	std::future<Response> future = promise->get_future();
+	submit<Request>([promise](Response* response, std::exception_ptr err)
+	{
+		if(err)
+			promise->set_exception(err);
+		else
+			promise->set_value(std::move(*response));
+	}, args...);
+	return future;
+}
+
+}
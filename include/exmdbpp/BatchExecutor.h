@@ -0,0 +1,135 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include "queries.h"
+
+namespace exmdbpp::queries
+{
+
+/**
+ * @brief      Concurrent execution of queries over many stores
+ *
+ * Runs the same query for a list of stores in parallel. Clients are leased
+ * from a QueriesRouter, so stores are placed on the same nodes (including
+ * failover) as requests sent through the router directly.
+ *
+ * The number of requests in flight is bounded by the number of worker
+ * threads and the size of each node's pool.
+ */
+class BatchExecutor
+{
+public:
+	/**
+	 * @brief      Result of the query for a single store
+	 *
+	 * @tparam     T     Result type of the query (std::monostate for void)
+	 */
+	template<typename T>
+	struct Result
+	{
+		std::string homedir; ///< Home directory of the store
+		T value{}; ///< Query result (only valid if no error occurred)
+		std::exception_ptr error; ///< Exception thrown by the query, if any
+
+		bool ok() const noexcept;
+	};
+
+	/// Result type of query function F
+	template<typename F>
+	using Result_t = std::invoke_result_t<F, ExmdbQueries&, const std::string&>;
+
+	/// Stored value type of query function F
+	template<typename F>
+	using Value_t = std::conditional_t<std::is_void_v<Result_t<F>>, std::monostate, Result_t<F>>;
+
+	explicit BatchExecutor(QueriesRouter&, size_t=0);
+
+	template<typename F>
+	std::vector<Result<Value_t<F>>> run(const std::vector<std::string>&, F&&);
+
+private:
+	QueriesRouter& router; ///< Router providing the clients
+	size_t threads; ///< Maximum number of worker threads (0 to use the router's capacity)
+};
+
+/**
+ * @brief      Check whether the query completed successfully
+ */
+template<typename T>
+inline bool BatchExecutor::Result<T>::ok() const noexcept
+{return !error;}
+
+/**
+ * @brief      Run query for each store
+ *
+ * The query is invoked with a leased client and the home directory of the
+ * store, from multiple threads concurrently. Exceptions thrown by the query
+ * are stored in the result of the respective store.
+ *
+ * Stores that cannot be routed fail with std::invalid_argument, stores
+ * whose nodes are all unreachable with ConnectionError.
+ *
+ * @param      homedirs  Home directories of the stores
+ * @param      query     Function to call for each store
+ *
+ * @tparam     F         Query function type, invocable as `query(ExmdbQueries&, const std::string&)`
+ *
+ * @throws     std::system_error  A worker thread could not be started (after stopping the others)
+ *
+ * @return     Results in order of the home directories
+ */
+template<typename F>
+std::vector<BatchExecutor::Result<BatchExecutor::Value_t<F>>> BatchExecutor::run(const std::vector<std::string>& homedirs,
+                                                                                 F&& query)
+{
+	std::vector<Result<Value_t<F>>> results(homedirs.size());
+	std::atomic<size_t> next = 0;
+	auto worker = [&]
+	{
+		for(size_t index = next++; index < homedirs.size(); index = next++)
+		{
+			Result<Value_t<F>>& result = results[index];
+			try
+			{
+				result.homedir = homedirs[index];
+				auto client = router.lease(result.homedir);
+				if constexpr(std::is_void_v<Result_t<F>>)
+					query(*client, result.homedir);
+				else
+					result.value = query(*client, result.homedir);
+			}
+			catch(...)
+			{result.error = std::current_exception();}
+		}
+	};
+	size_t count = std::min(threads? threads : router.capacity(), homedirs.size());
+	std::vector<std::thread> workers;
+	workers.reserve(count);
+	try
+	{
+		for(size_t i = 1; i < count; ++i)
+			workers.emplace_back(worker);
+	}
+	catch(...)
+	{ // Let started workers finish their current store, then give up
+		next = homedirs.size();
+		for(std::thread& thread : workers)
+			thread.join();
+		throw;
+	}
+	worker();
+	for(std::thread& thread : workers)
+		thread.join();
+	return results;
+}
+
+}
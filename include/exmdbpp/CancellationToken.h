@@ -0,0 +1,36 @@
+#pragma once
+#include <atomic>
+
+namespace exmdbpp
+{
+
+/**
+ * @brief      Flag to abort blocking requests from another thread
+ *
+ * Clients using the token check it before sending a request and while
+ * waiting for the server, aborting the request with a CancelledError once
+ * the token was cancelled. The token stays cancelled until reset() is
+ * called.
+ *
+ * All functions are thread-safe.
+ */
+class CancellationToken
+{
+public:
+	CancellationToken();
+	~CancellationToken();
+	CancellationToken(const CancellationToken&) = delete;
+	CancellationToken& operator=(const CancellationToken&) = delete;
+
+	void cancel() noexcept;
+	void reset() noexcept;
+	bool cancelled() const noexcept;
+
+	int fd() const noexcept;
+
+private:
+	std::atomic<bool> flag{false}; ///< Whether the token was cancelled
+	int event = -1; ///< eventfd signaled on cancellation
+};
+
+}
@@ -0,0 +1,394 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ExmdbClient.h"
+
+namespace exmdbpp
+{
+
+/**
+ * @brief      Pool of pre-connected clients
+ *
+ * Manages a fixed number of clients connected to the same server. Clients are
+ * checked out with lease() and automatically returned to the pool when the
+ * Lease is destroyed, allowing multiple threads to communicate with the
+ * server in parallel without sharing a connection.
+ *
+ * Clients that lost their connection are reconnected on checkout. An
+ * optional background health check detects dead connections of idle
+ * clients and reconnects them before they are leased again.
+ *
+ * @tparam     Client  Client type (ExmdbClient or derived class)
+ */
+template<class Client>
+class ClientPool
+{
+public:
+	/**
+	 * @brief      Exclusive handle to a pooled client
+	 */
+	class Lease
+	{
+	public:
+		Lease(Lease&&) noexcept;
+		Lease& operator=(Lease&&) noexcept;
+		~Lease();
+
+		Client* operator->() const noexcept;
+		Client& operator*() const noexcept;
+
+	private:
+		friend class ClientPool;
+		Lease(ClientPool*, Client*) noexcept;
+
+		void release() noexcept;
+
+		ClientPool* pool; ///< Pool the client belongs to
+		Client* client; ///< Leased client
+	};
+
+	ClientPool(const std::string&, const std::string&, const std::string&, bool, size_t, uint8_t=0);
+	~ClientPool();
+	ClientPool(const ClientPool&) = delete;
+	ClientPool& operator=(const ClientPool&) = delete;
+
+	Lease lease();
+
+	template<class Request, typename... Args>
+	requests::Response_t<Request> send(const Args&...);
+
+	size_t size() const noexcept;
+	size_t available() const;
+
+	void setInstrumentation(const std::shared_ptr<Instrumentation>&);
+	void setSocketOptions(const ExmdbClient::SocketOptions&);
+
+	size_t check();
+	void startHealthCheck(std::chrono::milliseconds);
+	void stopHealthCheck();
+
+private:
+	void giveBack(Client*) noexcept;
+
+	std::vector<std::unique_ptr<Client>> clients; ///< All clients managed by the pool
+	std::vector<Client*> idle; ///< Clients currently available for checkout
+	mutable std::mutex mutex; ///< Mutex protecting the idle list
+	std::condition_variable released; ///< Signaled when a client is returned
+	std::thread checker; ///< Health check thread
+	std::condition_variable stopChecker; ///< Signaled when the health check should terminate
+	bool checking = false; ///< Whether the health check thread is running
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief      Create lease
+ *
+ * @param      pool    Pool the client belongs to
+ * @param      client  Client to lease
+ */
+template<class Client>
+inline ClientPool<Client>::Lease::Lease(ClientPool* pool, Client* client) noexcept : pool(pool), client(client)
+{}
+
+/**
+ * @brief      Move constructor
+ *
+ * @param      other  Lease to move from
+ */
+template<class Client>
+inline ClientPool<Client>::Lease::Lease(Lease&& other) noexcept : pool(other.pool), client(other.client)
+{other.client = nullptr;}
+
+/**
+ * @brief      Move assignment operator
+ *
+ * Returns the currently held client (if any) to the pool.
+ *
+ * @param      other  Lease to move from
+ */
+template<class Client>
+inline typename ClientPool<Client>::Lease& ClientPool<Client>::Lease::operator=(Lease&& other) noexcept
+{
+	if(this == &other)
+		return *this;
+	release();
+	pool = other.pool;
+	client = other.client;
+	other.client = nullptr;
+	return *this;
+}
+
+/**
+ * @brief      Destructor
+ *
+ * Returns the client to the pool.
+ */
+template<class Client>
+inline ClientPool<Client>::Lease::~Lease()
+{release();}
+
+/**
+ * @brief      Access leased client
+ */
+template<class Client>
+inline Client* ClientPool<Client>::Lease::operator->() const noexcept
+{return client;}
+
+/**
+ * @brief      Access leased client
+ */
+template<class Client>
+inline Client& ClientPool<Client>::Lease::operator*() const noexcept
+{return *client;}
+
+/**
+ * @brief      Return client to the pool
+ *
+ * Has no effect if the lease does not hold a client.
+ */
+template<class Client>
+inline void ClientPool<Client>::Lease::release() noexcept
+{
+	if(client)
+		pool->giveBack(client);
+	client = nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief      Initialize pool and connect clients
+ *
+ * @param      host       Server address
+ * @param      port       Server port
+ * @param      prefix     Data area prefix (passed to ConnectRequest)
+ * @param      isPrivate  Whether to access private or public data (passed to ConnectRequest)
+ * @param      size       Number of clients to create
+ * @param      flags      Client flags
+ *
+ * @throws     std::invalid_argument  Pool size is zero
+ * @throws     ConnectionError        Connection could not be established
+ */
+template<class Client>
+ClientPool<Client>::ClientPool(const std::string& host, const std::string& port, const std::string& prefix, bool isPrivate,
+                               size_t size, uint8_t flags)
+{
+	if(!size)
+		throw std::invalid_argument("Pool size must be at least 1");
+	clients.reserve(size);
+	idle.reserve(size);
+	for(size_t i = 0; i < size; ++i)
+	{
+		clients.emplace_back(new Client(host, port, prefix, isPrivate, flags));
+		idle.emplace_back(clients.back().get());
+	}
+}
+
+/**
+ * @brief      Destructor
+ *
+ * Stops the health check thread, if running.
+ */
+template<class Client>
+inline ClientPool<Client>::~ClientPool()
+{stopHealthCheck();}
+
+/**
+ * @brief      Check out a client
+ *
+ * Blocks until a client becomes available.
+ *
+ * If the connection of the client was lost, a reconnect is attempted before
+ * it is handed out.
+ *
+ * @throws     ConnectionError  Client is disconnected and reconnecting failed
+ *
+ * @return     Lease holding the client
+ */
+template<class Client>
+typename ClientPool<Client>::Lease ClientPool<Client>::lease()
+{
+	Client* client;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		released.wait(lock, [this]{return !idle.empty();});
+		client = idle.back();
+		idle.pop_back();
+	}
+	Lease lease(this, client);
+	if(!client->connected() && !client->reconnect())
+		throw ConnectionError("Failed to reconnect pooled client");
+	return lease;
+}
+
+/**
+ * @brief      Send request using a pooled client
+ *
+ * Checks out a client for the duration of the request.
+ *
+ * @param      args     Values to serialize
+ *
+ * @tparam     Request  Type of the request
+ * @tparam     Args     Request arguments
+ *
+ * @return     Parsed response object
+ */
+template<class Client>
+template<class Request, typename... Args>
+inline requests::Response_t<Request> ClientPool<Client>::send(const Args&... args)
+{return lease()->template send<Request>(args...);}
+
+/**
+ * @brief      Return number of clients managed by the pool
+ */
+template<class Client>
+inline size_t ClientPool<Client>::size() const noexcept
+{return clients.size();}
+
+/**
+ * @brief      Return number of clients currently available for checkout
+ */
+template<class Client>
+inline size_t ClientPool<Client>::available() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return idle.size();
+}
+
+/**
+ * @brief      Set instrumentation for all clients
+ *
+ * Blocks until all clients have been returned to the pool.
+ *
+ * @param      instr  Instrumentation to use or nullptr to disable
+ */
+template<class Client>
+inline void ClientPool<Client>::setInstrumentation(const std::shared_ptr<Instrumentation>& instr)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	released.wait(lock, [this]{return idle.size() == clients.size();});
+	for(auto& client : clients)
+		client->setInstrumentation(instr);
+}
+
+/**
+ * @brief      Put client back into the idle list
+ *
+ * @param      client  Client to return
+ */
+template<class Client>
+inline void ClientPool<Client>::giveBack(Client* client) noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		idle.emplace_back(client);
+	}
+	released.notify_all();
+}
+
+/**
+ * @brief      Set socket options for all clients
+ *
+ * Blocks until all clients have been returned to the pool.
+ *
+ * @param      opts  Options to use
+ *
+ * @throws     ConnectionError  Applying the options failed
+ */
+template<class Client>
+inline void ClientPool<Client>::setSocketOptions(const ExmdbClient::SocketOptions& opts)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	released.wait(lock, [this]{return idle.size() == clients.size();});
+	for(auto& client : clients)
+		client->setSocketOptions(opts);
+}
+
+/**
+ * @brief      Check connections of idle clients
+ *
+ * Each client that is currently not leased is checked with
+ * ExmdbClient::alive() and reconnected if its connection is dead. Clients
+ * are checked one at a time, so the remaining clients stay available.
+ *
+ * @return     Number of clients reconnected
+ */
+template<class Client>
+size_t ClientPool<Client>::check()
+{
+	std::vector<Client*> snapshot;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		snapshot = idle;
+	}
+	size_t reconnected = 0;
+	for(Client* client : snapshot)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = std::find(idle.begin(), idle.end(), client);
+			if(it == idle.end())
+				continue; // Leased in the meantime
+			idle.erase(it);
+		}
+		if(!client->alive() && client->reconnect())
+			++reconnected;
+		giveBack(client);
+	}
+	return reconnected;
+}
+
+/**
+ * @brief      Start periodic health check in a background thread
+ *
+ * Has no effect if the health check is already running.
+ *
+ * @param      interval  Time between checks
+ */
+template<class Client>
+void ClientPool<Client>::startHealthCheck(std::chrono::milliseconds interval)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if(checking)
+		return;
+	checker = std::thread([this, interval]
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while(!stopChecker.wait_for(lock, interval, [this]{return !checking;}))
+		{
+			lock.unlock();
+			check();
+			lock.lock();
+		}
+	});
+	checking = true; // Only read by the thread after the lock is released
+}
+
+/**
+ * @brief      Stop health check thread
+ *
+ * Blocks until a check in progress has completed.
+ */
+template<class Client>
+void ClientPool<Client>::stopHealthCheck()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		checking = false;
+	}
+	stopChecker.notify_all();
+	if(checker.joinable())
+		checker.join();
+}
+
+}
@@ -0,0 +1,378 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ClientPool.h"
+
+namespace exmdbpp
+{
+
+/**
+ * @brief      Client routing requests to the server owning a store
+ *
+ * Each route maps a home directory prefix to a list of equivalent nodes
+ * serving the stores below it. Requests are routed to the route with the
+ * longest prefix matching the home directory. Within a route, the stores
+ * are distributed over the nodes using rendezvous hashing, so each store is
+ * consistently handled by the same node and adding or removing a node only
+ * moves the stores of that node. Home directories and node addresses are
+ * hashed with FNV-1a, so the placement is identical across processes, hosts
+ * and library builds.
+ *
+ * If a node cannot be reached, the request is retried on the next node in
+ * the hash order of the store. Failed nodes are skipped (i.e. tried last)
+ * until the retry delay has passed. Note that a request may have been
+ * executed by the server if the connection failed while waiting for the
+ * response.
+ *
+ * Each node uses its own ClientPool, which is created on first use. The
+ * connections are established without holding any lock, threads using the
+ * same node meanwhile wait for the pool to become available.
+ *
+ * @tparam     Client  Client type (ExmdbClient or derived class)
+ */
+template<class Client>
+class ClientRouter
+{
+public:
+	using Pool = ClientPool<Client>; ///< Pool type used for each node
+
+	/**
+	 * @brief      Server address
+	 */
+	struct Node
+	{
+		std::string host; ///< Server address
+		std::string port; ///< Server port
+	};
+
+	/**
+	 * @brief      Nodes serving a home directory prefix
+	 */
+	struct Route
+	{
+		std::string prefix; ///< Home directory prefix (passed to ConnectRequest)
+		std::vector<Node> nodes; ///< Nodes serving the prefix
+	};
+
+	ClientRouter(const std::vector<Route>&, bool, size_t, uint8_t=0,
+	             std::chrono::milliseconds=std::chrono::seconds(5));
+	ClientRouter(const ClientRouter&) = delete;
+	ClientRouter& operator=(const ClientRouter&) = delete;
+
+	typename Pool::Lease lease(const std::string&);
+
+	template<class Request, typename... Args>
+	requests::Response_t<Request> send(const std::string&, const Args&...);
+
+	std::vector<Node> nodes(const std::string&) const;
+	size_t capacity() const noexcept;
+
+private:
+	struct NodeState
+	{
+		Node node; ///< Node address
+		std::string prefix; ///< Home directory prefix of the route
+		uint64_t hash; ///< Hash of the node address
+		std::mutex mutex; ///< Mutex protecting pool creation
+		std::condition_variable built; ///< Signaled when pool creation finished
+		bool building = false; ///< Whether a thread is currently creating the pool
+		std::unique_ptr<Pool> pool; ///< Connections to the node (created on first use, never replaced)
+		std::atomic<int64_t> downUntil{0}; ///< Time until which the node is considered unreachable
+	};
+
+	struct RouteState
+	{
+		std::string prefix; ///< Home directory prefix
+		std::vector<std::unique_ptr<NodeState>> nodes; ///< Nodes serving the prefix
+	};
+
+	template<typename F>
+	std::invoke_result_t<F, Pool&> dispatch(const std::string&, F&&);
+
+	std::vector<NodeState*> candidates(const std::string&) const;
+	Pool& pool(NodeState&);
+	void markDown(NodeState&) noexcept;
+
+	static uint64_t hash(const std::string&) noexcept;
+	static uint64_t mix(uint64_t) noexcept;
+	static int64_t now() noexcept;
+
+	std::vector<RouteState> routes; ///< Configured routes
+	bool isPrivate; ///< Whether to access private or public stores
+	size_t poolSize; ///< Number of connections per node
+	uint8_t flags; ///< Client flags
+	std::chrono::milliseconds retryDelay; ///< Time to skip a node after a connection failure
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief      Initialize router
+ *
+ * No connections are established until a node is first used.
+ *
+ * @param      topology    Routes to use
+ * @param      isPrivate   Whether to access private or public data (passed to ConnectRequest)
+ * @param      poolSize    Number of connections per node
+ * @param      flags       Client flags
+ * @param      retryDelay  Time to skip a node after a connection failure
+ *
+ * @throws     std::invalid_argument  Pool size is zero or a route has no nodes
+ */
+template<class Client>
+ClientRouter<Client>::ClientRouter(const std::vector<Route>& topology, bool isPrivate, size_t poolSize, uint8_t flags,
+                                   std::chrono::milliseconds retryDelay) :
+    isPrivate(isPrivate), poolSize(poolSize), flags(flags), retryDelay(retryDelay)
+{
+	if(!poolSize)
+		throw std::invalid_argument("Pool size must be at least 1");
+	routes.reserve(topology.size());
+	for(const Route& route : topology)
+	{
+		if(route.nodes.empty())
+			throw std::invalid_argument("No nodes configured for prefix '"+route.prefix+"'");
+		RouteState& state = routes.emplace_back(RouteState{route.prefix, {}});
+		for(const Node& node : route.nodes)
+		{
+			state.nodes.emplace_back(std::make_unique<NodeState>());
+			state.nodes.back()->node = node;
+			state.nodes.back()->prefix = route.prefix;
+			state.nodes.back()->hash = hash(node.host+":"+node.port);
+		}
+	}
+}
+
+/**
+ * @brief      Check out a client connected to the node owning a store
+ *
+ * @param      homedir  Home directory of the store
+ *
+ * @throws     std::invalid_argument  No route matches the home directory
+ * @throws     ConnectionError        None of the nodes could be reached
+ *
+ * @return     Lease holding the client
+ */
+template<class Client>
+inline typename ClientRouter<Client>::Pool::Lease ClientRouter<Client>::lease(const std::string& homedir)
+{return dispatch(homedir, [](Pool& pool){return pool.lease();});}
+
+/**
+ * @brief      Send request to the node owning a store
+ *
+ * The home directory is passed as first request argument.
+ *
+ * See documentation of the specific Request for a description of the
+ * parameters.
+ *
+ * @param      homedir  Home directory of the store
+ * @param      args     Values to serialize
+ *
+ * @tparam     Request  Type of the request
+ * @tparam     Args     Request arguments
+ *
+ * @throws     std::invalid_argument  No route matches the home directory
+ * @throws     ConnectionError        None of the nodes could be reached
+ *
+ * @return     Parsed response object
+ */
+template<class Client>
+template<class Request, typename... Args>
+inline requests::Response_t<Request> ClientRouter<Client>::send(const std::string& homedir, const Args&... args)
+{return dispatch(homedir, [&](Pool& pool){return pool.template send<Request>(homedir, args...);});}
+
+/**
+ * @brief      Return nodes serving a store
+ *
+ * @param      homedir  Home directory of the store
+ *
+ * @throws     std::invalid_argument  No route matches the home directory
+ *
+ * @return     Nodes in the order they are tried
+ */
+template<class Client>
+std::vector<typename ClientRouter<Client>::Node> ClientRouter<Client>::nodes(const std::string& homedir) const
+{
+	std::vector<Node> result;
+	for(const NodeState* node : candidates(homedir))
+		result.emplace_back(node->node);
+	return result;
+}
+
+/**
+ * @brief      Return maximum number of connections
+ *
+ * @return     Number of connections of all nodes if every pool was created
+ */
+template<class Client>
+size_t ClientRouter<Client>::capacity() const noexcept
+{
+	size_t nodes = 0;
+	for(const RouteState& route : routes)
+		nodes += route.nodes.size();
+	return nodes*poolSize;
+}
+
+/**
+ * @brief      Run function on the pool of the node owning a store
+ *
+ * Tries the next node if a ConnectionError (other than CancelledError)
+ * occurs.
+ *
+ * @param      homedir  Home directory of the store
+ * @param      func     Function to call
+ *
+ * @return     Return value of the function
+ */
+template<class Client>
+template<typename F>
+std::invoke_result_t<F, typename ClientRouter<Client>::Pool&> ClientRouter<Client>::dispatch(const std::string& homedir, F&& func)
+{
+	std::exception_ptr error;
+	for(NodeState* node : candidates(homedir))
+		try
+		{
+			auto result = func(pool(*node));
+			node->downUntil.store(0, std::memory_order_relaxed);
+			return result;
+		}
+		catch(const CancelledError&)
+		{throw;}
+		catch(const ConnectionError&)
+		{
+			markDown(*node);
+			error = std::current_exception();
+		}
+	std::rethrow_exception(error);
+}
+
+/**
+ * @brief      Determine order in which nodes are tried for a store
+ *
+ * Nodes are ordered by their rendezvous hash score, nodes currently
+ * considered unreachable are moved to the end.
+ *
+ * @param      homedir  Home directory of the store
+ *
+ * @throws     std::invalid_argument  No route matches the home directory
+ *
+ * @return     Nodes of the matching route
+ */
+template<class Client>
+std::vector<typename ClientRouter<Client>::NodeState*> ClientRouter<Client>::candidates(const std::string& homedir) const
+{
+	const RouteState* best = nullptr;
+	for(const RouteState& route : routes)
+		if(homedir.compare(0, route.prefix.size(), route.prefix) == 0 && (!best || route.prefix.size() > best->prefix.size()))
+			best = &route;
+	if(!best)
+		throw std::invalid_argument("No route for '"+homedir+"'");
+	uint64_t key = hash(homedir);
+	int64_t current = now();
+	std::vector<std::tuple<bool, uint64_t, NodeState*>> order; ///< Down flag, inverted score, node
+	order.reserve(best->nodes.size());
+	for(const auto& node : best->nodes)
+		order.emplace_back(node->downUntil.load(std::memory_order_relaxed) > current, ~mix(key^node->hash), node.get());
+	std::sort(order.begin(), order.end());
+	std::vector<NodeState*> result;
+	result.reserve(order.size());
+	for(const auto& entry : order)
+		result.emplace_back(std::get<2>(entry));
+	return result;
+}
+
+/**
+ * @brief      Return pool of a node, creating it if necessary
+ *
+ * The pool is created without holding the node's mutex and published
+ * afterwards. Other threads requesting the pool meanwhile wait for the
+ * creation to finish and take over if it failed.
+ *
+ * @param      node  Node to get the pool of
+ *
+ * @throws     ConnectionError  Pool creation failed
+ *
+ * @return     Pool of the node
+ */
+template<class Client>
+typename ClientRouter<Client>::Pool& ClientRouter<Client>::pool(NodeState& node)
+{
+	std::unique_lock<std::mutex> lock(node.mutex);
+	node.built.wait(lock, [&]{return !node.building;});
+	if(node.pool)
+		return *node.pool;
+	node.building = true;
+	lock.unlock();
+	std::unique_ptr<Pool> created;
+	try
+	{created = std::make_unique<Pool>(node.node.host, node.node.port, node.prefix, isPrivate, poolSize, flags);}
+	catch(...)
+	{
+		lock.lock();
+		node.building = false;
+		node.built.notify_all();
+		throw;
+	}
+	lock.lock();
+	node.pool = std::move(created);
+	node.building = false;
+	node.built.notify_all();
+	return *node.pool;
+}
+
+/**
+ * @brief      Mark node as unreachable for the retry delay
+ *
+ * @param      node  Node that failed
+ */
+template<class Client>
+inline void ClientRouter<Client>::markDown(NodeState& node) noexcept
+{node.downUntil.store(now()+std::chrono::duration_cast<std::chrono::nanoseconds>(retryDelay).count(), std::memory_order_relaxed);}
+
+/**
+ * @brief      Compute 64 bit FNV-1a hash of a string
+ *
+ * Unlike std::hash, the result does not depend on the standard library
+ * implementation.
+ */
+template<class Client>
+inline uint64_t ClientRouter<Client>::hash(const std::string& data) noexcept
+{
+	uint64_t value = 0xcbf29ce484222325ULL;
+	for(unsigned char c : data)
+		value = (value^c)*0x100000001b3ULL;
+	return value;
+}
+
+/**
+ * @brief      Mix bits of hash value (splitmix64 finalizer)
+ */
+template<class Client>
+inline uint64_t ClientRouter<Client>::mix(uint64_t x) noexcept
+{
+	x = (x^(x >> 30))*0xbf58476d1ce4e5b9ULL;
+	x = (x^(x >> 27))*0x94d049bb133111ebULL;
+	return x^(x >> 31);
+}
+
+/**
+ * @brief      Return current steady clock time in nanoseconds
+ */
+template<class Client>
+inline int64_t ClientRouter<Client>::now() noexcept
+{return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();}
+
+}
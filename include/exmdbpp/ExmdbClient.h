@@ -1,13 +1,23 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <cstdint>
+#include <memory>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <functional>
 
+#include "CancellationToken.h"
 #include "exceptions.h"
 #include "IOBuffer.h"
+#include "Metrics.h"
 #include "requests.h"
 
+struct iovec;
+
 /**
  * @brief Root namespace for the exmdbpp library
  */
@@ -21,20 +31,59 @@ namespace exmdbpp
  */
 class ExmdbClient
 {
+public:
+	/**
+	 * @brief      Options applied to the socket of each connection
+	 *
+	 * TCP specific options are ignored for UNIX domain sockets.
+	 */
+	struct SocketOptions
+	{
+		bool noDelay = true; ///< Disable Nagle's algorithm (TCP_NODELAY)
+		bool keepAlive = false; ///< Enable TCP keepalive probes
+		std::chrono::seconds keepIdle{60}; ///< Idle time before the first keepalive probe
+		std::chrono::seconds keepInterval{10}; ///< Interval between keepalive probes
+		int keepCount = 3; ///< Number of unanswered probes before the connection is considered dead
+		int sendBuffer = 0; ///< Size of the socket send buffer (0 for system default)
+		int receiveBuffer = 0; ///< Size of the socket receive buffer (0 for system default)
+	};
+
+private:
 	class Connection
 	{
 	public:
+		using Clock = std::chrono::steady_clock;
+
 		Connection() = default;
 		~Connection();
 		Connection(Connection&&) noexcept;
 		Connection& operator=(Connection&&) noexcept;
 
-		void connect(const std::string&, const std::string&);
+		void connect(const std::string&, const std::string&, std::chrono::milliseconds=std::chrono::milliseconds(3000));
+		void arm(Clock::time_point, const CancellationToken*) noexcept;
+		void configure(const SocketOptions&);
+		bool alive();
 		void close();
 		void send(IOBuffer&);
+		void transmit(const IOBuffer&);
+		void transmit(std::vector<iovec>&);
+		void receive(IOBuffer&);
+		uint32_t receiveHeader();
+		size_t receiveSome(void*, size_t);
+		size_t trySend(const void*, size_t);
+		size_t tryReceive(void*, size_t);
+		short wait(short);
+		bool connected() const noexcept;
+		int release() noexcept;
 
 	private:
 		int sock = -1; ///< TCP socket to send and receive data
+		Clock::time_point deadline = Clock::time_point::max(); ///< Time at which blocking operations fail
+		const CancellationToken* token = nullptr; ///< Token aborting blocking operations (optional)
+
+		void connectUnix(const std::string&);
+		void recvAll(void*, size_t);
+		int ioFlags() const noexcept;
 	};
 
 	struct ConnParm
@@ -48,22 +97,169 @@ class ExmdbClient
 	};
 
 public:
+	/**
+	 * @brief      Batch of requests sent over a single connection
+	 *
+	 * Requests added to the pipeline are serialized into a common buffer and
+	 * transmitted at once when calling execute(). Responses are read back in
+	 * order while the requests are still being sent, so batches larger than
+	 * the socket buffers do not stall, and can be retrieved with get().
+	 *
+	 * Only requests that do not depend on the results of each other can be
+	 * combined in a single pipeline.
+	 *
+	 * If the client has instrumentation set, a CallRecord is reported for
+	 * each request. Failed requests are reported by execute(), successful
+	 * ones when the response is retrieved with get() (including the
+	 * deserialization time) or, if it is never retrieved, when the pipeline
+	 * is cleared or destroyed.
+	 */
+	class Pipeline
+	{
+	public:
+		explicit Pipeline(ExmdbClient&);
+		~Pipeline();
+		Pipeline(const Pipeline&) = delete;
+		Pipeline& operator=(const Pipeline&) = delete;
+
+		template<class Request, typename... Args>
+		size_t add(const Args&...);
+
+		void execute();
+
+		template<class Request, class Response=requests::Response_t<Request>, typename... Args>
+		Response get(size_t, const Args&...);
+
+		void clear() noexcept;
+		size_t size() const noexcept;
+
+	private:
+		ExmdbClient& client; ///< Client to send requests with
+		IOBuffer buffer; ///< Serialized requests
+		std::vector<uint8_t> callIds; ///< Call IDs of the added requests
+		std::vector<uint8_t> status; ///< Response codes returned by the server
+		std::vector<IOBuffer> responses; ///< Received response data
+		std::shared_ptr<Instrumentation> instrumentation; ///< Instrumentation used by the last execute() (optional)
+		std::vector<CallRecord> records; ///< Measurements of the requests (if instrumented)
+		std::vector<bool> pending; ///< Whether the record of a successful request is yet to be reported
+
+		void report(size_t) noexcept;
+	};
+
+	/**
+	 * @brief      Incremental reader for a single response
+	 *
+	 * Created by ExmdbClient::stream(). Response data is received from the
+	 * socket on demand into a fixed-size buffer, so responses of arbitrary
+	 * size can be processed with bounded memory.
+	 *
+	 * The client must not send other requests while the stream is in use.
+	 * Destroying a stream that was not read completely closes the
+	 * connection, as the remaining data cannot be skipped efficiently.
+	 */
+	class ResponseStream
+	{
+	public:
+		ResponseStream(const ResponseStream&) = delete;
+		ResponseStream(ResponseStream&&) noexcept;
+		~ResponseStream();
+
+		ResponseStream& operator=(const ResponseStream&) = delete;
+		ResponseStream& operator=(ResponseStream&&) = delete;
+
+		template<typename T>
+		T pop();
+
+		void read(void*, size_t);
+		std::pair<const uint8_t*, size_t> chunk(size_t);
+		void readString(IOBuffer&);
+		size_t remaining() const noexcept;
+
+	private:
+		friend class ExmdbClient;
+
+		ResponseStream(ExmdbClient&, uint32_t, size_t, const CallRecord*);
+
+		void fill();
+		void report(uint8_t) noexcept;
+
+		ExmdbClient* client; ///< Client owning the connection (nullptr if moved from)
+		ByteBuffer buffer; ///< Receive buffer
+		size_t pos = 0; ///< Read position in the buffer
+		size_t end = 0; ///< End of valid data in the buffer
+		size_t pending; ///< Bytes of the response not yet received
+		CallRecord record; ///< Measurements of the request (if instrumented)
+		bool recording; ///< Whether the record is yet to be reported
+		std::chrono::steady_clock::time_point created; ///< Time the response header was received
+	};
+
 	ExmdbClient() = default;
 	ExmdbClient(const std::string&, const std::string&, const std::string&, bool, uint8_t=0);
 
 	void connect(const std::string&, const std::string&, const std::string&, bool);
 	bool reconnect();
+	bool connected() const noexcept;
+	bool alive();
 
 	template<class Request, typename... Args>
 	requests::Response_t<Request> send(const Args&...);
 
+	template<class Request, typename... Args>
+	IOBuffer sendRaw(const Args&...);
+
+	template<class Request, typename... Args>
+	ResponseStream stream(const Args&...);
+
+	void setInstrumentation(std::shared_ptr<Instrumentation>) noexcept;
+	const std::shared_ptr<Instrumentation>& getInstrumentation() const noexcept;
+
+	void setConnectTimeout(std::chrono::milliseconds) noexcept;
+	void setTimeout(std::chrono::milliseconds) noexcept;
+	void setDeadline(std::chrono::steady_clock::time_point) noexcept;
+	void clearDeadline() noexcept;
+	void setCancellationToken(std::shared_ptr<CancellationToken>) noexcept;
+	void setSocketOptions(const SocketOptions&);
+
 	static const uint8_t AUTO_RECONNECT;
 private:
+	friend class AsyncClient;
+
+	template<class Request, typename... Args>
+	void exchange(CallRecord*, uint32_t*, const Args&...);
+
+	/**
+	 * @brief      Recently observed message sizes of a call
+	 */
+	struct SizeHint
+	{
+		uint32_t request = 0; ///< Expected size of the serialized request
+		uint32_t response = 0; ///< Expected size of the response data
+
+		static void learn(uint32_t&, size_t) noexcept;
+	};
+
+	void arm(Connection&);
+
+	static uint64_t elapsed(std::chrono::steady_clock::time_point) noexcept;
+
+	static constexpr size_t referenceThreshold = 4096; ///< Minimum size of binary data to send without copying
+	static constexpr size_t streamBufferSize = 65536; ///< Size of the receive buffer used by response streams
+	static constexpr size_t pipelineChunkSize = 65536; ///< Number of bytes received at once by pipelines
+
+	template<class Request, typename... Args>
+	static void writeFramed(IOBuffer&, const Args&...);
+
 	Connection connection; ///< Connection used to send and receive data
 	ConnParm params; ///< Connection parameters
 	IOBuffer buffer; ///< Buffer managing data to send / received data
 	uint8_t flags = 0; ///< Client flags
-
+	std::shared_ptr<Instrumentation> instrumentation; ///< Instrumentation receiving call records (optional)
+	std::chrono::milliseconds connectTimeout{3000}; ///< Maximum time to wait for TCP connection establishment
+	std::chrono::milliseconds timeout{0}; ///< Maximum duration of a single request (0 for unlimited)
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(); ///< Deadline for all requests
+	std::shared_ptr<CancellationToken> cancellation; ///< Token aborting requests (optional)
+	SocketOptions socketOptions; ///< Options applied to new connections
+	std::array<SizeHint, 256> sizeHints{}; ///< Message sizes by call ID, used to preallocate the buffer
 };
 
 /**
@@ -82,18 +278,345 @@ private:
 template<class Request, typename... Args>
 inline requests::Response_t<Request> ExmdbClient::send(const Args&... args)
 {
+	if(!instrumentation)
+	{
+		exchange<Request>(nullptr, nullptr, args...);
+		return requests::Response_t<Request>(buffer);
+	}
+	CallRecord record;
+	exchange<Request>(&record, nullptr, args...);
+	auto start = std::chrono::steady_clock::now();
+	try
+	{
+		requests::Response_t<Request> response(buffer);
+		record.deserializeNs = elapsed(start);
+		instrumentation->record(record);
+		return response;
+	}
+	catch(...)
+	{
+		record.deserializeNs = elapsed(start);
+		record.status = CallRecord::DECODE_ERROR;
+		instrumentation->record(record);
+		throw;
+	}
+}
+
+/**
+ * @brief      Send request and return unparsed response
+ *
+ * Ownership of the response data is transferred to the caller, which allows
+ * responses that reference the data directly (like
+ * requests::BorrowedTableResponse) to be constructed from it.
+ *
+ * See documentation of the specific Request for a description of the
+ * parameters.
+ *
+ * @param      args     Values to serialize
+ *
+ * @tparam     Request  Type of the request
+ * @tparam     Args     Request arguments
+ *
+ * @return     Buffer containing the response data
+ */
+template<class Request, typename... Args>
+inline IOBuffer ExmdbClient::sendRaw(const Args&... args)
+{
+	if(instrumentation)
+	{
+		CallRecord record;
+		exchange<Request>(&record, nullptr, args...);
+		instrumentation->record(record);
+	}
+	else
+		exchange<Request>(nullptr, nullptr, args...);
+	IOBuffer response;
+	std::swap(response, buffer);
+	return response;
+}
+
+/**
+ * @brief      Send request and return stream to read the response from
+ *
+ * Only the response header is received before returning, the response data
+ * must be read from the stream before the client can be used again.
+ *
+ * If instrumentation is set, the request is reported once the response
+ * was received completely, or as failed if the stream is destroyed early.
+ *
+ * See documentation of the specific Request for a description of the
+ * parameters.
+ *
+ * @param      args     Values to serialize
+ *
+ * @tparam     Request  Type of the request
+ * @tparam     Args     Request arguments
+ *
+ * @return     Stream providing the response data
+ */
+template<class Request, typename... Args>
+inline ExmdbClient::ResponseStream ExmdbClient::stream(const Args&... args)
+{
+	uint32_t length;
+	if(!instrumentation)
+	{
+		exchange<Request>(nullptr, &length, args...);
+		return ResponseStream(*this, length, streamBufferSize, nullptr);
+	}
+	CallRecord record;
+	exchange<Request>(&record, &length, args...);
+	return ResponseStream(*this, length, streamBufferSize, &record);
+}
+
+/**
+ * @brief      Serialize and send request, receive response into buffer
+ *
+ * If a record is given, serialization and network times as well as request
+ * and response sizes are stored in it. Failed requests are reported to the
+ * instrumentation directly, successful requests must be reported by the
+ * caller after deserialization.
+ *
+ * If `length` is given, only the response header is received and the
+ * length of the response is stored in it.
+ *
+ * The deadline and cancellation token of the client apply to sending the
+ * request and receiving the response (including data read later through a
+ * ResponseStream). A TimeoutError or CancelledError closes the connection.
+ *
+ * @param      record   Record to store measurements in or nullptr
+ * @param      length   Location to store response length in or nullptr
+ * @param      args     Values to serialize
+ *
+ * @tparam     Request  Type of the request
+ * @tparam     Args     Request arguments
+ */
+template<class Request, typename... Args>
+inline void ExmdbClient::exchange(CallRecord* record, uint32_t* length, const Args&... args)
+{
+	std::chrono::steady_clock::time_point start;
+	if(record)
+	{
+		record->callId = Request::callId;
+		start = std::chrono::steady_clock::now();
+	}
+	arm(connection);
+	SizeHint& hint = sizeHints[Request::callId];
 	buffer.clear();
+	buffer.reserve(length? hint.request : std::max(hint.request, hint.response));
+	buffer.setReferenceThreshold(referenceThreshold);
 	buffer.start();
 	Request::write(buffer, args...);
 	buffer.finalize();
-	try {connection.send(buffer);}
+	SizeHint::learn(hint.request, buffer.size());
+	if(record)
+	{
+		record->serializeNs = elapsed(start);
+		record->requestBytes = buffer.totalSize();
+		start = std::chrono::steady_clock::now();
+	}
+	try
+	{
+		if(length)
+		{
+			connection.transmit(buffer);
+			*length = connection.receiveHeader();
+		}
+		else
+			connection.send(buffer);
+	}
 	catch (const ExmdbProtocolError& err)
 	{
+		if(record)
+		{
+			record->networkNs = elapsed(start);
+			record->status = err.code;
+			instrumentation->record(*record);
+		}
 		if (err.code == 8 && flags & AUTO_RECONNECT)  // DISPATCH_ERROR
 			reconnect();
 		throw;
 	}
-	return requests::Response_t<Request>(buffer);
+	catch (const ConnectionError&)
+	{
+		connection.close(); // Stream state is undefined, do not reuse
+		if(record)
+		{
+			record->networkNs = elapsed(start);
+			record->status = CallRecord::CONNECTION_ERROR;
+			instrumentation->record(*record);
+		}
+		throw;
+	}
+	if(!length)
+		SizeHint::learn(hint.response, buffer.size());
+	if(record)
+	{
+		record->networkNs = elapsed(start);
+		record->responseBytes = length? *length : buffer.size();
+	}
+}
+
+/**
+ * @brief      Return nanoseconds passed since a point in time
+ *
+ * @param      start  Start time
+ */
+inline uint64_t ExmdbClient::elapsed(std::chrono::steady_clock::time_point start) noexcept
+{return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start).count());}
+
+/**
+ * @brief      Update size hint with an observed size
+ *
+ * The hint follows increasing sizes immediately and decays slowly
+ * otherwise, so occasional small messages do not cause reallocations for
+ * the next large one, while a single outlier is eventually forgotten.
+ *
+ * @param      hint  Hint to update
+ * @param      size  Observed size
+ */
+inline void ExmdbClient::SizeHint::learn(uint32_t& hint, size_t size) noexcept
+{hint = uint32_t(std::min<size_t>(std::max<size_t>(size, hint-hint/8), UINT32_MAX));}
+
+/**
+ * @brief      Append serialized request to buffer
+ *
+ * In contrast to IOBuffer::start() and IOBuffer::finalize(), existing data
+ * in the buffer is preserved, allowing multiple requests to be combined.
+ *
+ * If serialization fails, the buffer is restored to its previous size. As
+ * references cannot be rolled back, the buffer should not have a reference
+ * threshold set.
+ *
+ * @param      buff     Buffer to append the request to
+ * @param      args     Values to serialize
+ *
+ * @tparam     Request  Type of the request
+ * @tparam     Args     Request arguments
+ */
+template<class Request, typename... Args>
+inline void ExmdbClient::writeFramed(IOBuffer& buff, const Args&... args)
+{
+	size_t offset = buff.size(), start = buff.totalSize();
+	buff.resize(offset+sizeof(uint32_t));
+	try {Request::write(buff, args...);}
+	catch(...)
+	{
+		buff.resize(offset);
+		throw;
+	}
+	uint32_t length = htole32(uint32_t(buff.totalSize()-start-sizeof(uint32_t)));
+	memcpy(buff.data()+offset, &length, sizeof(length));
+}
+
+/**
+ * @brief      Add request to the pipeline
+ *
+ * See documentation of the specific Request for a description of the
+ * parameters.
+ *
+ * @param      args     Values to serialize
+ *
+ * @tparam     Request  Type of the request
+ * @tparam     Args     Request arguments
+ *
+ * @return     Index of the request, to be used with get()
+ */
+template<class Request, typename... Args>
+inline size_t ExmdbClient::Pipeline::add(const Args&... args)
+{
+	if(!client.instrumentation)
+	{
+		writeFramed<Request>(buffer, args...);
+		callIds.emplace_back(Request::callId);
+		return callIds.size()-1;
+	}
+	auto start = std::chrono::steady_clock::now();
+	size_t offset = buffer.size();
+	writeFramed<Request>(buffer, args...);
+	callIds.emplace_back(Request::callId);
+	records.resize(callIds.size());
+	records.back().serializeNs = elapsed(start);
+	records.back().requestBytes = buffer.size()-offset;
+	return callIds.size()-1;
+}
+
+/**
+ * @brief      Parse response of a pipelined request
+ *
+ * Can only be called after execute().
+ *
+ * A different response type can be specified to interpret the response data,
+ * additional arguments are passed to its constructor.
+ *
+ * @param      index    Index of the request as returned by add()
+ * @param      args     Additional response constructor arguments
+ *
+ * @tparam     Request  Type of the request
+ * @tparam     Response Type of the response
+ * @tparam     Args     Additional response constructor argument types
+ *
+ * @throws     std::out_of_range       No response with this index available
+ * @throws     std::invalid_argument   Request type does not match the request at this index
+ * @throws     ExmdbProtocolError      The server returned an error for this request
+ *
+ * @return     Parsed response object
+ */
+template<class Request, class Response, typename... Args>
+inline Response ExmdbClient::Pipeline::get(size_t index, const Args&... args)
+{
+	if(index >= responses.size())
+		throw std::out_of_range("No response with index "+std::to_string(index));
+	if(callIds[index] != Request::callId)
+		throw std::invalid_argument("Request type mismatch for response "+std::to_string(index));
+	if(status[index] != 0)  // SUCCESS
+		throw ExmdbProtocolError("exmdb call failed: ", status[index]);
+	responses[index].reset();
+	if(index >= pending.size() || !pending[index])
+		return Response(responses[index], args...);
+	auto start = std::chrono::steady_clock::now();
+	try
+	{
+		Response response(responses[index], args...);
+		records[index].deserializeNs = elapsed(start);
+		report(index);
+		return response;
+	}
+	catch(...)
+	{
+		records[index].deserializeNs = elapsed(start);
+		records[index].status = CallRecord::DECODE_ERROR;
+		report(index);
+		throw;
+	}
+}
+
+/**
+ * @brief      Read unsigned integer value from the stream
+ *
+ * The value is automatically converted from little endian byte order.
+ *
+ * @tparam     T     Type of the value (uint8_t, uint16_t, uint32_t or uint64_t)
+ *
+ * @throws     SerializationError  Response does not contain enough data
+ * @throws     ConnectionError     Receiving failed
+ *
+ * @return     Value read
+ */
+template<typename T>
+inline T ExmdbClient::ResponseStream::pop()
+{
+	static_assert(std::is_same_v<T, uint8_t> || std::is_same_v<T, uint16_t> || std::is_same_v<T, uint32_t> ||
+	              std::is_same_v<T, uint64_t>, "Only unsigned integer types can be read from a stream");
+	T value;
+	read(&value, sizeof(T));
+	if constexpr(sizeof(T) == 2)
+		return le16toh(value);
+	else if constexpr(sizeof(T) == 4)
+		return le32toh(value);
+	else if constexpr(sizeof(T) == 8)
+		return le64toh(value);
+	else
+		return value;
 }
 
 
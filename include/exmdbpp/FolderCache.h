@@ -0,0 +1,88 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "queries.h"
+
+namespace exmdbpp::queries
+{
+
+/**
+ * @brief      Thread-safe cache of folder hierarchy information
+ *
+ * Stores folder IDs by parent ID and name, and basic folder properties by
+ * folder ID, separately for each store (identified by its home directory).
+ * Entries expire after a configurable time to live, so changes made by
+ * other clients are eventually picked up. Expired entries are removed when
+ * looked up, or when the number of entries of a store exceeds a threshold
+ * while inserting, which bounds the size of the cache to about twice the
+ * number of live entries.
+ *
+ * The cache can be shared by multiple clients.
+ */
+class FolderCache
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	explicit FolderCache(std::chrono::milliseconds=std::chrono::seconds(60));
+
+	std::optional<uint64_t> findId(const std::string&, uint64_t, const std::string&);
+	std::optional<Folder> findFolder(const std::string&, uint64_t);
+	void storeId(const std::string&, uint64_t, const std::string&, uint64_t);
+	void storeFolder(const std::string&, const Folder&);
+
+	void invalidate(const std::string&, uint64_t);
+	void invalidateChildren(const std::string&, uint64_t);
+	void invalidate(const std::string&);
+	void clear();
+
+	size_t size() const;
+
+private:
+	template<typename T>
+	struct Entry
+	{
+		T value; ///< Cached value
+		Clock::time_point expires; ///< Time after which the entry becomes invalid
+	};
+
+	/**
+	 * @brief      Folder ID lookup key
+	 */
+	struct NameKey
+	{
+		uint64_t parentId; ///< ID of the parent folder
+		std::string name; ///< Name of the folder
+
+		bool operator==(const NameKey&) const noexcept;
+	};
+
+	/**
+	 * @brief      Hash function for NameKey
+	 */
+	struct NameHash
+	{size_t operator()(const NameKey&) const noexcept;};
+
+	/**
+	 * @brief      Cached information of a single store
+	 */
+	struct Store
+	{
+		std::unordered_map<NameKey, Entry<uint64_t>, NameHash> ids; ///< Folder IDs by parent ID and name
+		std::unordered_map<uint64_t, Entry<Folder>> folders; ///< Folder properties by folder ID
+		size_t purgeAt = 256; ///< Number of entries at which expired entries are removed
+
+		void prune(Clock::time_point);
+	};
+
+	mutable std::mutex mutex; ///< Mutex protecting the store map
+	std::unordered_map<std::string, Store> stores; ///< Cached information by home directory
+	std::chrono::milliseconds ttl; ///< Time to live of new entries
+};
+
+}
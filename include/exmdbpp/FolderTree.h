@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "queries.h"
+
+namespace exmdbpp::queries
+{
+
+/**
+ * @brief      Client-side copy of a folder hierarchy
+ *
+ * Holds all folders below a root folder, indexed by folder ID and by parent
+ * ID. The tree is kept up to date with ExmdbQueries::syncFolderTree, which
+ * only transfers folders modified since the previous synchronization.
+ *
+ * The tree tracks the latest modification time of its folders, which is
+ * used as watermark for the next synchronization. Each tree therefore
+ * belongs to a single store.
+ *
+ * FolderTree is not thread-safe.
+ */
+class FolderTree
+{
+public:
+	explicit FolderTree(uint64_t);
+
+	uint64_t root() const noexcept;
+	uint64_t modifiedSince() const noexcept;
+	size_t size() const noexcept;
+	bool empty() const noexcept;
+
+	const Folder* find(uint64_t) const;
+	std::vector<const Folder*> children(uint64_t) const;
+
+	void merge(std::vector<Folder>&&, FolderChanges&);
+	void retain(const std::vector<uint64_t>&, FolderChanges&);
+	void clear() noexcept;
+
+private:
+	void link(const Folder&);
+	void unlink(const Folder&);
+
+	uint64_t rootId; ///< ID of the root folder (not contained in the tree)
+	uint64_t watermark = 0; ///< Latest modification time of any folder in the tree
+	std::unordered_map<uint64_t, Folder> folders; ///< Folders by ID
+	std::unordered_map<uint64_t, std::unordered_set<uint64_t>> childIds; ///< Folder IDs by parent ID
+};
+
+}
@@ -1,22 +1,75 @@
 #pragma once
 
+#include <algorithm>
 #include <vector>
 #include <cstdint>
+#include <memory>
+#include <new>
 #include <stdexcept>
 #include <string>
 #include <cstring>
+#include <type_traits>
+#include <utility>
 #include <endian.h>
 
 namespace exmdbpp
 {
+
+/**
+ * @brief      Allocator default-initializing instead of value-initializing elements
+ *
+ * Containers using this allocator leave trivial elements uninitialized on
+ * resize(), avoiding the zero-fill of memory that is overwritten anyway.
+ *
+ * @tparam     T     Element type
+ * @tparam     A     Underlying allocator
+ */
+template<typename T, class A=std::allocator<T>>
+class DefaultInitAllocator : public A
+{
+	using Traits = std::allocator_traits<A>;
+public:
+	template<typename U>
+	struct rebind
+	{using other = DefaultInitAllocator<U, typename Traits::template rebind_alloc<U>>;};
+
+	using A::A;
+
+	/**
+	 * @brief      Default-initialize object
+	 */
+	template<typename U>
+	void construct(U* ptr) noexcept(std::is_nothrow_default_constructible_v<U>)
+	{::new(static_cast<void*>(ptr)) U;}
+
+	/**
+	 * @brief      Construct object from arguments
+	 */
+	template<typename U, typename... Args>
+	void construct(U* ptr, Args&&... args) noexcept(std::is_nothrow_constructible_v<U, Args...>)
+	{::new(static_cast<void*>(ptr)) U(std::forward<Args>(args)...);}
+};
+
+using ByteBuffer = std::vector<uint8_t, DefaultInitAllocator<uint8_t>>; ///< Byte vector without zero-fill on resize
+
 /**
  * @brief      I/O buffer class
  *
  * Can be used for serialization and deserialization of values and structures.
  *
  * Implementation, including specializations for basic types, is provided in IOBufferImpl.h.
+ *
+ * If a reference threshold is set, large blocks of data pushed with
+ * push_ref() are not copied into the buffer but referenced instead. The
+ * referenced memory must stay valid until the buffer is transmitted or
+ * cleared. Buffers containing references can only be used for sending.
+ *
+ * Resizing the buffer does not initialize the new bytes, so received data
+ * is written to the memory only once. Growing and copying the buffer is done
+ * with memcpy, as the standard library falls back to per-element copies for
+ * custom allocators.
  */
-class IOBuffer : public std::vector<uint8_t>
+class IOBuffer : public ByteBuffer
 {
 	/**
 	 * @brief      Helper struct providing serialization
@@ -33,13 +86,37 @@ class IOBuffer : public std::vector<uint8_t>
 	template<typename T>
 	friend struct Serialize;
 public:
-	using std::vector<uint8_t>::vector; ///< Use STL constructors
+	/**
+	 * @brief      Externally stored data segment
+	 */
+	struct Reference
+	{
+		size_t offset; ///< Position in the buffer at which the data is inserted
+		const uint8_t* data; ///< Referenced data
+		size_t length; ///< Number of bytes
+	};
+
+	using ByteBuffer::vector; ///< Use STL constructors
+
+	IOBuffer() = default;
+	IOBuffer(const IOBuffer&);
+	IOBuffer(IOBuffer&&) noexcept = default;
+	IOBuffer& operator=(const IOBuffer&);
+	IOBuffer& operator=(IOBuffer&&) noexcept = default;
+
+	void reserve(size_t);
+	void resize(size_t);
+	using ByteBuffer::assign;
+	void assign(const uint8_t*, const uint8_t*);
 
 	void push_raw(const void*, size_t);
+	void push_ref(const void*, size_t);
 	template<typename T> void push(const T&);
 	template<typename T, typename... Args> void push(const T&, const Args&...);
 
 	const void* pop_raw(size_t);
+	const char* pop_str(size_t&);
+	template<typename T> void pop_array(T*, size_t);
 	template<typename T> void pop(T&);
 	template<typename T, typename... Args> void pop(T&, Args&...);
 	template<typename T> T pop();
@@ -51,8 +128,15 @@ public:
 	void reset() noexcept;
 
 	size_t tell() const;
+
+	void setReferenceThreshold(size_t) noexcept;
+	const std::vector<Reference>& references() const noexcept;
+	size_t totalSize() const noexcept;
 private:
 	  size_t rpos = 0; ///< Offset of the read cursor
+	  size_t refThreshold = 0; ///< Minimum size of data to reference instead of copy (0 to disable)
+	  size_t refBytes = 0; ///< Total size of referenced data
+	  std::vector<Reference> refs; ///< Referenced data segments
 
 	  template<typename T> void push_T(const T&);
 	  template<typename T> void pop_T(T&);
@@ -60,14 +144,92 @@ private:
 
 ///////////////////////////////////////////////////////////////////////////////
 
+/**
+ * @brief      Copy buffer
+ *
+ * @param      other  Buffer to copy
+ */
+inline IOBuffer::IOBuffer(const IOBuffer& other) :
+    ByteBuffer(), rpos(other.rpos), refThreshold(other.refThreshold), refBytes(other.refBytes), refs(other.refs)
+{assign(other.data(), other.data()+other.size());}
+
+/**
+ * @brief      Copy buffer
+ *
+ * @param      other  Buffer to copy
+ *
+ * @return     Reference to this buffer
+ */
+inline IOBuffer& IOBuffer::operator=(const IOBuffer& other)
+{
+	if(this == &other)
+		return *this;
+	assign(other.data(), other.data()+other.size());
+	rpos = other.rpos;
+	refThreshold = other.refThreshold;
+	refBytes = other.refBytes;
+	refs = other.refs;
+	return *this;
+}
+
+/**
+ * @brief      Ensure capacity for at least the given number of bytes
+ *
+ * @param      length  Minimum capacity
+ */
+inline void IOBuffer::reserve(size_t length)
+{
+	if(length <= capacity())
+		return;
+	ByteBuffer storage;
+	storage.reserve(length);
+	storage.ByteBuffer::resize(size());
+	if(!empty())
+		memcpy(storage.data(), data(), size());
+	ByteBuffer::swap(storage);
+}
+
+/**
+ * @brief      Resize buffer
+ *
+ * New bytes are left uninitialized. Capacity grows geometrically.
+ *
+ * @param      length  New size
+ */
+inline void IOBuffer::resize(size_t length)
+{
+	if(length > capacity())
+		reserve(std::max(length, 2*capacity()));
+	ByteBuffer::resize(length);
+}
+
+/**
+ * @brief      Replace content of the buffer
+ *
+ * The read cursor is not modified.
+ *
+ * @param      first  Start of the data to copy
+ * @param      last   End of the data to copy
+ */
+inline void IOBuffer::assign(const uint8_t* first, const uint8_t* last)
+{
+	ByteBuffer::clear();
+	resize(size_t(last-first));
+	if(first != last)
+		memcpy(data(), first, size_t(last-first));
+}
+
 /**
  * @brief      Clear the buffer
  *
- * Sets the size to zero and resets the read cursor to beginning.
+ * Sets the size to zero, drops all references and resets the read cursor to
+ * beginning.
  */
 inline void IOBuffer::clear() noexcept
 {
-	std::vector<uint8_t>::clear();
+	ByteBuffer::clear();
+	refs.clear();
+	refBytes = 0;
 	rpos = 0;
 }
 
@@ -86,8 +248,37 @@ inline void IOBuffer::start()
  */
 inline void IOBuffer::finalize()
 {
-	uint32_t v = htole32(uint32_t(size() - 4));
+	uint32_t v = htole32(uint32_t(totalSize() - 4));
 	memcpy(data(), &v, sizeof(v));
 }
 
+/**
+ * @brief      Set minimum size of data referenced by push_ref()
+ *
+ * Referencing is only safe if everything serialized into the buffer
+ * outlives its transmission. ExmdbClient only enables it for blocking
+ * requests, where the request arguments (including cached serialized
+ * restrictions) are alive until the response is received. Buffers that are
+ * sent later, like those of pipelines and the AsyncClient, must keep the
+ * threshold at 0.
+ *
+ * @param      threshold  Minimum number of bytes (0 to always copy)
+ */
+inline void IOBuffer::setReferenceThreshold(size_t threshold) noexcept
+{refThreshold = threshold;}
+
+/**
+ * @brief      Return referenced data segments
+ *
+ * @return     List of references, ordered by offset
+ */
+inline const std::vector<IOBuffer::Reference>& IOBuffer::references() const noexcept
+{return refs;}
+
+/**
+ * @brief      Return size of the buffer including referenced data
+ */
+inline size_t IOBuffer::totalSize() const noexcept
+{return size()+refBytes;}
+
 }
@@ -2,6 +2,7 @@
 
 #include <array>
 #include <cstdint>
+#include <type_traits>
 #include "IOBuffer.h"
 #include <endian.h>
 
@@ -28,7 +29,32 @@ struct IOBuffer::Serialize<std::array<T, N>>
  * @param      length  Number of bytes to append
  */
 inline void IOBuffer::push_raw(const void* data, size_t length)
-{insert(end(), reinterpret_cast<const uint8_t*>(data), reinterpret_cast<const uint8_t*>(data)+length);}
+{
+	if(size()+length > capacity())
+		reserve(std::max(size()+length, 2*capacity()));
+	size_t offset = size();
+	ByteBuffer::resize(offset+length);
+	if(length)
+		memcpy(this->data()+offset, data, length);
+}
+
+/**
+ * @brief      Push data into the buffer without copying
+ *
+ * If the length reaches the reference threshold, only a reference to the
+ * data is stored, which must stay valid until the buffer is sent or cleared.
+ * Otherwise, the data is copied like with push_raw().
+ *
+ * @param      data    Data to insert
+ * @param      length  Number of bytes to append
+ */
+inline void IOBuffer::push_ref(const void* data, size_t length)
+{
+	if(!refThreshold || length < refThreshold)
+		return push_raw(data, length);
+	refs.emplace_back(Reference{size(), static_cast<const uint8_t*>(data), length});
+	refBytes += length;
+}
 
 /**
  * @brief      Push data element without conversion
@@ -106,6 +132,67 @@ inline const void* IOBuffer::pop_raw(size_t length)
 	return data()+rpos-length;
 }
 
+/**
+ * @brief      Return null-terminated string and advance read cursor
+ *
+ * The terminator is located with memchr, which uses vectorized
+ * implementations where available.
+ *
+ * No data is copied by this call, see pop_raw().
+ *
+ * @throw      std::out_of_range No null character found before the end of the buffer
+ *
+ * @param      length  Length of the string (excluding the terminator)
+ *
+ * @return     Pointer to the string
+ */
+inline const char* IOBuffer::pop_str(size_t& length)
+{
+	const char* str = reinterpret_cast<const char*>(data()+rpos);
+	const void* end = rpos < size()? memchr(str, 0, size()-rpos) : nullptr;
+	if(!end)
+		throw std::out_of_range("Read past the end of buffer. (Unterminated string, "+std::to_string(size()-rpos)+
+		                        " bytes available)");
+	length = size_t(static_cast<const char*>(end)-str);
+	rpos += length+1;
+	return str;
+}
+
+/**
+ * @brief      Read array of little endian numbers
+ *
+ * On little endian hosts, the data is copied directly. Otherwise integers
+ * are converted in a separate pass that the compiler can vectorize.
+ * In accordance with the scalar specializations, floating point values
+ * are never converted.
+ *
+ * @throw      std::out_of_range Less than count elements are available
+ *
+ * @param      dest   Destination array
+ * @param      count  Number of elements to read
+ *
+ * @tparam     T      Element type
+ */
+template<typename T>
+inline void IOBuffer::pop_array(T* dest, size_t count)
+{
+	static_assert(std::is_arithmetic_v<T>, "Bulk deserialization is only available for numbers");
+	if(!count)
+		return;
+	memcpy(dest, pop_raw(count*sizeof(T)), count*sizeof(T));
+#if __BYTE_ORDER != __LITTLE_ENDIAN
+	if constexpr(std::is_integral_v<T> && sizeof(T) == sizeof(uint16_t))
+		for(T* it = dest; it != dest+count; ++it)
+			*it = T(le16toh(*it));
+	else if constexpr(std::is_integral_v<T> && sizeof(T) == sizeof(uint32_t))
+		for(T* it = dest; it != dest+count; ++it)
+			*it = T(le32toh(*it));
+	else if constexpr(std::is_integral_v<T> && sizeof(T) == sizeof(uint64_t))
+		for(T* it = dest; it != dest+count; ++it)
+			*it = T(le64toh(*it));
+#endif
+}
+
 /**
  * @brief      Pop data from buffer
  *
@@ -228,7 +315,7 @@ inline void IOBuffer::Serialize<T>::push(IOBuffer&, const T&)
  */
 template<>
 inline void IOBuffer::Serialize<uint8_t>::push(IOBuffer& buff, const uint8_t& value)
-{buff.push_back(value);}
+{buff.push_raw(&value, sizeof(value));}
 
 /**
  * @brief      Insert uint16_t value into IOBuffer
@@ -320,10 +407,7 @@ inline void IOBuffer::Serialize<char*>::push(IOBuffer& buff, char* const& value)
  */
 template<>
 inline void IOBuffer::Serialize<std::string>::push(IOBuffer& buff, const std::string& value)
-{
-	buff.push_raw(value.data(), value.length());
-	buff.push_back(0);
-}
+{buff.push_raw(value.c_str(), value.length()+1);}
 
 /**
  * @brief      Insert bool value into IOBuffer
@@ -333,7 +417,7 @@ inline void IOBuffer::Serialize<std::string>::push(IOBuffer& buff, const std::st
  */
 template<>
 inline void IOBuffer::Serialize<bool>::push(IOBuffer& buff, const bool& value)
-{buff.push_back(value);}
+{buff.push<uint8_t>(value);}
 
 /**
  * @brief      Insert array of values into buffer
@@ -466,9 +550,8 @@ inline void IOBuffer::Serialize<bool>::pop(IOBuffer& buff, bool& value)
 template<>
 inline void IOBuffer::Serialize<const char*>::pop(IOBuffer& buff, const char*& value)
 {
-	const char* temp = reinterpret_cast<const char*>(buff.data()+buff.tell());
-	while(*reinterpret_cast<const char*>(buff.pop_raw(1)));
-	value = temp;
+	size_t length;
+	value = buff.pop_str(length);
 }
 
 /**
@@ -485,9 +568,9 @@ inline void IOBuffer::Serialize<const char*>::pop(IOBuffer& buff, const char*& v
 template<>
 inline void IOBuffer::Serialize<std::string>::pop(IOBuffer& buff, std::string& value)
 {
-	const char* temp = reinterpret_cast<const char*>(buff.data()+buff.tell());
-	while(*reinterpret_cast<const char*>(buff.pop_raw(1)));
-	value = temp;
+	size_t length;
+	const char* str = buff.pop_str(length);
+	value.assign(str, length);
 }
 
 }
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "queries.h"
+#include "structures.h"
+
+namespace exmdbpp::queries
+{
+
+/**
+ * @brief      Concurrent export of message contents
+ *
+ * Reads messages over multiple pooled connections in parallel, while the
+ * message IDs are paged from a content table. Each worker fetches and
+ * decodes a message on its own connection, so network latency of one
+ * request overlaps with transfer and decoding of others.
+ *
+ * Messages are delivered to the sink from the calling thread, in the order
+ * of the message IDs. Memory usage is bounded by the window size, which
+ * limits the number of messages fetched but not yet delivered.
+ */
+class MessageExporter
+{
+public:
+	using Sink = std::function<void(uint64_t, structures::MessageContent&&)>; ///< Receives message ID and content
+	using ErrorHandler = std::function<void(uint64_t, std::exception_ptr)>; ///< Receives message ID and error
+
+	explicit MessageExporter(QueriesPool&, size_t=0, size_t=0);
+
+	size_t exportFolder(const std::string&, uint64_t, const Sink&, uint8_t=0,
+	                    const structures::Restriction& = structures::Restriction::XNULL(), uint32_t=1000);
+	size_t exportMessages(const std::string&, const std::vector<uint64_t>&, const Sink&);
+
+	void setErrorHandler(ErrorHandler) noexcept;
+
+private:
+	size_t run(const std::string&, const std::function<bool(uint64_t&)>&, const Sink&, size_t);
+
+	QueriesPool& pool; ///< Pool providing the connections
+	size_t workers; ///< Maximum number of concurrent fetches (0 to use all available connections)
+	size_t window; ///< Maximum number of messages fetched but not delivered (0 for twice the number of workers)
+	ErrorHandler onError; ///< Handler for failed messages (export aborts if not set)
+};
+
+}
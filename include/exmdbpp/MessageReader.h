@@ -0,0 +1,122 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "ExmdbClient.h"
+#include "IOBuffer.h"
+#include "structures.h"
+
+namespace exmdbpp
+{
+
+/**
+ * @brief      Event interface for streamed message content
+ *
+ * Receives the contents of a message in the order they appear in the
+ * response. Each message (including embedded messages) is enclosed in
+ * beginMessage() / endMessage() calls, each attachment in
+ * beginAttachment() / endAttachment() calls. Properties reported between
+ * beginAttachment() and the next beginMessage() or endAttachment() belong to
+ * the attachment, other properties belong to the innermost message.
+ *
+ * Binary properties exceeding the blob threshold of the reader are not
+ * decoded but reported in chunks via beginBlob(), blobChunk() and endBlob().
+ *
+ * All functions have empty default implementations.
+ */
+class MessageHandler
+{
+public:
+	virtual ~MessageHandler() = default;
+
+	/**
+	 * @brief      Start of a message
+	 */
+	virtual void beginMessage() {}
+
+	/**
+	 * @brief      Property of the current message or attachment
+	 *
+	 * @param      propval  Decoded property
+	 */
+	virtual void propval(structures::TaggedPropval&&) {}
+
+	/**
+	 * @brief      Start of a large binary property
+	 *
+	 * @param      tag     Tag of the property
+	 * @param      length  Total size of the property data
+	 */
+	virtual void beginBlob(uint32_t, uint32_t) {}
+
+	/**
+	 * @brief      Part of a large binary property
+	 *
+	 * The data is only valid until the function returns.
+	 *
+	 * @param      data    Pointer to the data
+	 * @param      length  Number of bytes
+	 */
+	virtual void blobChunk(const uint8_t*, size_t) {}
+
+	/**
+	 * @brief      End of a large binary property
+	 */
+	virtual void endBlob() {}
+
+	/**
+	 * @brief      Recipient of the current message
+	 *
+	 * @param      propvals  Properties of the recipient
+	 */
+	virtual void recipient(std::vector<structures::TaggedPropval>&&) {}
+
+	/**
+	 * @brief      Start of an attachment of the current message
+	 */
+	virtual void beginAttachment() {}
+
+	/**
+	 * @brief      End of the current attachment
+	 */
+	virtual void endAttachment() {}
+
+	/**
+	 * @brief      End of the current message
+	 */
+	virtual void endMessage() {}
+};
+
+/**
+ * @brief      Incremental message content parser
+ *
+ * Parses serialized message content directly from a response stream and
+ * reports its contents to a MessageHandler, without loading the whole
+ * message (including attachments) into memory.
+ *
+ * Memory usage is bounded by the stream buffer size and the size of the
+ * largest property not handled as blob. String properties and recipients
+ * are always decoded completely.
+ */
+class MessageReader
+{
+public:
+	static constexpr uint32_t DEFAULT_BLOB_THRESHOLD = 65536; ///< Default minimum size of binary properties reported as blob
+
+	explicit MessageReader(MessageHandler&, uint32_t=DEFAULT_BLOB_THRESHOLD);
+
+	void read(ExmdbClient::ResponseStream&);
+
+private:
+	void readMessage(ExmdbClient::ResponseStream&, unsigned);
+	void readPropvals(ExmdbClient::ResponseStream&, std::vector<structures::TaggedPropval>*);
+	void readPropval(ExmdbClient::ResponseStream&, std::vector<structures::TaggedPropval>*);
+	void copy(ExmdbClient::ResponseStream&, size_t);
+	void copyArray(ExmdbClient::ResponseStream&, size_t);
+
+	MessageHandler& handler; ///< Handler receiving the events
+	uint32_t blobThreshold; ///< Minimum size of binary properties reported as blob
+	IOBuffer scratch; ///< Buffer used to decode properties
+};
+
+}
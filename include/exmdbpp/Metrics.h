@@ -0,0 +1,115 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace exmdbpp
+{
+
+/**
+ * @brief      Measurements of a single request
+ */
+struct CallRecord
+{
+	static constexpr uint8_t CONNECTION_ERROR = 0xFF; ///< Status reported if the connection failed
+	static constexpr uint8_t DECODE_ERROR = 0xFE; ///< Status reported if the response could not be deserialized
+
+	uint8_t callId = 0; ///< ID of the request
+	uint8_t status = 0; ///< Response code (0 on success)
+	uint64_t requestBytes = 0; ///< Size of the serialized request
+	uint64_t responseBytes = 0; ///< Size of the response payload
+	uint64_t serializeNs = 0; ///< Time spent serializing the request
+	uint64_t networkNs = 0; ///< Time between start of transmission and reception of the response
+	uint64_t deserializeNs = 0; ///< Time spent deserializing the response
+};
+
+/**
+ * @brief      Instrumentation hook interface
+ *
+ * Receives a CallRecord for each request sent by a client. Implementations
+ * must be thread-safe if shared between clients used by different threads.
+ */
+class Instrumentation
+{
+public:
+	virtual ~Instrumentation() = default;
+
+	/**
+	 * @brief      Record completed request
+	 *
+	 * @param      record  Measurements of the request
+	 */
+	virtual void record(const CallRecord&) noexcept = 0;
+
+	/**
+	 * @brief      Record successful reconnect
+	 */
+	virtual void reconnected() noexcept {}
+};
+
+/**
+ * @brief      Lock-free histogram with power-of-two buckets
+ *
+ * Bucket `i` counts values `v` with `2^(i-1) < v <= 2^i` (bucket 0 counts
+ * values up to 1), so the upper bound of each bucket is inclusive.
+ */
+class Histogram
+{
+public:
+	static constexpr size_t BUCKETS = 65; ///< Number of buckets
+
+	void add(uint64_t) noexcept;
+	void reset() noexcept;
+
+	uint64_t count() const noexcept;
+	uint64_t sum() const noexcept;
+	uint64_t bucket(size_t) const noexcept;
+	uint64_t quantile(double) const noexcept;
+
+	static uint64_t upperBound(size_t) noexcept;
+
+private:
+	std::array<std::atomic<uint64_t>, BUCKETS> buckets{}; ///< Number of values per bucket
+	std::atomic<uint64_t> total{0}; ///< Sum of all values
+};
+
+/**
+ * @brief      Built-in instrumentation collecting per-call statistics
+ *
+ * All counters can be updated concurrently without locking.
+ */
+class Metrics : public Instrumentation
+{
+public:
+	/**
+	 * @brief      Statistics of a single request type
+	 */
+	struct CallStats
+	{
+		std::atomic<uint64_t> calls{0}; ///< Number of requests
+		std::atomic<uint64_t> errors{0}; ///< Number of failed requests
+		std::atomic<uint64_t> requestBytes{0}; ///< Total size of requests
+		std::atomic<uint64_t> responseBytes{0}; ///< Total size of responses
+		Histogram serialize; ///< Serialization time in nanoseconds
+		Histogram network; ///< Network round trip time in nanoseconds
+		Histogram deserialize; ///< Deserialization time in nanoseconds
+	};
+
+	void record(const CallRecord&) noexcept override;
+	void reconnected() noexcept override;
+
+	const CallStats& stats(uint8_t) const noexcept;
+	uint64_t errors(uint8_t) const noexcept;
+	uint64_t reconnects() const noexcept;
+
+	std::string exportText() const;
+	void reset() noexcept;
+
+private:
+	std::array<CallStats, 256> calls; ///< Statistics per call ID
+	std::array<std::atomic<uint64_t>, 256> errorCodes{}; ///< Number of errors per status code
+	std::atomic<uint64_t> reconnectCount{0}; ///< Number of reconnects
+};
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ExmdbClient.h"
+#include "structures.h"
+
+namespace exmdbpp::queries
+{
+
+/**
+ * @brief      Thread-safe cache of named property IDs
+ *
+ * Maps property names to property IDs per store (identified by its home
+ * directory). The cache can be shared by multiple clients, concurrent
+ * lookups of names that are not cached yet are coalesced into a single
+ * GetNamedPropIdsRequest.
+ *
+ * Names that cannot be resolved (ID 0) are not cached.
+ */
+class NamedPropCache
+{
+public:
+	std::vector<uint16_t> resolve(ExmdbClient&, const std::string&, bool, const std::vector<structures::PropertyName>&);
+
+	void invalidate(const std::string&);
+	void clear();
+
+	size_t size() const;
+
+private:
+	using Entry = std::shared_ptr<const std::shared_future<uint16_t>>; ///< (Possibly pending) property ID
+	using Store = std::unordered_map<std::string, Entry>; ///< Property IDs by serialized property name
+
+	void forget(const std::string&, const std::string&, const Entry&);
+
+	static std::string key(const structures::PropertyName&);
+
+	mutable std::mutex mutex; ///< Mutex protecting the store map
+	std::unordered_map<std::string, Store> stores; ///< Cached IDs by home directory
+};
+
+}
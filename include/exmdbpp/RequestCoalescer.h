@@ -0,0 +1,208 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "IOBuffer.h"
+#include "requests.h"
+
+namespace exmdbpp
+{
+
+/**
+ * @brief      Single-flight layer sharing identical concurrent requests
+ *
+ * Requests are identified by their serialized form (including call ID and
+ * home directory). If a request is sent while an identical request is
+ * still in flight, the caller waits for the pending request and receives
+ * the same response instead of sending another request to the server.
+ *
+ * Optionally, responses can be kept for a short time to live, so that
+ * identical requests arriving shortly after are answered from the cache.
+ * Failed requests are never cached, the error is only passed to the callers
+ * waiting at the time.
+ *
+ * Only requests without side effects should be sent through the coalescer.
+ *
+ * @tparam     Target  Thread-safe request sender (e.g. ClientPool or ClientRouter)
+ */
+template<class Target>
+class RequestCoalescer
+{
+public:
+	template<class Request>
+	using Result = std::shared_ptr<const requests::Response_t<Request>>; ///< Shared, immutable response
+
+	explicit RequestCoalescer(Target&, std::chrono::milliseconds=std::chrono::milliseconds(0));
+	RequestCoalescer(const RequestCoalescer&) = delete;
+	RequestCoalescer& operator=(const RequestCoalescer&) = delete;
+
+	template<class Request, typename... Args>
+	Result<Request> send(const Args&...);
+
+	void clear();
+	size_t size() const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	/**
+	 * @brief      Pending or cached request
+	 */
+	struct Flight
+	{
+		std::promise<std::shared_ptr<const void>> promise; ///< Promise fulfilled by the sending thread
+		std::shared_future<std::shared_ptr<const void>> result = promise.get_future().share(); ///< Response
+		bool done = false; ///< Whether the response is available
+		Clock::time_point expires; ///< Time after which a cached response becomes invalid
+	};
+
+	void finish(const std::string&, const std::shared_ptr<Flight>&, bool);
+	void purge(Clock::time_point);
+
+	Target& target; ///< Sender used for requests
+	std::chrono::milliseconds ttl; ///< Time to keep responses (0 to share in-flight requests only)
+	mutable std::mutex mutex; ///< Mutex protecting the flight map
+	std::unordered_map<std::string, std::shared_ptr<Flight>> flights; ///< Pending and cached requests by serialized request
+	size_t purgeAt = 64; ///< Number of entries at which expired entries are removed
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief      Initialize coalescer
+ *
+ * @param      target  Sender used for requests
+ * @param      ttl     Time to keep responses (0 to share in-flight requests only)
+ */
+template<class Target>
+RequestCoalescer<Target>::RequestCoalescer(Target& target, std::chrono::milliseconds ttl) : target(target), ttl(ttl)
+{}
+
+/**
+ * @brief      Send request or join identical pending request
+ *
+ * See documentation of the specific Request for a description of the
+ * parameters.
+ *
+ * @param      args     Values to serialize
+ *
+ * @tparam     Request  Type of the request
+ * @tparam     Args     Request arguments
+ *
+ * @throws     Any exception thrown by the shared request
+ *
+ * @return     Parsed response object
+ */
+template<class Target>
+template<class Request, typename... Args>
+typename RequestCoalescer<Target>::template Result<Request> RequestCoalescer<Target>::send(const Args&... args)
+{
+	using Response = requests::Response_t<Request>;
+	IOBuffer buff;
+	Request::write(buff, args...);
+	std::string key(reinterpret_cast<const char*>(buff.data()), buff.size());
+	std::shared_ptr<Flight> flight;
+	bool leader = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Clock::time_point now = Clock::now();
+		auto it = flights.find(key);
+		if(it != flights.end() && (!it->second->done || it->second->expires > now))
+			flight = it->second;
+		else
+		{
+			if(flights.size() >= purgeAt)
+				purge(now);
+			flight = std::make_shared<Flight>();
+			flights[key] = flight;
+			leader = true;
+		}
+	}
+	if(!leader)
+		return std::static_pointer_cast<const Response>(flight->result.get());
+	try
+	{
+		auto response = std::make_shared<const Response>(target.template send<Request>(args...));
+		flight->promise.set_value(response);
+		finish(key, flight, true);
+		return response;
+	}
+	catch(...)
+	{
+		flight->promise.set_exception(std::current_exception());
+		finish(key, flight, false);
+		throw;
+	}
+}
+
+/**
+ * @brief      Drop all cached responses
+ *
+ * Pending requests are not affected.
+ */
+template<class Target>
+void RequestCoalescer<Target>::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for(auto it = flights.begin(); it != flights.end();)
+		it = it->second->done? flights.erase(it) : std::next(it);
+}
+
+/**
+ * @brief      Return number of pending and cached requests
+ */
+template<class Target>
+size_t RequestCoalescer<Target>::size() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return flights.size();
+}
+
+/**
+ * @brief      Complete request
+ *
+ * Successful responses are kept until the time to live has passed, other
+ * entries are removed.
+ *
+ * @param      key      Serialized request
+ * @param      flight   Completed request
+ * @param      success  Whether the request succeeded
+ */
+template<class Target>
+void RequestCoalescer<Target>::finish(const std::string& key, const std::shared_ptr<Flight>& flight, bool success)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = flights.find(key);
+	if(it == flights.end() || it->second != flight)
+		return;
+	if(success && ttl.count() > 0)
+	{
+		flight->done = true;
+		flight->expires = Clock::now()+ttl;
+	}
+	else
+		flights.erase(it);
+}
+
+/**
+ * @brief      Remove expired responses
+ *
+ * Adjusts the purge threshold to twice the number of remaining entries.
+ *
+ * @param      now   Current time
+ */
+template<class Target>
+void RequestCoalescer<Target>::purge(Clock::time_point now)
+{
+	for(auto it = flights.begin(); it != flights.end();)
+		it = it->second->done && it->second->expires <= now? flights.erase(it) : std::next(it);
+	purgeAt = std::max<size_t>(64, 2*flights.size());
+}
+
+}
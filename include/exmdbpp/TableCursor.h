@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "ExmdbClient.h"
+#include "requests.h"
+#include "structures.h"
+
+namespace exmdbpp::queries
+{
+
+/**
+ * @brief      Paged iterator over a loaded table
+ *
+ * Retrieves the rows of a table in pages of fixed size using repeated
+ * QueryTableRequests, so only a single page needs to be held in memory at
+ * any time. The table is automatically unloaded when the cursor is destroyed.
+ *
+ * If prefetching is enabled, the next page is requested in the background
+ * while the current one is processed. In this case the client must not be
+ * used by anyone else until the cursor is closed or destroyed.
+ */
+class TableCursor
+{
+public:
+	using PropvalList = std::vector<structures::TaggedPropval>; ///< Single table row
+	using Page = std::vector<PropvalList>; ///< Rows retrieved by a single request
+
+	TableCursor(ExmdbClient&, const std::string&, uint32_t, uint32_t, const std::vector<uint32_t>&, uint32_t=1000, bool=false);
+	~TableCursor();
+	TableCursor(const TableCursor&) = delete;
+	TableCursor& operator=(const TableCursor&) = delete;
+
+	static TableCursor hierarchy(ExmdbClient&, const std::string&, uint64_t, const std::vector<uint32_t>&, bool=false,
+	                             uint32_t=1000, bool=false, const structures::Restriction& = structures::Restriction::XNULL());
+	static TableCursor content(ExmdbClient&, const std::string&, uint64_t, const std::vector<uint32_t>&, uint8_t=0,
+	                           uint32_t=1000, bool=false, const structures::Restriction& = structures::Restriction::XNULL());
+
+	const PropvalList* next();
+	Page nextPage();
+	void close();
+
+	uint32_t rowCount() const noexcept;
+	uint32_t tableId() const noexcept;
+
+private:
+	bool advance();
+	Page fetch(uint32_t);
+
+	ExmdbClient& client; ///< Client used to query the table
+	std::string homedir; ///< Home directory of the store
+	std::vector<uint32_t> proptags; ///< Tags to retrieve
+	uint32_t id; ///< ID of the loaded table
+	uint32_t rows; ///< Number of rows in the table
+	uint32_t pageSize; ///< Maximum number of rows per request
+	uint32_t offset = 0; ///< Position of the next page to request
+	bool prefetch; ///< Whether to request the next page in the background
+	bool open = true; ///< Whether the table is still loaded
+	Page page; ///< Current page
+	size_t pos = 0; ///< Position of the next row in the current page
+	std::future<Page> pending; ///< Prefetched page
+};
+
+}
@@ -0,0 +1,305 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "constants.h"
+#include "IOBufferImpl.h"
+#include "structures.h"
+
+namespace exmdbpp::requests
+{
+
+/**
+ * @brief      Column specification for TypedTable
+ *
+ * Supported value types are:
+ *
+ * - bool or uint8_t for BYTE tags
+ * - uint16_t for SHORT tags
+ * - uint32_t for LONG and ERROR tags
+ * - uint64_t for LONGLONG, CURRENCY and FILETIME tags
+ * - float for FLOAT tags
+ * - double for DOUBLE and FLOATINGTIME tags
+ * - std::string or std::string_view for STRING, WSTRING and BINARY tags
+ * - const char* for STRING and WSTRING tags
+ *
+ * Views and pointers reference the response buffer owned by the table.
+ *
+ * @tparam     Tag   Tag to retrieve
+ * @tparam     T     Value type
+ */
+template<uint32_t Tag, typename T>
+struct Field
+{
+	static constexpr uint32_t tag = Tag; ///< Tag of the field
+	using type = T; ///< Value type of the field
+
+	/**
+	 * @brief      Check whether the value type can represent the tag type
+	 */
+	static constexpr bool compatible()
+	{
+		using namespace constants;
+		constexpr uint16_t pt = PropvalType::tagType(Tag);
+		if constexpr(std::is_same_v<T, bool> || std::is_same_v<T, uint8_t>)
+			return pt == PropvalType::BYTE;
+		else if constexpr(std::is_same_v<T, uint16_t>)
+			return pt == PropvalType::SHORT;
+		else if constexpr(std::is_same_v<T, uint32_t>)
+			return pt == PropvalType::LONG || pt == PropvalType::ERROR;
+		else if constexpr(std::is_same_v<T, uint64_t>)
+			return pt == PropvalType::LONGLONG || pt == PropvalType::CURRENCY || pt == PropvalType::FILETIME;
+		else if constexpr(std::is_same_v<T, float>)
+			return pt == PropvalType::FLOAT;
+		else if constexpr(std::is_same_v<T, double>)
+			return pt == PropvalType::DOUBLE || pt == PropvalType::FLOATINGTIME;
+		else if constexpr(std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>)
+			return pt == PropvalType::STRING || pt == PropvalType::WSTRING || pt == PropvalType::BINARY;
+		else if constexpr(std::is_same_v<T, const char*>)
+			return pt == PropvalType::STRING || pt == PropvalType::WSTRING;
+		return false;
+	}
+
+	static_assert(compatible(), "Field type cannot represent tag type");
+};
+
+/**
+ * @brief      Table response with compile-time row schema
+ *
+ * Decodes the result of a QueryTableRequest directly into typed fields
+ * without creating intermediate TaggedPropval objects. The list of tags to
+ * request is provided by `proptags`.
+ *
+ * Fields that are not contained in a row are value-initialized and can be
+ * detected with Row::has(). Values with tags that do not match exactly (e.g.
+ * error values) are treated as missing.
+ *
+ * Example:
+ *
+ *     using Folders = TypedTable<Field<PropTag::FOLDERID, uint64_t>, Field<PropTag::DISPLAYNAME, std::string_view>>;
+ *     Folders folders(client.sendRaw<QueryTableRequest>(homedir, "", 0, tableId, Folders::proptags, 0, rowCount));
+ *     for(const auto& row : folders)
+ *         std::cout << row.get<PropTag::FOLDERID>() << ": " << row.get<PropTag::DISPLAYNAME>() << "\n";
+ *
+ * @tparam     Fields  Field specifications
+ */
+template<class... Fields>
+class TypedTable
+{
+	static_assert(sizeof...(Fields) > 0 && sizeof...(Fields) <= 64, "TypedTable requires between 1 and 64 fields");
+
+	template<uint32_t Tag>
+	static constexpr size_t indexOf();
+
+public:
+	static constexpr std::array<uint32_t, sizeof...(Fields)> proptags = {Fields::tag...}; ///< Tags to request
+
+	/**
+	 * @brief      Single table row
+	 */
+	struct Row
+	{
+		template<uint32_t Tag> const auto& get() const;
+		template<uint32_t Tag> bool has() const;
+
+		std::tuple<typename Fields::type...> values{}; ///< Field values
+		uint64_t present = 0; ///< Bitmask of fields contained in the row
+	};
+
+	explicit TypedTable(IOBuffer&&);
+	explicit TypedTable(IOBuffer&);
+	TypedTable(TypedTable&&) noexcept = default;
+	TypedTable& operator=(TypedTable&&) noexcept = default;
+
+	const Row& operator[](size_t) const;
+	typename std::vector<Row>::const_iterator begin() const;
+	typename std::vector<Row>::const_iterator end() const;
+	size_t size() const noexcept;
+
+private:
+	template<size_t... I>
+	void read(Row&, size_t, std::index_sequence<I...>);
+
+	template<uint32_t Tag, typename T>
+	void read(T&);
+
+	IOBuffer buffer; ///< Response data referenced by views
+	std::vector<Row> rows; ///< Decoded rows
+};
+
+/**
+ * @brief      Decode table
+ *
+ * @param      buff  Buffer containing the response data (moved into the table)
+ */
+template<class... Fields>
+TypedTable<Fields...>::TypedTable(IOBuffer&& buff) : buffer(std::move(buff))
+{
+	rows.resize(buffer.pop<uint32_t>());
+	for(Row& row : rows)
+	{
+		uint16_t count = buffer.pop<uint16_t>();
+		size_t hint = 0;
+		for(uint16_t i = 0; i < count; ++i)
+		{
+			uint32_t tag;
+			if(buffer.tell()+sizeof(tag) > buffer.size())
+				throw std::out_of_range("Read past the end of buffer.");
+			memcpy(&tag, buffer.data()+buffer.tell(), sizeof(tag));
+			tag = le32toh(tag);
+			size_t index = 0;
+			while(index < proptags.size() && proptags[(hint+index)%proptags.size()] != tag)
+				++index;
+			if(index == proptags.size())
+			{
+				structures::TaggedPropval skipped(buffer);
+				continue;
+			}
+			index = (hint+index)%proptags.size();
+			hint = index+1;
+			buffer.pop<uint32_t>();
+			read(row, index, std::index_sequence_for<Fields...>());
+			row.present |= uint64_t(1) << index;
+		}
+	}
+}
+
+/**
+ * @brief      Decode table
+ *
+ * The buffer content is moved into the table.
+ *
+ * @param      buff  Buffer containing the response data
+ */
+template<class... Fields>
+inline TypedTable<Fields...>::TypedTable(IOBuffer& buff) : TypedTable(std::move(buff))
+{}
+
+/**
+ * @brief      Access row
+ *
+ * @param      index  Row index
+ *
+ * @return     Reference to the row
+ */
+template<class... Fields>
+inline auto TypedTable<Fields...>::operator[](size_t index) const -> const Row&
+{return rows[index];}
+
+/**
+ * @brief      Return iterator to first row
+ */
+template<class... Fields>
+inline auto TypedTable<Fields...>::begin() const -> typename std::vector<Row>::const_iterator
+{return rows.begin();}
+
+/**
+ * @brief      Return iterator past the last row
+ */
+template<class... Fields>
+inline auto TypedTable<Fields...>::end() const -> typename std::vector<Row>::const_iterator
+{return rows.end();}
+
+/**
+ * @brief      Return number of rows
+ */
+template<class... Fields>
+inline size_t TypedTable<Fields...>::size() const noexcept
+{return rows.size();}
+
+/**
+ * @brief      Return value of field
+ *
+ * @tparam     Tag   Tag of the field
+ *
+ * @return     Field value (value-initialized if not present)
+ */
+template<class... Fields>
+template<uint32_t Tag>
+inline const auto& TypedTable<Fields...>::Row::get() const
+{
+	static_assert(indexOf<Tag>() < sizeof...(Fields), "Tag is not part of the table");
+	return std::get<indexOf<Tag>()>(values);
+}
+
+/**
+ * @brief      Check whether the row contains a field
+ *
+ * @tparam     Tag   Tag of the field
+ *
+ * @return     true if the value is present, false otherwise
+ */
+template<class... Fields>
+template<uint32_t Tag>
+inline bool TypedTable<Fields...>::Row::has() const
+{
+	static_assert(indexOf<Tag>() < sizeof...(Fields), "Tag is not part of the table");
+	return present & (uint64_t(1) << indexOf<Tag>());
+}
+
+/**
+ * @brief      Find index of tag
+ *
+ * @tparam     Tag   Tag to search for
+ *
+ * @return     Index of the field or number of fields if not found
+ */
+template<class... Fields>
+template<uint32_t Tag>
+inline constexpr size_t TypedTable<Fields...>::indexOf()
+{
+	constexpr uint32_t tags[] = {Fields::tag...};
+	for(size_t i = 0; i < sizeof...(Fields); ++i)
+		if(tags[i] == Tag)
+			return i;
+	return sizeof...(Fields);
+}
+
+/**
+ * @brief      Read value into field selected at runtime
+ *
+ * @param      row    Row to read into
+ * @param      index  Index of the field
+ */
+template<class... Fields>
+template<size_t... I>
+inline void TypedTable<Fields...>::read(Row& row, size_t index, std::index_sequence<I...>)
+{((index == I && (read<Fields::tag>(std::get<I>(row.values)), true)) || ...);}
+
+/**
+ * @brief      Read single value
+ *
+ * @param      value  Destination
+ *
+ * @tparam     Tag    Tag of the value
+ * @tparam     T      Value type
+ */
+template<class... Fields>
+template<uint32_t Tag, typename T>
+inline void TypedTable<Fields...>::read(T& value)
+{
+	if constexpr(std::is_arithmetic_v<T>)
+		buffer >> value;
+	else if constexpr(constants::PropvalType::tagType(Tag) == constants::PropvalType::BINARY)
+	{
+		uint32_t length = buffer.pop<uint32_t>();
+		value = T(static_cast<const char*>(buffer.pop_raw(length)), length);
+	}
+	else if constexpr(std::is_same_v<T, const char*>)
+		value = buffer.pop<const char*>();
+	else
+	{
+		size_t length;
+		const char* str = buffer.pop_str(length);
+		value = T(str, length);
+	}
+}
+
+}
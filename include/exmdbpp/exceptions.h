@@ -23,6 +23,24 @@ public:
 	using ExmdbError::ExmdbError;
 };
 
+/**
+ * @brief   Exception thrown when a request exceeds its deadline
+ */
+class TimeoutError : public ConnectionError
+{
+public:
+	using ConnectionError::ConnectionError;
+};
+
+/**
+ * @brief   Exception thrown when a request was aborted via CancellationToken
+ */
+class CancelledError : public ConnectionError
+{
+public:
+	using ConnectionError::ConnectionError;
+};
+
 /**
  * @brief   Exception thrown when exmdb server returns an error code
  */
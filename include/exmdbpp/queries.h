@@ -1,14 +1,19 @@
 #pragma once
 #include <cstdint>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
 #include "requests.h"
+#include "ClientPool.h"
+#include "ClientRouter.h"
 #include "ExmdbClient.h"
 
 namespace exmdbpp
 {
 
+class MessageHandler;
+
 /**
  * @brief   Higher level implementation of multi-request queries
  */
@@ -31,6 +36,8 @@ struct Folder
 	uint64_t creationTime = 0;
 	std::string container;
 	bool syncToMobile = false;
+	uint64_t changeNumber = 0;
+	uint64_t lastModified = 0;
 private:
 	void init(const std::vector<structures::TaggedPropval>&, uint32_t=0);
 };
@@ -45,6 +52,7 @@ struct FolderList
 {
 	FolderList(const requests::Response_t<requests::QueryTableRequest>&, uint32_t=0);
 	FolderList(const std::vector<std::vector<structures::TaggedPropval>>&, uint32_t=0);
+	FolderList(const requests::ColumnarTableResponse&, uint32_t=0);
 
 	std::vector<Folder> folders;
 };
@@ -74,6 +82,22 @@ struct FolderMemberList
 	std::vector<Member> members;
 };
 
+/**
+ * @brief      Changes applied to a FolderTree by ExmdbQueries::syncFolderTree
+ */
+struct FolderChanges
+{
+	std::vector<uint64_t> added; ///< IDs of folders added to the tree
+	std::vector<uint64_t> modified; ///< IDs of folders whose properties changed
+	std::vector<uint64_t> removed; ///< IDs of folders removed from the tree
+
+	bool empty() const noexcept;
+};
+
+class FolderCache;
+class FolderTree;
+class NamedPropCache;
+
 /**
  * @brief      ExmdbClient extension providing useful queries
  *
@@ -94,6 +118,7 @@ public:
 
 	static const std::vector<uint32_t> defaultFolderProps; ///< Default properties when querying folders
 	static const uint32_t ownerRights; ///< Default rights for folder owners
+	static const size_t batchSize; ///< Maximum number of items processed per pipeline round trip
 
 	enum PermissionMode
 	{
@@ -103,10 +128,13 @@ public:
 	};
 
 	uint64_t createFolder(const std::string&, uint32_t, const std::string&, const std::string&, const std::string&, uint64_t=0);
+	std::vector<uint64_t> createFolders(const std::string&, uint32_t, const std::vector<Folder>&);
 	bool deleteFolder(const std::string&, uint64_t, bool=false);
+	size_t deleteFolders(const std::string&, const std::vector<uint64_t>&, bool=false);
 	PropvalTable findFolder(const std::string&, const std::string&, uint64_t=0, bool=true, uint32_t fuuz=0,
 	                        const std::vector<uint32_t>& = defaultFolderProps);
 	ProptagList getAllStoreProperties(const std::string&);
+	Folder getFolder(const std::string&, uint64_t);
 	[[deprecated]] PropvalTable getFolderList(const std::string&, const std::vector<uint32_t>& = defaultFolderProps, uint32_t=0, uint32_t=0);
 	PropvalTable getFolderMemberList(const std::string&, uint64_t);
 	PropvalList getFolderProperties(const std::string&, uint32_t, uint64_t, const std::vector<uint32_t>& = defaultFolderProps);
@@ -114,22 +142,43 @@ public:
 	PropvalList getStoreProperties(const std::string&, uint32_t, const std::vector<uint32_t>&);
 	PropvalTable listFolders(const std::string&, uint64_t, bool=false, const std::vector<uint32_t>& = defaultFolderProps,
 	                         uint32_t=0, uint32_t=0, const structures::Restriction& = structures::Restriction::XNULL());
+	requests::ColumnarTableResponse listFoldersColumnar(const std::string&, uint64_t, bool=false,
+	                                                    const std::vector<uint32_t>& = defaultFolderProps, uint32_t=0, uint32_t=0,
+	                                                    const structures::Restriction& = structures::Restriction::XNULL());
 	void removeStoreProperties(const std::string&, const std::vector<uint32_t>&);
 	bool removeDevice(const std::string&, const std::string&, const std::string&);
 	bool removeSyncStates(const std::string&, const std::string&);
+	bool readMessage(const std::string&, uint64_t, MessageHandler&, uint32_t=0);
+	void readMessageInstance(const std::string&, uint32_t, MessageHandler&);
 	std::vector<uint16_t> resolveNamedProperties(const std::string&, bool, const std::vector<structures::PropertyName>&);
 	bool resyncDevice(const std::string&, const std::string&, const std::string&, uint32_t);
+	FolderChanges syncFolderTree(const std::string&, FolderTree&);
 	uint32_t setFolderMember(const std::string&, uint64_t, const std::string&, uint32_t, PermissionMode=ADD);
 	uint32_t setFolderMember(const std::string&, uint64_t, uint64_t, uint32_t, PermissionMode=ADD);
+	size_t setFolderMemberBatch(const std::string&, const std::vector<uint64_t>&, const std::string&, uint32_t, PermissionMode=ADD);
 	size_t setFolderMembers(const std::string&, uint64_t, const std::vector<std::string>&, uint32_t);
 	ProblemList setFolderProperties(const std::string&, uint32_t, uint64_t, const std::vector<structures::TaggedPropval>&);
 	ProblemList setStoreProperties(const std::string&, uint32_t, const std::vector<structures::TaggedPropval>&);
+	size_t setSubtreeMember(const std::string&, uint64_t, const std::string&, uint32_t, PermissionMode=ADD);
 	void unloadStore(const std::string&);
 
+	void setFolderCache(std::shared_ptr<FolderCache>) noexcept;
+	const std::shared_ptr<FolderCache>& getFolderCache() const noexcept;
+	void setNamedPropCache(std::shared_ptr<NamedPropCache>) noexcept;
+	const std::shared_ptr<NamedPropCache>& getNamedPropCache() const noexcept;
+
 private:
+	std::shared_ptr<FolderCache> folderCache; ///< Cache used for folder lookups (optional)
+	std::shared_ptr<NamedPropCache> namedPropCache; ///< Cache used to resolve named properties (optional)
+
+	uint64_t folderIdByName(const std::string&, uint64_t, const std::string&);
+	PropvalTable queryAndUnload(const std::string&, uint32_t, const Collection<uint16_t, uint32_t>&, uint32_t, uint32_t);
 	uint32_t setFolderMember(const std::string&, uint64_t, const FolderMemberList::Member&, uint32_t, PermissionMode);
 };
 
+using QueriesPool = ClientPool<ExmdbQueries>; ///< Pool of ExmdbQueries clients
+using QueriesRouter = ClientRouter<ExmdbQueries>; ///< Router distributing stores over ExmdbQueries pools
+
 }
 
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <array>
 #include <limits>
@@ -221,7 +222,7 @@ struct LoadTableResponse
 /**
  * @brief   Message content response
  *
- * Result of ReadMessageRequest or ReadMessageInstanceRequest
+ * Result of ReadMessageInstanceRequest
  */
 struct MessageContentResponse
 {
@@ -285,6 +286,96 @@ struct TableResponse
 	std::vector<std::vector<structures::TaggedPropval> > entries; ///< Returned rows of entries
 };
 
+/**
+ * @brief      Zero-copy table response
+ *
+ * Alternative to TableResponse that takes ownership of the received data.
+ * String and binary values reference the response buffer directly, other
+ * array values are allocated from an internal arena, so no per-value
+ * allocations are necessary.
+ *
+ * Values are only valid as long as the response object exists. They can be
+ * copied into owning TaggedPropvals with TaggedPropval::materialize() where
+ * they need to outlive the response.
+ *
+ * Can be obtained with ExmdbClient::sendRaw().
+ */
+class BorrowedTableResponse
+{
+public:
+	using Row = structures::TaggedPropval::VArray<const structures::TaggedPropval>; ///< Non-owning view of a table row
+
+	explicit BorrowedTableResponse(IOBuffer&&);
+	BorrowedTableResponse(BorrowedTableResponse&&) noexcept = default;
+	BorrowedTableResponse& operator=(BorrowedTableResponse&&) noexcept = default;
+
+	Row operator[](size_t) const;
+	size_t size() const noexcept;
+
+private:
+	IOBuffer buffer; ///< Received data referenced by the propvals
+	structures::Arena arena; ///< Storage for array values
+	std::vector<structures::TaggedPropval> propvals; ///< Propvals of all rows
+	std::vector<size_t> rows; ///< Offset of each row in propvals (plus end offset)
+};
+
+/**
+ * @brief      Column oriented table response
+ *
+ * Decodes the table into one contiguous column per requested tag:
+ *
+ * - Integer, boolean and time values are stored in `values`
+ * - Floating point values are stored as doubles in `values` (reinterpreted)
+ * - String and binary data is concatenated in `data`, with `offsets`
+ *   containing the start of each row (and the end of the last row)
+ * - Array values are stored as TaggedPropval in `propvals`
+ *
+ * Rows that do not contain a value for a column are marked in the presence
+ * bitmap of the column. Values with tags that do not match exactly (e.g.
+ * error values) are treated as missing.
+ */
+class ColumnarTableResponse
+{
+public:
+	/**
+	 * @brief      Values of a single tag
+	 */
+	struct Column
+	{
+		enum Kind : uint8_t
+		{
+			INTEGER, ///< Integer, boolean or time values
+			REAL, ///< Floating point values
+			BYTES, ///< String or binary values
+			GENERIC, ///< Array values
+		};
+
+		explicit Column(uint32_t);
+
+		bool present(size_t) const;
+		uint64_t value(size_t) const;
+		double real(size_t) const;
+		std::string_view bytes(size_t) const;
+		const char* str(size_t) const;
+		const structures::TaggedPropval& propval(size_t) const;
+
+		uint32_t tag; ///< Tag of the column
+		Kind kind; ///< Storage type of the column
+		std::vector<uint64_t> presence; ///< Bitmap of rows containing a value
+		std::vector<uint64_t> values; ///< Scalar values (INTEGER and REAL columns)
+		std::vector<char> data; ///< Concatenated data (BYTES columns)
+		std::vector<uint32_t> offsets; ///< Data offsets (BYTES columns)
+		std::vector<structures::TaggedPropval> propvals; ///< Values (GENERIC columns)
+	};
+
+	ColumnarTableResponse(IOBuffer&, const std::vector<uint32_t>&);
+
+	const Column* column(uint32_t) const;
+
+	size_t rows = 0; ///< Number of rows
+	std::vector<Column> columns; ///< Columns in order of the requested tags
+};
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
@@ -895,23 +986,26 @@ struct response_map<SetFolderPropertiesRequest::callId>
  * @brief   Read message
  *
  * Get contents of a message
- * *
+ *
  * @param   string      homedir
  * @param   string      username
+ * @param   uint32_t    cpid
  * @param   uint64_t    messageId
  *
  * @return  Response<ReadMessageRequest::callId>
  */
 struct ReadMessageRequest : public Request<constants::CallId::READ_MESSAGE,
-        uint32_t>
+        std::string, uint32_t, uint64_t>
 {};
 
-/**
- * Response type override for read message instance request (-> ContentResponse)
- */
 template<>
-struct response_map<ReadMessageRequest::callId>
-{using type = MessageContentResponse;};
+struct Response<ReadMessageRequest::callId>
+{
+	explicit Response(IOBuffer&);
+
+	bool found; ///< Whether the message exists
+	structures::MessageContent content; ///< Content of the message (empty if not found)
+};
 
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -925,11 +1019,7 @@ struct response_map<ReadMessageRequest::callId>
  * usage.
  *
  * @param   string      homedir
- * @param   string      username
- * @param   uint32_t    cpid
- * @param   bool        new
- * @param   uint64_t    folderId
- * @param   uint64_t    messageId
+ * @param   uint32_t    instanceId
  *
  * @return  Response<ReadMessageInstanceRequest::callId>
  */
@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <string>
 #include <array>
+#include <cstddef>
 #include <memory>
 #include <variant>
 #include <vector>
@@ -12,6 +13,52 @@
 namespace exmdbpp::structures
 {
 
+/**
+ * @brief      Bump allocator for short-lived deserialized data
+ *
+ * Memory is allocated from large blocks and only released when the arena is
+ * cleared or destroyed. Objects placed in the arena are never destructed, so
+ * only trivially destructible types should be stored.
+ */
+class Arena
+{
+public:
+	explicit Arena(size_t=4096) noexcept;
+	Arena(Arena&&) noexcept = default;
+	Arena& operator=(Arena&&) noexcept = default;
+
+	void* allocate(size_t, size_t=alignof(std::max_align_t));
+	template<typename T> T* allocate(size_t);
+
+	void clear() noexcept;
+
+private:
+	struct Block
+	{
+		std::unique_ptr<uint8_t[]> data; ///< Block memory
+		size_t size; ///< Size of the block in bytes
+	};
+
+	std::vector<Block> blocks; ///< Allocated memory blocks
+	size_t blockSize; ///< Minimum size of new blocks
+	size_t used = 0; ///< Number of bytes used in the last block
+};
+
+/**
+ * @brief      Allocate uninitialized memory for array of objects
+ *
+ * @param      count  Number of objects
+ *
+ * @tparam     T      Object type
+ *
+ * @return     Pointer to the first element
+ */
+template<typename T>
+inline T* Arena::allocate(size_t count)
+{return static_cast<T*>(allocate(count*sizeof(T), alignof(T)));}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 /**
  * @brief      Tagged property value
  */
@@ -36,6 +83,7 @@ public:
 
 	TaggedPropval() = default;
 	explicit TaggedPropval(IOBuffer&);
+	TaggedPropval(IOBuffer&, Arena&);
 	TaggedPropval(const TaggedPropval&);
 	TaggedPropval(TaggedPropval&&) noexcept;
 	~TaggedPropval();
@@ -59,6 +107,7 @@ public:
 	TaggedPropval& operator=(const TaggedPropval&);
 	TaggedPropval& operator=(TaggedPropval&&) noexcept;
 
+	TaggedPropval materialize() const;
 	std::string printValue() const;
 	std::string toString() const;
 	uint32_t binaryLength() const;
@@ -100,9 +149,11 @@ public:
 private:
 	bool owned = true; ///< Whether the memory stored in pointer values is owned (automatically deallocated in destructor)
 
+	void read(IOBuffer&, Arena*);
 	char* copyStr(const char*);
-	void copyValue(const TaggedPropval&);
-	void copyData(const void*, uint32_t, size_t=alignof(uint8_t));
+	char* copyStr(const char*, size_t);
+	void copyValue(const TaggedPropval&, bool=false);
+	void copyData(const void*, uint32_t);
 	void free();
 };
 
@@ -195,6 +246,13 @@ struct PropertyProblem
 
 /**
  * @brief      Restriction for filtered table loading
+ *
+ * Restrictions are immutable trees with reference counted nodes, copying a
+ * restriction or using it as sub-restriction does not copy the tree.
+ * Restrictions can therefore be shared between requests and threads.
+ *
+ * The serialized form is computed once on first serialization and reused
+ * afterwards.
  */
 class Restriction
 {
@@ -235,6 +293,7 @@ public:
 	constexpr Restriction() noexcept {} //should be '= default', workaround for g++/clang bug
 
 	void serialize(IOBuffer&) const;
+	const std::vector<uint8_t>& serialized() const;
 
 	operator bool() const;
 
@@ -256,121 +315,56 @@ private:
 		XNULL = 0xff,
 	};
 
-	template<typename T>
-	struct acu_ptr : public std::unique_ptr<T> //Auto-copy unique_ptr
-	{
-		using std::unique_ptr<T>::unique_ptr;
-		inline acu_ptr(const acu_ptr<T>& other) {if(other) this->reset(new T(*other));}
-		inline acu_ptr<T>& operator=(const acu_ptr<T>& other) {this->reset(other? new T(*other): nullptr); return *this;}
-	};
-
-
-	struct RChain
-	{
-		explicit RChain(std::vector<Restriction>&&);
-		std::vector<Restriction> elements;
-	};
-
-	struct RNot
-	{
-		explicit RNot(Restriction&&);
-		acu_ptr<Restriction> res;
-	};
-
-	struct RContent
-	{
-		RContent(uint32_t, uint32_t, TaggedPropval&&);
-		uint32_t fuzzyLevel;
-		uint32_t proptag;
-		TaggedPropval propval;
-	};
-
-	struct RProp
-	{
-		RProp(Op, uint32_t, TaggedPropval&&);
-		Op op;
-		uint32_t proptag;
-		TaggedPropval propval;
-	};
-
-	struct RPropComp
-	{
-		RPropComp(Op, uint32_t, uint32_t);
-		Op op;
-		uint32_t proptag1;
-		uint32_t proptag2;
-	};
-
-	struct RBitMask
-	{
-		RBitMask(bool, uint32_t, uint32_t);
-		bool all;
-		uint32_t proptag;
-		uint32_t mask;
-	};
-
-	struct RSize
-	{
-		RSize(Op, uint32_t, uint32_t);
-		Op op;
-		uint32_t proptag;
-		uint32_t size;
-	};
-
-	struct RExist
-	{
-		explicit RExist(uint32_t);
-		uint32_t proptag;
-	};
-
-	struct RSubObj
-	{
-		RSubObj(uint32_t, Restriction&&);
-		uint32_t subobject;
-		acu_ptr<Restriction> res;
-	};
-
-	struct RComment
-	{
-		explicit RComment(std::vector<TaggedPropval>&&, Restriction&&=Restriction::XNULL());
-		std::vector<TaggedPropval> propvals;
-		acu_ptr<Restriction> res;
-	};
-
-	struct RCount
-	{
-		RCount(uint32_t, Restriction&&);
-		uint32_t count;
-		acu_ptr<Restriction> subres;
-	};
-
-	///////////////////////////////////////////////////////////////////////////////
+	struct RChain;
+	struct RNot;
+	struct RContent;
+	struct RProp;
+	struct RPropComp;
+	struct RBitMask;
+	struct RSize;
+	struct RExist;
+	struct RSubObj;
+	struct RComment;
+	struct RCount;
+	struct Node;
 
 	template<Type I, typename... Args>
 	static Restriction create(Args&&...);
 
-	std::variant<RChain, RChain, RNot, RContent, RProp, RPropComp, RBitMask, RSize, RExist, RSubObj, RComment, RCount, std::monostate> res = std::monostate();
+	std::shared_ptr<const Node> node; ///< Immutable restriction tree (nullptr for NULL restriction)
 };
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * @brief      Complete content of a message
+ *
+ * Decoded from the responses of ReadMessageRequest and
+ * ReadMessageInstanceRequest. For large messages, MessageReader processes
+ * the same format incrementally from a response stream.
+ */
 struct MessageContent
 {
+	/**
+	 * @brief      Content of a single attachment
+	 */
 	struct AttachmentContent
 	{
 		AttachmentContent() = default;
-		explicit AttachmentContent(IOBuffer&);
+		explicit AttachmentContent(IOBuffer&, unsigned=0);
 
-		std::vector<TaggedPropval> propvals;
-		std::unique_ptr<MessageContent> embedded;
+		std::vector<TaggedPropval> propvals; ///< Attachment properties
+		std::unique_ptr<MessageContent> embedded; ///< Embedded message (or nullptr)
 	};
 
 	MessageContent() = default;
-	explicit MessageContent(IOBuffer&);
+	explicit MessageContent(IOBuffer&, unsigned=0);
 
-	std::vector<TaggedPropval> propvals;
-	std::vector<std::vector<TaggedPropval>> recipients;
-	std::vector<AttachmentContent> attachments;
+	static constexpr unsigned MAX_DEPTH = 64; ///< Maximum nesting level of embedded messages
+
+	std::vector<TaggedPropval> propvals; ///< Message properties
+	std::vector<std::vector<TaggedPropval>> recipients; ///< Properties of each recipient
+	std::vector<AttachmentContent> attachments; ///< Attachments
 };
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
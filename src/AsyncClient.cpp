@@ -0,0 +1,644 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * SPDX-FileCopyrightText: 2020-2021 grommunio GmbH
+ */
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "AsyncClient.h"
+#include "IOBufferImpl.h"
+#include "constants.h"
+
+namespace exmdbpp
+{
+
+using namespace constants;
+using namespace requests;
+
+static const size_t readSize = 65536; ///< Number of bytes to read at once
+static const int maxEvents = 64; ///< Maximum number of events to process per epoll_wait call
+
+/**
+ * @brief      Initialize client and connect to server
+ *
+ * Waits until all connections are established and the handshake completed.
+ *
+ * If the host is an absolute path, UNIX domain socket connections to this
+ * path are established instead and the port is ignored.
+ *
+ * @param      host         Server address or socket path
+ * @param      port         Server port
+ * @param      prefix       Data area prefix (passed to ConnectRequest)
+ * @param      isPrivate    Whether to access private or public data (passed to ConnectRequest)
+ * @param      connections  Number of connections to use
+ *
+ * @throws     std::invalid_argument  Number of connections is zero
+ * @throws     ConnectionError        Connection could not be established
+ * @throws     ExmdbProtocolError     Server rejected the connection
+ */
+AsyncClient::AsyncClient(const std::string& host, const std::string& port, const std::string& prefix, bool isPrivate,
+                         size_t connections) : host(host), port(port), prefix(prefix), isPrivate(isPrivate)
+{
+	if(!connections)
+		throw std::invalid_argument("At least one connection is required");
+	resolve();
+	if((epfd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+		throw ConnectionError("Failed to create epoll instance: "+std::string(strerror(errno)));
+	channels.resize(connections);
+	try
+	{
+		for(Channel& channel : channels)
+			open(channel);
+		auto establishing = [](const Channel& channel)
+		{return channel.sock != -1 && (channel.connecting || channel.handshake);};
+		while(std::any_of(channels.begin(), channels.end(), establishing))
+			process(-1);
+		for(Channel& channel : channels)
+			if(channel.sock == -1)
+				std::rethrow_exception(channel.error);
+	}
+	catch(...)
+	{
+		for(Channel& channel : channels)
+			if(channel.sock != -1)
+				::close(channel.sock);
+		::close(epfd);
+		throw;
+	}
+}
+
+/**
+ * @brief      Destructor
+ *
+ * Closes all connections. Callbacks of pending requests are not invoked,
+ * futures of pending requests report a broken promise.
+ */
+AsyncClient::~AsyncClient()
+{
+	for(Channel& channel : channels)
+		if(channel.sock != -1)
+			::close(channel.sock);
+	::close(epfd);
+}
+
+/**
+ * @brief      Wait for events and process them
+ *
+ * Sends pending requests, advances connections being established and
+ * invokes the callbacks of all requests that completed. Requests exceeding
+ * their deadline are failed before and after waiting.
+ *
+ * Callbacks must not throw exceptions.
+ *
+ * @param      timeout  Maximum time to wait in milliseconds (-1 to wait indefinitely)
+ *
+ * @return     Number of requests completed
+ */
+size_t AsyncClient::process(int timeout)
+{
+	epoll_event events[maxEvents];
+	size_t completed = expire();
+	int count = epoll_wait(epfd, events, maxEvents, completed? 0 : waitTime(timeout));
+	if(count < 0)
+	{
+		if(errno == EINTR)
+			return completed;
+		throw ConnectionError("Failed to wait for events: "+std::string(strerror(errno)));
+	}
+	for(int i = 0; i < count; ++i)
+	{
+		Channel& channel = *static_cast<Channel*>(events[i].data.ptr);
+		if(channel.sock != -1 && channel.connecting)
+		{
+			if(events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+				connected(channel);
+			continue;
+		}
+		if(channel.sock != -1 && events[i].events & EPOLLOUT)
+			flush(channel);
+		if(channel.sock != -1 && events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+			completed += receive(channel);
+	}
+	return completed+expire();
+}
+
+/**
+ * @brief      Process events until all requests completed
+ */
+void AsyncClient::run()
+{
+	while(calls)
+		process(-1);
+}
+
+/**
+ * @brief      Return file descriptor for event loop integration
+ *
+ * The descriptor becomes readable when events are available for process().
+ *
+ * While a connection is being established, process() must additionally be
+ * called once the connect timeout has passed for the attempt to fail.
+ *
+ * @return     epoll file descriptor
+ */
+int AsyncClient::fd() const noexcept
+{return epfd;}
+
+/**
+ * @brief      Return number of requests waiting for a response
+ */
+size_t AsyncClient::pending() const noexcept
+{return calls;}
+
+/**
+ * @brief      Return time until the next timeout
+ *
+ * When integrating the client into an external event loop, process() must
+ * be called after this time even if fd() did not become readable.
+ *
+ * @return     Time in milliseconds or -1 if no timeout is pending
+ */
+int AsyncClient::timeout() const
+{return waitTime(-1);}
+
+/**
+ * @brief      Set timeout for establishing connections
+ *
+ * @param      limit  Maximum time to wait per address (default 3000 ms)
+ */
+void AsyncClient::setConnectTimeout(std::chrono::milliseconds limit) noexcept
+{connectTimeout = limit;}
+
+/**
+ * @brief      Set timeout for each request
+ *
+ * Applies to requests submitted afterwards and limits the time until the
+ * response is received, including time spent reconnecting.
+ *
+ * @param      limit  Maximum duration of a request (0 for unlimited)
+ */
+void AsyncClient::setTimeout(std::chrono::milliseconds limit) noexcept
+{requestTimeout = limit;}
+
+/**
+ * @brief      Set deadline for all following requests
+ *
+ * Requests not completed by the deadline fail with TimeoutError. If a
+ * request timeout is set as well, the earlier of both applies.
+ *
+ * @param      until  Time at which requests fail
+ */
+void AsyncClient::setDeadline(std::chrono::steady_clock::time_point until) noexcept
+{deadline = until;}
+
+/**
+ * @brief      Remove deadline set with setDeadline()
+ */
+void AsyncClient::clearDeadline() noexcept
+{deadline = Clock::time_point::max();}
+
+/**
+ * @brief      Order timers by deadline
+ */
+bool AsyncClient::Timer::operator>(const Timer& other) const noexcept
+{return deadline > other.deadline;}
+
+/**
+ * @brief      Resolve server addresses
+ *
+ * Addresses are only resolved once, so reconnecting does not block on name
+ * resolution.
+ *
+ * @throws     ConnectionError  Address could not be resolved
+ */
+void AsyncClient::resolve()
+{
+	if(!host.empty() && host[0] == '/')
+	{
+		Address address{AF_UNIX, {}, sizeof(sockaddr_un)};
+		sockaddr_un& addr = reinterpret_cast<sockaddr_un&>(address.addr);
+		if(host.size() >= sizeof(addr.sun_path))
+			throw ConnectionError("Connect failed: socket path too long");
+		addr.sun_family = AF_UNIX;
+		memcpy(addr.sun_path, host.c_str(), host.size()+1);
+		addresses.emplace_back(address);
+		return;
+	}
+	addrinfo hint{}, *addrs;
+	hint.ai_socktype = SOCK_STREAM;
+	int error = getaddrinfo(host.c_str(), port.c_str(), &hint, &addrs);
+	if(error)
+		throw ConnectionError("Could not resolve address: "+std::string(gai_strerror(error)));
+	for(addrinfo* addr = addrs; addr != nullptr; addr = addr->ai_next)
+	{
+		Address address{addr->ai_family, {}, addr->ai_addrlen};
+		memcpy(&address.addr, addr->ai_addr, addr->ai_addrlen);
+		addresses.emplace_back(address);
+	}
+	freeaddrinfo(addrs);
+	if(addresses.empty())
+		throw ConnectionError("Could not resolve address: no addresses found");
+}
+
+/**
+ * @brief      Start establishing connection
+ *
+ * The ConnectRequest is queued as first request of the channel, so
+ * requests can be submitted immediately. The connection and handshake are
+ * completed by process().
+ *
+ * @param      channel  Channel to connect
+ *
+ * @throws     ConnectionError  No connection attempt could be started
+ */
+void AsyncClient::open(Channel& channel)
+{
+	channel.writing = false;
+	channel.out.clear();
+	channel.sent = 0;
+	channel.in.clear();
+	channel.consumed = 0;
+	channel.address = 0;
+	ExmdbClient::writeFramed<ConnectRequest>(channel.out, prefix, isPrivate);
+	channel.handshake = true;
+	connect(channel);
+	if(channel.sock == -1)
+		std::rethrow_exception(channel.error);
+}
+
+/**
+ * @brief      Start non-blocking connect to the current address
+ *
+ * Addresses that fail immediately are skipped. If no address is left, the
+ * channel is closed.
+ *
+ * @param      channel  Channel to connect
+ */
+void AsyncClient::connect(Channel& channel)
+{
+	std::string error = "no address left";
+	for(; channel.address < addresses.size(); ++channel.address)
+	{
+		const Address& address = addresses[channel.address];
+		int sock = socket(address.family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if(sock == -1)
+		{
+			error = strerror(errno);
+			continue;
+		}
+		if(::connect(sock, reinterpret_cast<const sockaddr*>(&address.addr), address.length) == -1 && errno != EINPROGRESS)
+		{
+			error = strerror(errno);
+			::close(sock);
+			continue;
+		}
+		epoll_event event{};
+		event.events = EPOLLOUT;
+		event.data.ptr = &channel;
+		if(epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &event) == -1)
+		{
+			error = strerror(errno);
+			::close(sock);
+			continue;
+		}
+		channel.sock = sock;
+		channel.connecting = channel.writing = true;
+		channel.connectDeadline = Clock::now()+connectTimeout;
+		return;
+	}
+	close(channel, std::make_exception_ptr(ConnectionError("Connect failed: "+error)));
+}
+
+/**
+ * @brief      Complete connection after the socket became writable
+ *
+ * Sends the handshake and all requests submitted in the meantime.
+ *
+ * @param      channel  Channel being connected
+ */
+void AsyncClient::connected(Channel& channel)
+{
+	int error = 0;
+	socklen_t length = sizeof(error);
+	if(getsockopt(channel.sock, SOL_SOCKET, SO_ERROR, &error, &length) == -1)
+		error = errno;
+	if(error)
+		return retry(channel, strerror(error));
+	channel.connecting = false;
+	if(addresses[channel.address].family != AF_UNIX)
+	{
+		int noDelay = 1;
+		setsockopt(channel.sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+	}
+	flush(channel);
+}
+
+/**
+ * @brief      Abort current connection attempt and try the next address
+ *
+ * @param      channel  Channel being connected
+ * @param      error    Reason of the failure
+ */
+void AsyncClient::retry(Channel& channel, const std::string& error)
+{
+	::close(channel.sock);
+	channel.sock = -1;
+	if(++channel.address < addresses.size())
+		connect(channel);
+	else
+		close(channel, std::make_exception_ptr(ConnectionError("Connect failed: "+error)));
+}
+
+/**
+ * @brief      Close connection and fail all pending requests
+ *
+ * The connection is re-established when the next request is submitted.
+ *
+ * @param      channel  Channel to close
+ * @param      err      Error to report to pending requests
+ */
+void AsyncClient::close(Channel& channel, const std::exception_ptr& err)
+{
+	if(channel.sock != -1)
+		::close(channel.sock);
+	channel.sock = -1;
+	channel.writing = channel.connecting = channel.handshake = false;
+	channel.out.clear();
+	channel.sent = 0;
+	channel.in.clear();
+	channel.consumed = 0;
+	channel.error = err;
+	std::deque<Handler> failed;
+	failed.swap(channel.calls);
+	calls -= failed.size();
+	channel.completed += failed.size();
+	for(Handler& handler : failed)
+		handler(nullptr, err);
+}
+
+/**
+ * @brief      Register handler for the last serialized request
+ *
+ * Starts the timer of the request if a timeout or deadline is set and
+ * tries to send the request immediately.
+ *
+ * @param      channel  Channel that the request was serialized to
+ * @param      handler  Completion handler
+ */
+void AsyncClient::enqueue(Channel& channel, Handler&& handler)
+{
+	channel.calls.emplace_back(std::move(handler));
+	++calls;
+	Clock::time_point until = deadline;
+	if(requestTimeout.count() > 0)
+		until = std::min(until, Clock::now()+requestTimeout);
+	if(until != Clock::time_point::max())
+		timers.push(Timer{until, size_t(&channel-channels.data()), channel.submitted});
+	++channel.submitted;
+	flush(channel);
+}
+
+/**
+ * @brief      Send as much buffered data as possible without blocking
+ *
+ * Data is kept buffered while the connection is being established.
+ *
+ * @param      channel  Channel to send data of
+ */
+void AsyncClient::flush(Channel& channel)
+{
+	if(channel.connecting)
+		return;
+	while(channel.sent < channel.out.size())
+	{
+		ssize_t bytes = ::send(channel.sock, channel.out.data()+channel.sent, channel.out.size()-channel.sent, MSG_NOSIGNAL);
+		if(bytes < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return close(channel, std::make_exception_ptr(ConnectionError("Send failed: "+std::string(strerror(errno)))));
+		}
+		channel.sent += size_t(bytes);
+	}
+	if(channel.sent == channel.out.size())
+	{
+		channel.out.clear();
+		channel.sent = 0;
+	}
+	updateEvents(channel);
+}
+
+/**
+ * @brief      Read available data and dispatch complete responses
+ *
+ * Responses are located by advancing a read offset, the processed data is
+ * removed from the receive buffer once after all complete responses were
+ * dispatched.
+ *
+ * @param      channel  Channel to read from
+ *
+ * @return     Number of requests completed
+ */
+size_t AsyncClient::receive(Channel& channel)
+{
+	for(;;)
+	{
+		size_t offset = channel.in.size();
+		channel.in.resize(offset+readSize);
+		ssize_t bytes = recv(channel.sock, channel.in.data()+offset, readSize, 0);
+		channel.in.resize(offset+(bytes > 0? size_t(bytes) : 0));
+		if(bytes < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			close(channel, std::make_exception_ptr(ConnectionError("Receive failed: "+std::string(strerror(errno)))));
+			return 0;
+		}
+		if(bytes == 0)
+		{
+			close(channel, std::make_exception_ptr(ConnectionError("Connection closed unexpectedly")));
+			return 0;
+		}
+		if(size_t(bytes) < readSize)
+			break;
+	}
+	size_t completed = 0;
+	while(channel.sock != -1 && channel.consumed < channel.in.size())
+	{
+		const uint8_t* data = channel.in.data()+channel.consumed;
+		size_t available = channel.in.size()-channel.consumed, total = 1;
+		uint8_t status = data[0];
+		if(status == ResponseCode::SUCCESS)
+		{
+			uint32_t length;
+			if(available < 5)
+				break;
+			memcpy(&length, data+1, sizeof(length));
+			total += sizeof(length)+le32toh(length);
+			if(available < total)
+				break;
+		}
+		if(channel.handshake)
+		{
+			channel.handshake = false;
+			channel.consumed += total;
+			if(status != ResponseCode::SUCCESS)
+				close(channel, std::make_exception_ptr(ExmdbProtocolError("Connect failed: ", status)));
+			continue;
+		}
+		if(channel.calls.empty())
+		{
+			close(channel, std::make_exception_ptr(ConnectionError("Received unexpected response")));
+			break;
+		}
+		Handler handler = std::move(channel.calls.front());
+		channel.calls.pop_front();
+		--calls;
+		++channel.completed;
+		++completed;
+		if(status != ResponseCode::SUCCESS)
+		{
+			++channel.consumed;
+			handler(nullptr, std::make_exception_ptr(ExmdbProtocolError("exmdb call failed: ", status)));
+			continue;
+		}
+		IOBuffer response;
+		if(!channel.consumed && total == channel.in.size())
+		{
+			std::swap(response, channel.in);
+			response.pop_raw(5);
+		}
+		else
+		{
+			response.assign(data+5, data+total);
+			channel.consumed += total;
+		}
+		handler(&response, nullptr);
+	}
+	if(channel.sock == -1)
+		return completed;
+	if(channel.consumed == channel.in.size())
+		channel.in.clear();
+	else if(channel.consumed)
+	{
+		size_t left = channel.in.size()-channel.consumed;
+		memmove(channel.in.data(), channel.in.data()+channel.consumed, left);
+		channel.in.resize(left);
+	}
+	channel.consumed = 0;
+	return completed;
+}
+
+/**
+ * @brief      Update epoll event mask
+ *
+ * Write events are only requested while connecting or while there is data
+ * to send.
+ *
+ * @param      channel  Channel to update
+ */
+void AsyncClient::updateEvents(Channel& channel)
+{
+	bool writing = channel.connecting || !channel.out.empty();
+	if(writing == channel.writing)
+		return;
+	epoll_event event{};
+	event.events = EPOLLIN | (writing? uint32_t(EPOLLOUT) : 0u);
+	event.data.ptr = &channel;
+	if(epoll_ctl(epfd, EPOLL_CTL_MOD, channel.sock, &event) == -1)
+		return close(channel, std::make_exception_ptr(ConnectionError("Failed to update events: "+std::string(strerror(errno)))));
+	channel.writing = writing;
+}
+
+/**
+ * @brief      Fail connection attempts and requests that exceeded their timeout
+ *
+ * A request exceeding its deadline closes its channel, as the responses of
+ * later requests cannot be received before its own.
+ *
+ * Timers of completed requests are discarded as soon as they reach the top
+ * of the heap.
+ *
+ * @return     Number of requests failed
+ */
+size_t AsyncClient::expire()
+{
+	size_t failed = calls;
+	Clock::time_point now = Clock::now();
+	for(Channel& channel : channels)
+		if(channel.sock != -1 && channel.connecting && channel.connectDeadline <= now)
+			retry(channel, "connection timeout");
+	while(!timers.empty() && timers.top().deadline <= now)
+	{
+		Timer timer = timers.top();
+		timers.pop();
+		Channel& channel = channels[timer.channel];
+		if(timer.call >= channel.completed)
+			close(channel, std::make_exception_ptr(TimeoutError("Request timed out")));
+	}
+	while(!timers.empty() && timers.top().call < channels[timers.top().channel].completed)
+		timers.pop();
+	return failed-calls;
+}
+
+/**
+ * @brief      Limit wait time to the next pending timeout
+ *
+ * @param      timeout  Requested maximum wait time in milliseconds (-1 for no limit)
+ *
+ * @return     Time to wait in milliseconds (-1 for no limit)
+ */
+int AsyncClient::waitTime(int timeout) const
+{
+	Clock::time_point now = Clock::now();
+	auto limit = [&](Clock::time_point until)
+	{
+		auto left = std::chrono::ceil<std::chrono::milliseconds>(until-now).count();
+		int ms = int(std::clamp<int64_t>(left, 0, INT_MAX));
+		timeout = timeout < 0? ms : std::min(timeout, ms);
+	};
+	for(const Channel& channel : channels)
+		if(channel.sock != -1 && channel.connecting)
+			limit(channel.connectDeadline);
+	if(!timers.empty())
+		limit(timers.top().deadline);
+	return timeout;
+}
+
+/**
+ * @brief      Select channel for the next request
+ *
+ * Chooses the channel with the fewest pending requests, starting to
+ * reconnect it if necessary. Reconnecting does not block, requests are sent
+ * once the connection is established.
+ *
+ * @throws     ConnectionError  No connection attempt could be started
+ *
+ * @return     Selected channel
+ */
+AsyncClient::Channel& AsyncClient::select()
+{
+	Channel* best = &channels.front();
+	for(Channel& channel : channels)
+		if(channel.calls.size() < best->calls.size() || (best->sock == -1 && channel.sock != -1))
+			best = &channel;
+	if(best->sock == -1)
+		open(*best);
+	return *best;
+}
+
+}
@@ -0,0 +1,21 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * SPDX-FileCopyrightText: 2020-2021 grommunio GmbH
+ */
+#include "BatchExecutor.h"
+
+namespace exmdbpp::queries
+{
+
+/**
+ * @brief      Initialize executor
+ *
+ * The router must outlive the executor.
+ *
+ * @param      router   Router to lease clients from
+ * @param      threads  Maximum number of worker threads (0 to use one thread per connection of the router)
+ */
+BatchExecutor::BatchExecutor(QueriesRouter& router, size_t threads) : router(router), threads(threads)
+{}
+
+}
@@ -0,0 +1,72 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * SPDX-FileCopyrightText: 2020-2021 grommunio GmbH
+ */
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "CancellationToken.h"
+#include "exceptions.h"
+
+namespace exmdbpp
+{
+
+/**
+ * @brief      Create token in non-cancelled state
+ *
+ * @throws     ConnectionError  Event descriptor could not be created
+ */
+CancellationToken::CancellationToken()
+{
+	if((event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1)
+		throw ConnectionError("Failed to create eventfd: "+std::string(strerror(errno)));
+}
+
+/**
+ * @brief      Destructor
+ */
+CancellationToken::~CancellationToken()
+{::close(event);}
+
+/**
+ * @brief      Cancel requests using the token
+ *
+ * Wakes up all clients currently waiting for the server.
+ */
+void CancellationToken::cancel() noexcept
+{
+	if(flag.exchange(true))
+		return;
+	uint64_t value = 1;
+	[[maybe_unused]] ssize_t res = write(event, &value, sizeof(value));
+}
+
+/**
+ * @brief      Reset token to non-cancelled state
+ *
+ * Should only be called when no request using the token is in progress.
+ */
+void CancellationToken::reset() noexcept
+{
+	uint64_t value;
+	[[maybe_unused]] ssize_t res = read(event, &value, sizeof(value));
+	flag = false;
+}
+
+/**
+ * @brief      Check whether the token was cancelled
+ */
+bool CancellationToken::cancelled() const noexcept
+{return flag.load(std::memory_order_relaxed);}
+
+/**
+ * @brief      Return file descriptor that becomes readable on cancellation
+ */
+int CancellationToken::fd() const noexcept
+{return event;}
+
+}
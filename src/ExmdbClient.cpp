@@ -4,11 +4,19 @@
  */
 #include "ExmdbClient.h"
 #include "IOBufferImpl.h"
+#include <cerrno>
+#include <cstring>
 #include <cstdint>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <climits>
+#include <algorithm>
 #include <netdb.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <poll.h>
@@ -109,20 +117,49 @@ void ExmdbClient::Connection::close()
 	sock = -1;
 }
 
+/**
+ * @brief      Check whether the socket is open
+ *
+ * @return     true if the socket is open, false otherwise
+ */
+bool ExmdbClient::Connection::connected() const noexcept
+{return sock != -1;}
+
+/**
+ * @brief      Release ownership of the socket
+ *
+ * The connection is left in closed state, the caller is responsible for
+ * closing the returned socket.
+ *
+ * @return     Socket file descriptor (or -1 if not connected)
+ */
+int ExmdbClient::Connection::release() noexcept
+{
+	int fd = sock;
+	sock = -1;
+	return fd;
+}
+
 /**
  * @brief      Connect to server
  *
  * Establishes a TCP connection to the specified server.
  *
- * @param      host  Server address
- * @param      port  Server port or service
+ * If the host is an absolute path, a UNIX domain socket connection to this
+ * path is established instead and the port is ignored.
+ *
+ * @param      host     Server address or socket path
+ * @param      port     Server port or service
+ * @param      timeout  Maximum time to wait for each address
  *
  * @throws     ConnectionError   Connection could not be established
  */
-void ExmdbClient::Connection::connect(const std::string& host, const std::string& port)
+void ExmdbClient::Connection::connect(const std::string& host, const std::string& port, std::chrono::milliseconds timeout)
 {
 	if(sock != -1)
 		close();
+	if(!host.empty() && host[0] == '/')
+		return connectUnix(host);
 	addrinfo* addrs;
 	pollfd fd;
 	fd.events = POLLOUT;
@@ -143,7 +180,7 @@ void ExmdbClient::Connection::connect(const std::string& host, const std::string
 		fcntl(sock, F_SETFL, flags | O_NONBLOCK);
 		::connect(sock, addr->ai_addr, addr->ai_addrlen);
 		fd.fd = sock;
-		res = poll(&fd, 1, 3000);
+		res = poll(&fd, 1, int(std::min<int64_t>(timeout.count(), INT_MAX)));
 		if(res == 1)
 			break;
 		error = errno;
@@ -158,6 +195,150 @@ void ExmdbClient::Connection::connect(const std::string& host, const std::string
 	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) & ~O_NONBLOCK);
 }
 
+/**
+ * @brief      Connect to UNIX domain socket
+ *
+ * @param      path  Path of the socket
+ *
+ * @throws     ConnectionError   Connection could not be established
+ */
+void ExmdbClient::Connection::connectUnix(const std::string& path)
+{
+	sockaddr_un addr{};
+	if(path.size() >= sizeof(addr.sun_path))
+		throw ConnectionError("Connect failed: socket path too long");
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path.c_str(), path.size()+1);
+	if((sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1)
+		throw ConnectionError("Connect failed: "+std::string(strerror(errno)));
+	if(::connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1)
+	{
+		int error = errno;
+		close();
+		throw ConnectionError("Connect failed: "+std::string(strerror(error)));
+	}
+}
+
+/**
+ * @brief      Apply socket options
+ *
+ * TCP specific options are skipped for UNIX domain sockets.
+ *
+ * @param      opts  Options to apply
+ *
+ * @throws     ConnectionError   Setting an option failed
+ */
+void ExmdbClient::Connection::configure(const SocketOptions& opts)
+{
+	if(sock == -1)
+		return;
+	auto set = [this](int level, int name, int value)
+	{
+		if(setsockopt(sock, level, name, &value, sizeof(value)) == -1)
+			throw ConnectionError("Failed to set socket option: "+std::string(strerror(errno)));
+	};
+	int domain = AF_UNSPEC;
+	socklen_t length = sizeof(domain);
+	getsockopt(sock, SOL_SOCKET, SO_DOMAIN, &domain, &length);
+	if(domain == AF_INET || domain == AF_INET6)
+	{
+		set(IPPROTO_TCP, TCP_NODELAY, opts.noDelay);
+		set(SOL_SOCKET, SO_KEEPALIVE, opts.keepAlive);
+		if(opts.keepAlive)
+		{
+			set(IPPROTO_TCP, TCP_KEEPIDLE, int(opts.keepIdle.count()));
+			set(IPPROTO_TCP, TCP_KEEPINTVL, int(opts.keepInterval.count()));
+			set(IPPROTO_TCP, TCP_KEEPCNT, opts.keepCount);
+		}
+	}
+	if(opts.sendBuffer > 0)
+		set(SOL_SOCKET, SO_SNDBUF, opts.sendBuffer);
+	if(opts.receiveBuffer > 0)
+		set(SOL_SOCKET, SO_RCVBUF, opts.receiveBuffer);
+}
+
+/**
+ * @brief      Check whether the peer is still reachable
+ *
+ * Inspects the socket without blocking. An idle connection is expected to
+ * have no pending data, so a closed connection, a socket error (e.g. from
+ * failed keepalive probes) or unexpected data all mark it as dead.
+ *
+ * Dead connections are closed.
+ *
+ * @return     true if the connection is usable, false otherwise
+ */
+bool ExmdbClient::Connection::alive()
+{
+	if(sock == -1)
+		return false;
+	uint8_t byte;
+	ssize_t bytes;
+	while((bytes = recv(sock, &byte, 1, MSG_PEEK | MSG_DONTWAIT)) < 0 && errno == EINTR);
+	if(bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return true;
+	close();
+	return false;
+}
+
+/**
+ * @brief      Set limits for subsequent blocking operations
+ *
+ * If a deadline or token is set, socket operations do not block beyond the
+ * deadline and are aborted when the token is cancelled.
+ *
+ * @param      until   Time at which operations fail with TimeoutError (time_point::max() for no limit)
+ * @param      cancel  Token aborting operations with CancelledError or nullptr
+ */
+void ExmdbClient::Connection::arm(Clock::time_point until, const CancellationToken* cancel) noexcept
+{
+	deadline = until;
+	token = cancel;
+}
+
+/**
+ * @brief      Return flags for socket operations
+ *
+ * Operations are non-blocking if a deadline or cancellation token is set, so
+ * wait() can be used to enforce them.
+ */
+int ExmdbClient::Connection::ioFlags() const noexcept
+{return token || deadline != Clock::time_point::max()? MSG_DONTWAIT : 0;}
+
+/**
+ * @brief      Wait until the socket is ready
+ *
+ * @param      events  Events to wait for (POLLIN and/or POLLOUT)
+ *
+ * @throws     TimeoutError     Deadline passed
+ * @throws     CancelledError   Token was cancelled
+ * @throws     ConnectionError  Polling failed
+ *
+ * @return     Events reported for the socket
+ */
+short ExmdbClient::Connection::wait(short events)
+{
+	pollfd fds[2] = {{sock, events, 0}, {token? token->fd() : -1, POLLIN, 0}};
+	for(;;)
+	{
+		if(token && token->cancelled())
+			throw CancelledError("Request cancelled");
+		int timeout = -1;
+		if(deadline != Clock::time_point::max())
+		{
+			auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline-Clock::now()).count();
+			if(left <= 0)
+				throw TimeoutError("Request timed out");
+			timeout = int(std::min<int64_t>(left, INT_MAX));
+		}
+		int res = poll(fds, 2, timeout);
+		if(res < 0 && errno != EINTR)
+			throw ConnectionError("Poll failed: "+std::string(strerror(errno)));
+		if(res > 0 && fds[0].revents)
+			return fds[0].revents;
+	}
+}
+
 /**
  * @brief      Send request
  *
@@ -170,30 +351,253 @@ void ExmdbClient::Connection::connect(const std::string& host, const std::string
  */
 void ExmdbClient::Connection::send(IOBuffer& buff)
 {
-	ssize_t bytes = ::send(sock, buff.data(), buff.size(), MSG_NOSIGNAL);
-	if(bytes < 0)
-		throw ConnectionError("Send failed: "+std::string(strerror(errno)));
-	buff.resize(5);
-	bytes = recv(sock, buff.data(), 5, 0);
-	if(bytes < 0)
-		throw ConnectionError("Receive failed: "+std::string(strerror(errno)));
-	else if(bytes == 0)
-		throw ConnectionError("Connection closed unexpectedly");
-	uint8_t status = buff.pop<uint8_t>();
+	transmit(buff);
+	receive(buff);
+}
+
+/**
+ * @brief      Send data to the server
+ *
+ * Blocks until the whole buffer was written to the socket.
+ *
+ * If the buffer contains references, the data is transmitted with a
+ * single scatter-gather operation per batch of segments instead.
+ *
+ * @param      buff  Buffer containing the data to send
+ *
+ * @throws     ConnectionError   Sending failed
+ */
+void ExmdbClient::Connection::transmit(const IOBuffer& buff)
+{
+	if(!buff.references().empty())
+	{
+		std::vector<iovec> segments;
+		segments.reserve(2*buff.references().size()+1);
+		size_t offset = 0;
+		for(const IOBuffer::Reference& ref : buff.references())
+		{
+			if(ref.offset > offset)
+				segments.emplace_back(iovec{const_cast<uint8_t*>(buff.data())+offset, ref.offset-offset});
+			segments.emplace_back(iovec{const_cast<uint8_t*>(ref.data), ref.length});
+			offset = ref.offset;
+		}
+		if(offset < buff.size())
+			segments.emplace_back(iovec{const_cast<uint8_t*>(buff.data())+offset, buff.size()-offset});
+		return transmit(segments);
+	}
+	for(size_t offset = 0; offset < buff.size();)
+	{
+		ssize_t bytes = ::send(sock, buff.data()+offset, buff.size()-offset, MSG_NOSIGNAL | ioFlags());
+		if(bytes < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				wait(POLLOUT);
+				continue;
+			}
+			throw ConnectionError("Send failed: "+std::string(strerror(errno)));
+		}
+		offset += size_t(bytes);
+	}
+}
+
+/**
+ * @brief      Send list of data segments to the server
+ *
+ * Blocks until all segments were written to the socket. Partial writes are
+ * resumed at the first unsent byte.
+ *
+ * @param      segments  Segments to send (modified during transmission)
+ *
+ * @throws     ConnectionError   Sending failed
+ */
+void ExmdbClient::Connection::transmit(std::vector<iovec>& segments)
+{
+	size_t first = 0;
+	while(first < segments.size())
+	{
+		if(!segments[first].iov_len)
+		{
+			++first;
+			continue;
+		}
+		msghdr msg{};
+		msg.msg_iov = segments.data()+first;
+		msg.msg_iovlen = std::min<size_t>(segments.size()-first, IOV_MAX);
+		ssize_t bytes = sendmsg(sock, &msg, MSG_NOSIGNAL | ioFlags());
+		if(bytes < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				wait(POLLOUT);
+				continue;
+			}
+			throw ConnectionError("Send failed: "+std::string(strerror(errno)));
+		}
+		for(size_t sent = size_t(bytes); sent;)
+		{
+			iovec& segment = segments[first];
+			size_t consumed = std::min(sent, segment.iov_len);
+			segment.iov_base = static_cast<uint8_t*>(segment.iov_base)+consumed;
+			segment.iov_len -= consumed;
+			sent -= consumed;
+			if(!segment.iov_len)
+				++first;
+		}
+	}
+}
+
+/**
+ * @brief      Receive a single response
+ *
+ * The response code and length are inspected and the response (excluding
+ * status code and length) is written into the buffer.
+ *
+ * If the server reports an error, only the status code is consumed, leaving
+ * the connection ready to receive the next response.
+ *
+ * @param      buff  Buffer to write received data to
+ *
+ * @throws     ExmdbProtocolError  Server returned an error code
+ * @throws     ConnectionError     Receiving failed
+ */
+void ExmdbClient::Connection::receive(IOBuffer& buff)
+{
+	uint32_t length = receiveHeader();
+	buff.clear();
+	buff.resize(length);
+	recvAll(buff.data(), length);
+}
+
+/**
+ * @brief      Receive status code and length of a response
+ *
+ * The response data must be consumed with receiveSome() before the next
+ * response can be received.
+ *
+ * @throws     ExmdbProtocolError  Server returned an error code
+ * @throws     ConnectionError     Receiving failed
+ *
+ * @return     Length of the response data
+ */
+uint32_t ExmdbClient::Connection::receiveHeader()
+{
+	uint8_t status;
+	uint32_t length;
+	recvAll(&status, sizeof(status));
 	if(status != ResponseCode::SUCCESS)
 		throw ExmdbProtocolError("exmdb call failed: ", status);
-	if(bytes < 5)
-		throw ConnectionError("Short read");
-	uint32_t length = buff.pop<uint32_t>();
-	buff.reset();
-	buff.resize(length);
-	for(uint32_t offset = 0;offset < length;offset += bytes)
+	recvAll(&length, sizeof(length));
+	return le32toh(length);
+}
+
+/**
+ * @brief      Read at most the specified number of bytes
+ *
+ * Blocks until at least one byte is available.
+ *
+ * @param      data    Destination buffer
+ * @param      length  Maximum number of bytes to read
+ *
+ * @throws     ConnectionError   Reading failed or connection was closed
+ *
+ * @return     Number of bytes read
+ */
+size_t ExmdbClient::Connection::receiveSome(void* data, size_t length)
+{
+	for(;;)
+	{
+		ssize_t bytes = recv(sock, data, length, ioFlags());
+		if(bytes < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				wait(POLLIN);
+				continue;
+			}
+			throw ConnectionError("Receive failed: "+std::string(strerror(errno)));
+		}
+		if(bytes == 0)
+			throw ConnectionError("Connection closed unexpectedly");
+		return size_t(bytes);
+	}
+}
+
+/**
+ * @brief      Send as much data as possible without blocking
+ *
+ * @param      data    Data to send
+ * @param      length  Number of bytes to send
+ *
+ * @throws     ConnectionError   Sending failed
+ *
+ * @return     Number of bytes sent (0 if the socket buffer is full)
+ */
+size_t ExmdbClient::Connection::trySend(const void* data, size_t length)
+{
+	ssize_t bytes = ::send(sock, data, length, MSG_NOSIGNAL | MSG_DONTWAIT);
+	if(bytes >= 0)
+		return size_t(bytes);
+	if(errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+		return 0;
+	throw ConnectionError("Send failed: "+std::string(strerror(errno)));
+}
+
+/**
+ * @brief      Read available data without blocking
+ *
+ * @param      data    Destination buffer
+ * @param      length  Maximum number of bytes to read
+ *
+ * @throws     ConnectionError   Reading failed or connection was closed
+ *
+ * @return     Number of bytes read (0 if no data is available)
+ */
+size_t ExmdbClient::Connection::tryReceive(void* data, size_t length)
+{
+	ssize_t bytes = recv(sock, data, length, MSG_DONTWAIT);
+	if(bytes > 0)
+		return size_t(bytes);
+	if(bytes == 0)
+		throw ConnectionError("Connection closed unexpectedly");
+	if(errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+		return 0;
+	throw ConnectionError("Receive failed: "+std::string(strerror(errno)));
+}
+
+/**
+ * @brief      Read exactly the specified number of bytes
+ *
+ * @param      data    Destination buffer
+ * @param      length  Number of bytes to read
+ *
+ * @throws     ConnectionError   Reading failed or connection was closed
+ */
+void ExmdbClient::Connection::recvAll(void* data, size_t length)
+{
+	for(size_t offset = 0; offset < length;)
 	{
-		bytes = recv(sock, buff.data()+offset, length-offset, 0);
+		ssize_t bytes = recv(sock, static_cast<uint8_t*>(data)+offset, length-offset, ioFlags());
 		if(bytes < 0)
-			throw ConnectionError("Message reception failed");
+		{
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				wait(POLLIN);
+				continue;
+			}
+			throw ConnectionError("Receive failed: "+std::string(strerror(errno)));
+		}
 		if(bytes == 0)
 			throw ConnectionError("Connection closed unexpectedly");
+		offset += size_t(bytes);
 	}
 }
 
@@ -228,7 +632,8 @@ ExmdbClient::ExmdbClient(const std::string& host, const std::string& port, const
 void ExmdbClient::connect(const std::string& host, const std::string& port, const std::string& prefix, bool isPrivate)
 {
 	params = ConnParm(host, port, prefix, isPrivate);
-	connection.connect(host, port);
+	connection.connect(host, port, connectTimeout);
+	connection.configure(socketOptions);
 	send<ConnectRequest>(prefix, isPrivate);
 }
 
@@ -244,17 +649,531 @@ bool ExmdbClient::reconnect()
 	Connection newconn;
 	try
 	{
-		newconn.connect(params.host, params.port);
+		newconn.connect(params.host, params.port, connectTimeout);
+		newconn.configure(socketOptions);
+		arm(newconn);
 		buffer.clear();
 		buffer.start();
 		ConnectRequest::write(buffer, params.prefix, params.isPrivate);
 		buffer.finalize();
 		newconn.send(buffer);
 		connection = std::move(newconn);
+		if(instrumentation)
+			instrumentation->reconnected();
 		return true;
 	}
 	catch (...)
 	{return false;}
 }
 
+/**
+ * @brief      Check whether the client has an open connection
+ *
+ * The connection is closed automatically if a request fails due to a
+ * connection error.
+ *
+ * @return     true if connected, false otherwise
+ */
+bool ExmdbClient::connected() const noexcept
+{return connection.connected();}
+
+/**
+ * @brief      Check whether the connection is still usable
+ *
+ * Detects connections closed by the server (or found dead by keepalive
+ * probes) without sending a request. Dead connections are closed, so
+ * connected() returns false afterwards.
+ *
+ * Must not be called while a response is pending (e.g. a ResponseStream is
+ * in use).
+ *
+ * @return     true if the connection is usable, false otherwise
+ */
+bool ExmdbClient::alive()
+{return connection.alive();}
+
+/**
+ * @brief      Set socket options
+ *
+ * The options are applied to the current connection and all connections
+ * established later.
+ *
+ * @param      opts  Options to use
+ *
+ * @throws     ConnectionError  Applying the options to the current connection failed
+ */
+void ExmdbClient::setSocketOptions(const SocketOptions& opts)
+{
+	socketOptions = opts;
+	connection.configure(opts);
+}
+
+/**
+ * @brief      Set timeout for establishing TCP connections
+ *
+ * Applies to connect() and reconnect(), the connection handshake is
+ * subject to the request timeout.
+ *
+ * @param      limit  Maximum time to wait per address (default 3000 ms)
+ */
+void ExmdbClient::setConnectTimeout(std::chrono::milliseconds limit) noexcept
+{connectTimeout = limit;}
+
+/**
+ * @brief      Set timeout for each request
+ *
+ * Limits the total time spent sending a request and receiving its response.
+ *
+ * @param      limit  Maximum duration of a request (0 for unlimited)
+ */
+void ExmdbClient::setTimeout(std::chrono::milliseconds limit) noexcept
+{timeout = limit;}
+
+/**
+ * @brief      Set deadline for all following requests
+ *
+ * Requests fail with TimeoutError once the deadline has passed. If a request
+ * timeout is set as well, the earlier of both applies.
+ *
+ * @param      until  Time at which requests fail
+ */
+void ExmdbClient::setDeadline(std::chrono::steady_clock::time_point until) noexcept
+{deadline = until;}
+
+/**
+ * @brief      Remove deadline set with setDeadline()
+ */
+void ExmdbClient::clearDeadline() noexcept
+{deadline = std::chrono::steady_clock::time_point::max();}
+
+/**
+ * @brief      Set token to abort requests
+ *
+ * The token can be cancelled from another thread to abort the request that
+ * is currently in progress, as well as all following requests until the
+ * token is reset.
+ *
+ * @param      token  Token to use or nullptr to disable cancellation
+ */
+void ExmdbClient::setCancellationToken(std::shared_ptr<CancellationToken> token) noexcept
+{cancellation = std::move(token);}
+
+/**
+ * @brief      Apply deadline and cancellation token to a connection
+ *
+ * @param      conn  Connection to prepare for the next request
+ *
+ * @throws     CancelledError  Token is already cancelled
+ * @throws     TimeoutError    Deadline has already passed
+ */
+void ExmdbClient::arm(Connection& conn)
+{
+	if(cancellation && cancellation->cancelled())
+		throw CancelledError("Request cancelled");
+	auto now = std::chrono::steady_clock::now();
+	if(deadline <= now)
+		throw TimeoutError("Request timed out");
+	auto until = deadline;
+	if(timeout.count() > 0 && now+timeout < until)
+		until = now+timeout;
+	conn.arm(until, cancellation.get());
+}
+
+/**
+ * @brief      Set instrumentation
+ *
+ * The instrumentation receives a CallRecord for each request sent with
+ * send(), sendRaw(), stream() or through a Pipeline and is notified of
+ * successful reconnects.
+ *
+ * @param      instr  Instrumentation to use or nullptr to disable
+ */
+void ExmdbClient::setInstrumentation(std::shared_ptr<Instrumentation> instr) noexcept
+{instrumentation = std::move(instr);}
+
+/**
+ * @brief      Return current instrumentation
+ *
+ * @return     Instrumentation or nullptr if disabled
+ */
+const std::shared_ptr<Instrumentation>& ExmdbClient::getInstrumentation() const noexcept
+{return instrumentation;}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief      Create response stream
+ *
+ * If a record is given, it is completed and reported to the client's
+ * instrumentation once the response was received completely.
+ *
+ * @param      client      Client to read the response from
+ * @param      length      Length of the response data
+ * @param      bufferSize  Size of the receive buffer
+ * @param      record      Measurements of the request up to the response header or nullptr
+ */
+ExmdbClient::ResponseStream::ResponseStream(ExmdbClient& client, uint32_t length, size_t bufferSize,
+                                            const CallRecord* record) :
+    client(&client), buffer(std::min<size_t>(bufferSize, length)), pending(length), recording(record != nullptr),
+    created(std::chrono::steady_clock::now())
+{
+	if(record)
+		this->record = *record;
+	if(!pending)
+		report(ResponseCode::SUCCESS);
+}
+
+/**
+ * @brief      Move constructor
+ *
+ * @param      other  Stream to take over
+ */
+ExmdbClient::ResponseStream::ResponseStream(ResponseStream&& other) noexcept :
+    client(other.client), buffer(std::move(other.buffer)), pos(other.pos), end(other.end), pending(other.pending),
+    record(other.record), recording(other.recording), created(other.created)
+{
+	other.client = nullptr;
+	other.recording = false;
+}
+
+/**
+ * @brief      Destructor
+ *
+ * Closes the connection if the response was not read completely.
+ * A response not received completely is reported as connection error.
+ */
+ExmdbClient::ResponseStream::~ResponseStream()
+{
+	if(!client || !remaining())
+		return;
+	client->connection.close();
+	report(CallRecord::CONNECTION_ERROR);
+}
+
+/**
+ * @brief      Report request to the client's instrumentation
+ *
+ * The network time is extended to the current time. Does nothing if the
+ * request is not recorded or was already reported.
+ *
+ * @param      status  Status to report
+ */
+void ExmdbClient::ResponseStream::report(uint8_t status) noexcept
+{
+	if(!recording)
+		return;
+	recording = false;
+	record.networkNs += elapsed(created);
+	record.status = status;
+	if(client->instrumentation)
+		client->instrumentation->record(record);
+}
+
+/**
+ * @brief      Return number of response bytes not read yet
+ */
+size_t ExmdbClient::ResponseStream::remaining() const noexcept
+{return end-pos+pending;}
+
+/**
+ * @brief      Receive next chunk of data into the buffer
+ *
+ * Must only be called if the buffer was consumed completely.
+ *
+ * @throws     SerializationError  End of response reached
+ * @throws     ConnectionError     Receiving failed
+ */
+void ExmdbClient::ResponseStream::fill()
+{
+	if(!pending)
+		throw SerializationError("Read past the end of response");
+	try {end = client->connection.receiveSome(buffer.data(), std::min(pending, buffer.size()));}
+	catch(const ConnectionError&)
+	{
+		client->connection.close();
+		pending = 0;
+		report(CallRecord::CONNECTION_ERROR);
+		throw;
+	}
+	pos = 0;
+	pending -= end;
+	if(!pending)
+		report(ResponseCode::SUCCESS);
+}
+
+/**
+ * @brief      Read data from the stream
+ *
+ * @param      data    Destination buffer
+ * @param      length  Number of bytes to read
+ *
+ * @throws     SerializationError  Response does not contain enough data
+ * @throws     ConnectionError     Receiving failed
+ */
+void ExmdbClient::ResponseStream::read(void* data, size_t length)
+{
+	uint8_t* dest = static_cast<uint8_t*>(data);
+	while(length)
+	{
+		auto [src, bytes] = chunk(length);
+		memcpy(dest, src, bytes);
+		dest += bytes;
+		length -= bytes;
+	}
+}
+
+/**
+ * @brief      Read data from the stream without copying
+ *
+ * Returns the largest contiguous block of buffered data (but at most
+ * `length` bytes), receiving more data if the buffer is empty.
+ * The data is only valid until the next read operation.
+ *
+ * @param      length  Maximum number of bytes to read
+ *
+ * @throws     SerializationError  End of response reached
+ * @throws     ConnectionError     Receiving failed
+ *
+ * @return     Pointer to the data and number of bytes available
+ */
+std::pair<const uint8_t*, size_t> ExmdbClient::ResponseStream::chunk(size_t length)
+{
+	if(pos == end)
+		fill();
+	size_t bytes = std::min(length, end-pos);
+	const uint8_t* data = buffer.data()+pos;
+	pos += bytes;
+	return {data, bytes};
+}
+
+/**
+ * @brief      Read zero terminated string from the stream
+ *
+ * The string, including the terminator, is appended to the buffer.
+ *
+ * @param      dest  Buffer to append the string to
+ *
+ * @throws     SerializationError  Response ends before the terminator
+ * @throws     ConnectionError     Receiving failed
+ */
+void ExmdbClient::ResponseStream::readString(IOBuffer& dest)
+{
+	for(;;)
+	{
+		if(pos == end)
+			fill();
+		const uint8_t* start = buffer.data()+pos;
+		const void* term = memchr(start, 0, end-pos);
+		size_t bytes = term? static_cast<const uint8_t*>(term)-start+1 : end-pos;
+		dest.push_raw(start, bytes);
+		pos += bytes;
+		if(term)
+			return;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief      Create empty pipeline
+ *
+ * @param      client  Client to send requests with
+ */
+ExmdbClient::Pipeline::Pipeline(ExmdbClient& client) : client(client)
+{}
+
+/**
+ * @brief      Destructor
+ *
+ * Reports successful requests whose responses were not retrieved.
+ */
+ExmdbClient::Pipeline::~Pipeline()
+{clear();}
+
+/**
+ * @brief      Send pending requests and receive responses
+ *
+ * Responses are received as soon as they arrive, interleaved with sending
+ * the remaining requests. The server therefore never blocks on a full
+ * socket buffer while the client is still transmitting, regardless of the
+ * size of the batch.
+ *
+ * Responses indicating an error are recorded and reported when the response
+ * is retrieved with get().
+ *
+ * If instrumentation is set, the network time of each request is measured
+ * from the start of the transmission to the reception of its response.
+ *
+ * Requests added after execute() are sent by the next call to execute(), so
+ * the pipeline can be used to submit multiple consecutive batches while
+ * keeping all responses accessible.
+ *
+ * @throws     ConnectionError   Connection failed during transmission
+ */
+void ExmdbClient::Pipeline::execute()
+{
+	size_t first = responses.size();
+	if(first == callIds.size())
+		return;
+	Connection& conn = client.connection;
+	client.arm(conn);
+	bool dispatchError = false;
+	responses.resize(callIds.size());
+	status.resize(callIds.size(), ResponseCode::SUCCESS);
+	instrumentation = client.instrumentation;
+	if(instrumentation)
+	{
+		records.resize(callIds.size());
+		pending.resize(callIds.size(), false);
+		for(size_t i = first; i < callIds.size(); ++i)
+			records[i].callId = callIds[i];
+	}
+	auto start = std::chrono::steady_clock::now();
+	size_t next = first, sent = 0, filled = 0, headerLength = 0;
+	uint8_t header[1+sizeof(uint32_t)]; // Status code and length
+	bool inBody = false;
+	auto done = [&]
+	{
+		if(instrumentation)
+		{
+			CallRecord& record = records[next];
+			record.status = status[next];
+			record.responseBytes = responses[next].size();
+			record.networkNs = elapsed(start);
+			if(record.status != ResponseCode::SUCCESS)
+				instrumentation->record(record);
+			else
+				pending[next] = true;
+		}
+		++next;
+	};
+	auto complete = [&]
+	{
+		if(inBody && filled == responses[next].size())
+		{
+			inBody = false;
+			done();
+		}
+	};
+	auto feed = [&](const uint8_t* data, size_t length)
+	{
+		while(length && next < responses.size())
+		{
+			if(inBody)
+			{
+				size_t bytes = std::min(length, responses[next].size()-filled);
+				memcpy(responses[next].data()+filled, data, bytes);
+				filled += bytes;
+				data += bytes;
+				length -= bytes;
+				complete();
+				continue;
+			}
+			size_t bytes = std::min(length, headerLength? sizeof(header)-headerLength : 1);
+			memcpy(header+headerLength, data, bytes);
+			headerLength += bytes;
+			data += bytes;
+			length -= bytes;
+			if(headerLength == 1 && header[0] != ResponseCode::SUCCESS)
+			{
+				status[next] = header[0];
+				dispatchError |= header[0] == ResponseCode::DISPATCH_ERROR;
+				done();
+				headerLength = 0;
+			}
+			else if(headerLength == sizeof(header))
+			{
+				uint32_t bodyLength;
+				memcpy(&bodyLength, header+1, sizeof(bodyLength));
+				responses[next].clear();
+				responses[next].resize(le32toh(bodyLength));
+				headerLength = filled = 0;
+				inBody = true;
+				complete();
+			}
+		}
+	};
+	try
+	{
+		ByteBuffer chunk(pipelineChunkSize);
+		while(next < responses.size())
+		{
+			short revents = conn.wait(sent < buffer.size()? POLLIN | POLLOUT : POLLIN);
+			if(revents & POLLOUT && sent < buffer.size())
+				sent += conn.trySend(buffer.data()+sent, buffer.size()-sent);
+			if(!(revents & ~POLLOUT))
+				continue;
+			if(inBody && responses[next].size()-filled >= chunk.size())
+			{ // Receive large responses directly
+				filled += conn.tryReceive(responses[next].data()+filled, responses[next].size()-filled);
+				complete();
+			}
+			else
+				feed(chunk.data(), conn.tryReceive(chunk.data(), chunk.size()));
+		}
+	}
+	catch (const ConnectionError&)
+	{
+		client.connection.close();
+		if(instrumentation)
+		{
+			for(size_t i = first; i < callIds.size(); ++i)
+				if(i < next)
+					report(i);
+				else
+				{
+					records[i].status = CallRecord::CONNECTION_ERROR;
+					records[i].networkNs = elapsed(start);
+					instrumentation->record(records[i]);
+				}
+		}
+		records.resize(std::min(records.size(), first));
+		pending.resize(std::min(pending.size(), first));
+		callIds.resize(first);
+		responses.resize(first);
+		status.resize(first);
+		buffer.clear();
+		throw;
+	}
+	buffer.clear();
+	if(dispatchError && client.flags & AUTO_RECONNECT)
+		client.reconnect();
+}
+
+/**
+ * @brief      Remove all requests and responses
+ */
+void ExmdbClient::Pipeline::clear() noexcept
+{
+	for(size_t i = 0; i < pending.size(); ++i)
+		report(i);
+	buffer.clear();
+	callIds.clear();
+	status.clear();
+	responses.clear();
+	records.clear();
+	pending.clear();
+}
+
+/**
+ * @brief      Return number of requests in the pipeline
+ */
+size_t ExmdbClient::Pipeline::size() const noexcept
+{return callIds.size();}
+
+/**
+ * @brief      Report successful request to the instrumentation
+ *
+ * Does nothing if the request was already reported.
+ *
+ * @param      index  Index of the request
+ */
+void ExmdbClient::Pipeline::report(size_t index) noexcept
+{
+	if(!pending[index])
+		return;
+	pending[index] = false;
+	instrumentation->record(records[index]);
+}
+
 }
@@ -0,0 +1,222 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * SPDX-FileCopyrightText: 2020-2021 grommunio GmbH
+ */
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "FolderCache.h"
+
+namespace exmdbpp::queries
+{
+
+/**
+ * @brief      Compare lookup keys
+ */
+bool FolderCache::NameKey::operator==(const NameKey& other) const noexcept
+{return parentId == other.parentId && name == other.name;}
+
+/**
+ * @brief      Compute hash of lookup key
+ */
+size_t FolderCache::NameHash::operator()(const NameKey& key) const noexcept
+{return std::hash<std::string>()(key.name)^(std::hash<uint64_t>()(key.parentId)*31);}
+
+/**
+ * @brief      Remove expired entries if the purge threshold was reached
+ *
+ * Called before inserting entries. Adjusts the threshold to twice the
+ * number of remaining entries.
+ *
+ * @param      now   Current time
+ */
+void FolderCache::Store::prune(Clock::time_point now)
+{
+	if(ids.size()+folders.size() < purgeAt)
+		return;
+	for(auto it = ids.begin(); it != ids.end();)
+		it = it->second.expires <= now? ids.erase(it) : std::next(it);
+	for(auto it = folders.begin(); it != folders.end();)
+		it = it->second.expires <= now? folders.erase(it) : std::next(it);
+	purgeAt = std::max<size_t>(256, 2*(ids.size()+folders.size()));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief      Create empty cache
+ *
+ * @param      ttl   Time after which entries expire
+ */
+FolderCache::FolderCache(std::chrono::milliseconds ttl) : ttl(ttl)
+{}
+
+/**
+ * @brief      Look up folder ID by name
+ *
+ * @param      homedir   Home directory of the store
+ * @param      parentId  ID of the parent folder
+ * @param      name      Name of the folder
+ *
+ * @return     Folder ID or empty if not cached
+ */
+std::optional<uint64_t> FolderCache::findId(const std::string& homedir, uint64_t parentId, const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto store = stores.find(homedir);
+	if(store == stores.end())
+		return std::nullopt;
+	auto it = store->second.ids.find(NameKey{parentId, name});
+	if(it == store->second.ids.end())
+		return std::nullopt;
+	if(it->second.expires <= Clock::now())
+	{
+		store->second.ids.erase(it);
+		return std::nullopt;
+	}
+	return it->second.value;
+}
+
+/**
+ * @brief      Look up folder properties
+ *
+ * @param      homedir   Home directory of the store
+ * @param      folderId  ID of the folder
+ *
+ * @return     Folder properties or empty if not cached
+ */
+std::optional<Folder> FolderCache::findFolder(const std::string& homedir, uint64_t folderId)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto store = stores.find(homedir);
+	if(store == stores.end())
+		return std::nullopt;
+	auto it = store->second.folders.find(folderId);
+	if(it == store->second.folders.end())
+		return std::nullopt;
+	if(it->second.expires <= Clock::now())
+	{
+		store->second.folders.erase(it);
+		return std::nullopt;
+	}
+	return it->second.value;
+}
+
+/**
+ * @brief      Cache folder ID
+ *
+ * @param      homedir   Home directory of the store
+ * @param      parentId  ID of the parent folder
+ * @param      name      Name of the folder
+ * @param      folderId  ID of the folder
+ */
+void FolderCache::storeId(const std::string& homedir, uint64_t parentId, const std::string& name, uint64_t folderId)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	Clock::time_point now = Clock::now();
+	Store& store = stores[homedir];
+	store.prune(now);
+	store.ids.insert_or_assign(NameKey{parentId, name}, Entry<uint64_t>{folderId, now+ttl});
+}
+
+/**
+ * @brief      Cache folder properties
+ *
+ * @param      homedir   Home directory of the store
+ * @param      folder    Folder to cache
+ */
+void FolderCache::storeFolder(const std::string& homedir, const Folder& folder)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	Clock::time_point now = Clock::now();
+	Store& store = stores[homedir];
+	store.prune(now);
+	store.folders.insert_or_assign(folder.folderId, Entry<Folder>{folder, now+ttl});
+}
+
+/**
+ * @brief      Remove folder from the cache
+ *
+ * Removes the folder properties, all name lookups resolving to the folder
+ * and all cached information about its (known) sub-folders.
+ *
+ * @param      homedir   Home directory of the store
+ * @param      folderId  ID of the folder
+ */
+void FolderCache::invalidate(const std::string& homedir, uint64_t folderId)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto store = stores.find(homedir);
+	if(store == stores.end())
+		return;
+	auto& ids = store->second.ids;
+	auto& folders = store->second.folders;
+	std::vector<uint64_t> pending{folderId};
+	while(!pending.empty())
+	{
+		uint64_t current = pending.back();
+		pending.pop_back();
+		folders.erase(current);
+		for(auto it = ids.begin(); it != ids.end();)
+			if(it->second.value == current || it->first.parentId == current)
+			{
+				if(it->first.parentId == current)
+					pending.emplace_back(it->second.value);
+				it = ids.erase(it);
+			}
+			else
+				++it;
+	}
+}
+
+/**
+ * @brief      Remove name lookups of sub-folders
+ *
+ * @param      homedir   Home directory of the store
+ * @param      parentId  ID of the parent folder
+ */
+void FolderCache::invalidateChildren(const std::string& homedir, uint64_t parentId)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto store = stores.find(homedir);
+	if(store == stores.end())
+		return;
+	auto& ids = store->second.ids;
+	for(auto it = ids.begin(); it != ids.end();)
+		it = it->first.parentId == parentId? ids.erase(it) : std::next(it);
+}
+
+/**
+ * @brief      Remove all cached information of a store
+ *
+ * @param      homedir  Home directory of the store
+ */
+void FolderCache::invalidate(const std::string& homedir)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	stores.erase(homedir);
+}
+
+/**
+ * @brief      Remove all cached information
+ */
+void FolderCache::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	stores.clear();
+}
+
+/**
+ * @brief      Return total number of cached entries
+ */
+size_t FolderCache::size() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t count = 0;
+	for(const auto& store : stores)
+		count += store.second.ids.size()+store.second.folders.size();
+	return count;
+}
+
+}
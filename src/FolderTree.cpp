@@ -0,0 +1,167 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * SPDX-FileCopyrightText: 2020-2021 grommunio GmbH
+ */
+#include <algorithm>
+
+#include "FolderTree.h"
+
+namespace exmdbpp::queries
+{
+
+/**
+ * @brief      Create empty tree
+ *
+ * @param      root  ID of the folder below which the hierarchy is tracked
+ */
+FolderTree::FolderTree(uint64_t root) : rootId(root)
+{}
+
+/**
+ * @brief      Return ID of the root folder
+ */
+uint64_t FolderTree::root() const noexcept
+{return rootId;}
+
+/**
+ * @brief      Return latest modification time of the folders in the tree
+ *
+ * @return     Modification time (NT timestamp) or 0 if the tree is empty
+ */
+uint64_t FolderTree::modifiedSince() const noexcept
+{return watermark;}
+
+/**
+ * @brief      Return number of folders in the tree
+ */
+size_t FolderTree::size() const noexcept
+{return folders.size();}
+
+/**
+ * @brief      Check whether the tree is empty
+ */
+bool FolderTree::empty() const noexcept
+{return folders.empty();}
+
+/**
+ * @brief      Look up folder by ID
+ *
+ * The returned pointer is invalidated by the next modification of the tree.
+ *
+ * @param      folderId  ID of the folder
+ *
+ * @return     Pointer to the folder or nullptr if not found
+ */
+const Folder* FolderTree::find(uint64_t folderId) const
+{
+	auto it = folders.find(folderId);
+	return it == folders.end()? nullptr : &it->second;
+}
+
+/**
+ * @brief      Return direct sub-folders of a folder
+ *
+ * The returned pointers are invalidated by the next modification of the
+ * tree.
+ *
+ * @param      parentId  ID of the parent folder (use root() for top level folders)
+ *
+ * @return     Sub-folders in unspecified order
+ */
+std::vector<const Folder*> FolderTree::children(uint64_t parentId) const
+{
+	std::vector<const Folder*> result;
+	auto it = childIds.find(parentId);
+	if(it == childIds.end())
+		return result;
+	result.reserve(it->second.size());
+	for(uint64_t folderId : it->second)
+		result.emplace_back(&folders.at(folderId));
+	return result;
+}
+
+/**
+ * @brief      Insert or update folders
+ *
+ * Folders not yet contained in the tree are added. Known folders are
+ * replaced if their change number or modification time differs, and
+ * ignored otherwise.
+ *
+ * @param      update   Folders to merge
+ * @param      changes  Changes to record the affected folders in
+ */
+void FolderTree::merge(std::vector<Folder>&& update, FolderChanges& changes)
+{
+	for(Folder& folder : update)
+	{
+		watermark = std::max(watermark, folder.lastModified);
+		auto it = folders.find(folder.folderId);
+		if(it == folders.end())
+		{
+			changes.added.emplace_back(folder.folderId);
+			link(folders.emplace(folder.folderId, std::move(folder)).first->second);
+			continue;
+		}
+		if(it->second.changeNumber == folder.changeNumber && it->second.lastModified == folder.lastModified)
+			continue;
+		changes.modified.emplace_back(folder.folderId);
+		unlink(it->second);
+		it->second = std::move(folder);
+		link(it->second);
+	}
+}
+
+/**
+ * @brief      Remove all folders not contained in a list
+ *
+ * @param      existing  IDs of the folders to keep
+ * @param      changes   Changes to record the removed folders in
+ */
+void FolderTree::retain(const std::vector<uint64_t>& existing, FolderChanges& changes)
+{
+	std::unordered_set<uint64_t> keep(existing.begin(), existing.end());
+	for(auto it = folders.begin(); it != folders.end();)
+	{
+		if(keep.count(it->first))
+		{
+			++it;
+			continue;
+		}
+		changes.removed.emplace_back(it->first);
+		unlink(it->second);
+		it = folders.erase(it);
+	}
+}
+
+/**
+ * @brief      Remove all folders
+ *
+ * The next synchronization transfers the complete hierarchy.
+ */
+void FolderTree::clear() noexcept
+{
+	folders.clear();
+	childIds.clear();
+	watermark = 0;
+}
+
+/**
+ * @brief      Add folder to the index of its parent
+ */
+void FolderTree::link(const Folder& folder)
+{childIds[folder.parentId].emplace(folder.folderId);}
+
+/**
+ * @brief      Remove folder from the index of its parent
+ */
+void FolderTree::unlink(const Folder& folder)
+{
+	auto it = childIds.find(folder.parentId);
+	if(it == childIds.end())
+		return;
+	it->second.erase(folder.folderId);
+	if(it->second.empty())
+		childIds.erase(it);
+}
+
+}
@@ -0,0 +1,254 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * SPDX-FileCopyrightText: 2020-2021 grommunio GmbH
+ */
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+#include "constants.h"
+#include "IOBufferImpl.h"
+#include "MessageExporter.h"
+#include "TableCursor.h"
+
+using namespace exmdbpp::constants;
+using namespace exmdbpp::requests;
+using namespace exmdbpp::structures;
+
+namespace exmdbpp::queries
+{
+
+/**
+ * @brief      Initialize exporter
+ *
+ * @param      pool     Pool providing the connections
+ * @param      workers  Maximum number of concurrent fetches (0 to use all available connections)
+ * @param      window   Maximum number of messages fetched but not delivered yet (0 for twice the number of workers)
+ */
+MessageExporter::MessageExporter(QueriesPool& pool, size_t workers, size_t window) :
+    pool(pool), workers(workers), window(window)
+{}
+
+/**
+ * @brief      Set handler for failed messages
+ *
+ * If set, messages that cannot be read are reported to the handler and the
+ * export continues. Otherwise, the export is aborted with the first error.
+ *
+ * @param      handler  Handler to call or empty function to abort on error
+ */
+void MessageExporter::setErrorHandler(ErrorHandler handler) noexcept
+{onError = std::move(handler);}
+
+/**
+ * @brief      Export all messages of a folder
+ *
+ * Message IDs are paged from a content table using one of the pool's
+ * connections, the remaining connections are used to fetch the messages.
+ *
+ * @param      homedir      Home directory path of the store
+ * @param      folderId     ID of the folder
+ * @param      sink         Function receiving the messages
+ * @param      tableFlags   Flags passed to the content table
+ * @param      restriction  Restriction to apply to the content table
+ * @param      pageSize     Number of message IDs to retrieve per request
+ *
+ * @throws     std::invalid_argument  Pool contains less than two clients
+ * @throws     Any exception thrown by the table requests, the sink or (if no error handler is set) a message request
+ *
+ * @return     Number of messages delivered to the sink
+ */
+size_t MessageExporter::exportFolder(const std::string& homedir, uint64_t folderId, const Sink& sink, uint8_t tableFlags,
+                                     const Restriction& restriction, uint32_t pageSize)
+{
+	if(pool.size() < 2)
+		throw std::invalid_argument("Folder export requires a pool with at least two clients");
+	static const std::vector<uint32_t> midTag = {PropTag::MID};
+	auto client = pool.lease();
+	TableCursor cursor = TableCursor::content(*client, homedir, folderId, midTag, tableFlags, pageSize, true, restriction);
+	auto source = [&cursor](uint64_t& messageId)
+	{
+		while(const TableCursor::PropvalList* row = cursor.next())
+			for(const TaggedPropval& tp : *row)
+				if(tp.tag == PropTag::MID)
+				{
+					messageId = tp.value.u64;
+					return true;
+				}
+		return false;
+	};
+	return run(homedir, source, sink, pool.size()-1);
+}
+
+/**
+ * @brief      Export list of messages
+ *
+ * @param      homedir     Home directory path of the store
+ * @param      messageIds  IDs of the messages to export
+ * @param      sink        Function receiving the messages
+ *
+ * @throws     Any exception thrown by the sink or (if no error handler is set) a message request
+ *
+ * @return     Number of messages delivered to the sink
+ */
+size_t MessageExporter::exportMessages(const std::string& homedir, const std::vector<uint64_t>& messageIds, const Sink& sink)
+{
+	size_t next = 0;
+	auto source = [&](uint64_t& messageId)
+	{
+		if(next >= messageIds.size())
+			return false;
+		messageId = messageIds[next++];
+		return true;
+	};
+	return run(homedir, source, sink, pool.size());
+}
+
+/**
+ * @brief      Fetch messages concurrently and deliver them in order
+ *
+ * The calling thread retrieves message IDs from the source and delivers
+ * completed messages to the sink, worker threads read the messages.
+ *
+ * Messages that do not exist (anymore) are skipped.
+ *
+ * Each worker leases its client when it fetches its first message and
+ * returns it after a failed request. If no client can be leased, the
+ * error is reported for the message the worker was about to fetch.
+ *
+ * @param      homedir    Home directory path of the store
+ * @param      source     Function providing the next message ID, returns false if there are no more messages
+ * @param      sink       Function receiving the messages
+ * @param      available  Number of connections available for fetching
+ *
+ * @return     Number of messages delivered to the sink
+ */
+size_t MessageExporter::run(const std::string& homedir, const std::function<bool(uint64_t&)>& source, const Sink& sink,
+                            size_t available)
+{
+	struct Slot
+	{
+		uint64_t messageId = 0;
+		bool ready = false;
+		bool found = false;
+		MessageContent content;
+		std::exception_ptr error;
+	};
+	size_t count = std::max<size_t>(1, workers? std::min(workers, available) : available);
+	size_t limit = std::max<size_t>(1, window? window : 2*count);
+	std::mutex mutex;
+	std::condition_variable wakeWorkers, wakeMain;
+	std::deque<Slot> slots; ///< Messages delivered+0 ... issued-1
+	size_t delivered = 0, issued = 0, fetched = 0, exported = 0;
+	bool exhausted = false, stop = false;
+
+	auto worker = [&]
+	{
+		std::optional<QueriesPool::Lease> client; ///< Leased on first use, so lease errors are reported as message errors
+		std::unique_lock<std::mutex> lock(mutex);
+		for(;;)
+		{
+			wakeWorkers.wait(lock, [&]{return stop || fetched < issued || exhausted;});
+			if(stop || fetched == issued)
+				return;
+			size_t seq = fetched++;
+			uint64_t messageId = slots[seq-delivered].messageId;
+			lock.unlock();
+			bool found = false;
+			MessageContent content;
+			std::exception_ptr error;
+			try
+			{
+				if(!client)
+					client.emplace(pool.lease());
+				auto response = (*client)->send<ReadMessageRequest>(homedir, std::string(), uint32_t(0), messageId);
+				found = response.found;
+				content = std::move(response.content);
+			}
+			catch(...)
+			{
+				error = std::current_exception();
+				client.reset(); // Lost connections are repaired on the next checkout
+			}
+			lock.lock();
+			Slot& slot = slots[seq-delivered];
+			slot.found = found;
+			slot.content = std::move(content);
+			slot.error = error;
+			slot.ready = true;
+			if(seq == delivered)
+				wakeMain.notify_one();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(count);
+	auto shutdown = [&]
+	{
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			stop = true;
+		}
+		wakeWorkers.notify_all();
+		for(std::thread& thread : threads)
+			thread.join();
+	};
+	try
+	{
+		for(size_t i = 0; i < count; ++i)
+			threads.emplace_back(worker);
+		std::unique_lock<std::mutex> lock(mutex);
+		for(;;)
+		{
+			while(!exhausted && issued-delivered < limit)
+			{
+				uint64_t messageId;
+				lock.unlock();
+				bool more = source(messageId);
+				lock.lock();
+				if(!more)
+				{
+					exhausted = true;
+					wakeWorkers.notify_all();
+					break;
+				}
+				Slot& slot = slots.emplace_back();
+				slot.messageId = messageId;
+				++issued;
+				wakeWorkers.notify_one();
+			}
+			if(exhausted && delivered == issued)
+				break;
+			wakeMain.wait(lock, [&]{return slots.front().ready;});
+			Slot slot = std::move(slots.front());
+			slots.pop_front();
+			++delivered;
+			lock.unlock();
+			if(slot.error)
+			{
+				if(!onError)
+					std::rethrow_exception(slot.error);
+				onError(slot.messageId, slot.error);
+			}
+			else if(slot.found)
+			{
+				sink(slot.messageId, std::move(slot.content));
+				++exported;
+			}
+			lock.lock();
+		}
+	}
+	catch(...)
+	{
+		shutdown();
+		throw;
+	}
+	shutdown();
+	return exported;
+}
+
+}
@@ -0,0 +1,220 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * SPDX-FileCopyrightText: 2020-2021 grommunio GmbH
+ */
+#include <string>
+
+#include "constants.h"
+#include "IOBufferImpl.h"
+#include "MessageReader.h"
+
+namespace exmdbpp
+{
+
+using namespace constants;
+using namespace structures;
+
+/**
+ * @brief      Create message reader
+ *
+ * @param      handler        Handler receiving the message contents
+ * @param      blobThreshold  Minimum size of binary properties to report as blob
+ */
+MessageReader::MessageReader(MessageHandler& handler, uint32_t blobThreshold) :
+    handler(handler), blobThreshold(blobThreshold)
+{}
+
+/**
+ * @brief      Read message content from stream
+ *
+ * @param      stream  Stream positioned at the start of the message content
+ *
+ * @throws     SerializationError  Message content is invalid
+ * @throws     ConnectionError     Receiving failed
+ * @throws     Any exception thrown by the handler
+ */
+void MessageReader::read(ExmdbClient::ResponseStream& stream)
+{readMessage(stream, 0);}
+
+/**
+ * @brief      Read (possibly embedded) message
+ *
+ * @param      stream  Stream to read from
+ * @param      depth   Nesting level of the message
+ */
+void MessageReader::readMessage(ExmdbClient::ResponseStream& stream, unsigned depth)
+{
+	if(depth > MessageContent::MAX_DEPTH)
+		throw SerializationError("Maximum message nesting depth exceeded");
+	handler.beginMessage();
+	readPropvals(stream, nullptr);
+	if(stream.pop<uint8_t>())
+	{
+		uint32_t count = stream.pop<uint32_t>();
+		std::vector<TaggedPropval> recipient;
+		for(uint32_t i = 0; i < count; ++i)
+		{
+			readPropvals(stream, &recipient);
+			handler.recipient(std::move(recipient));
+			recipient.clear();
+		}
+	}
+	if(stream.pop<uint8_t>())
+	{
+		uint16_t count = stream.pop<uint16_t>();
+		for(uint16_t i = 0; i < count; ++i)
+		{
+			handler.beginAttachment();
+			readPropvals(stream, nullptr);
+			if(stream.pop<uint8_t>())
+				readMessage(stream, depth+1);
+			handler.endAttachment();
+		}
+	}
+	handler.endMessage();
+}
+
+/**
+ * @brief      Read list of TaggedPropvals with 16 bit length prefix
+ *
+ * @param      stream  Stream to read from
+ * @param      dest    List to store propvals in or nullptr to report them to the handler
+ */
+void MessageReader::readPropvals(ExmdbClient::ResponseStream& stream, std::vector<TaggedPropval>* dest)
+{
+	uint16_t count = stream.pop<uint16_t>();
+	if(dest)
+		dest->reserve(count);
+	for(uint16_t i = 0; i < count; ++i)
+		readPropval(stream, dest);
+}
+
+/**
+ * @brief      Read single TaggedPropval
+ *
+ * The serialized property is collected in the scratch buffer and then
+ * decoded by TaggedPropval. Binary properties exceeding the blob threshold
+ * are passed to the handler in chunks instead (unless stored in a list).
+ *
+ * @param      stream  Stream to read from
+ * @param      dest    List to store propval in or nullptr to report it to the handler
+ */
+void MessageReader::readPropval(ExmdbClient::ResponseStream& stream, std::vector<TaggedPropval>* dest)
+{
+	uint32_t tag = stream.pop<uint32_t>();
+	scratch.clear();
+	scratch.push(tag);
+	uint16_t type = tag&0xFFFF;
+	if(tag == PropvalType::UNSPECIFIED)
+	{
+		type = stream.pop<uint16_t>();
+		scratch.push(type);
+	}
+	switch(type)
+	{
+	default:
+		throw SerializationError("Deserialization of type "+std::to_string(type)+" is not supported.");
+	case PropvalType::BYTE:
+		copy(stream, 1); break;
+	case PropvalType::SHORT:
+		copy(stream, 2); break;
+	case PropvalType::LONG:
+	case PropvalType::ERROR:
+	case PropvalType::FLOAT:
+		copy(stream, 4); break;
+	case PropvalType::LONGLONG:
+	case PropvalType::CURRENCY:
+	case PropvalType::FILETIME:
+	case PropvalType::DOUBLE:
+	case PropvalType::FLOATINGTIME:
+		copy(stream, 8); break;
+	case PropvalType::STRING:
+	case PropvalType::WSTRING:
+		stream.readString(scratch); break;
+	case PropvalType::BINARY: {
+		uint32_t length = stream.pop<uint32_t>();
+		if(length > stream.remaining())
+			throw SerializationError("Binary property exceeds response");
+		if(dest || length < blobThreshold)
+		{
+			scratch.push(length);
+			copy(stream, length);
+			break;
+		}
+		handler.beginBlob(tag, length);
+		while(length)
+		{
+			auto [data, bytes] = stream.chunk(length);
+			handler.blobChunk(data, bytes);
+			length -= uint32_t(bytes);
+		}
+		handler.endBlob();
+		return;
+	}
+	case PropvalType::SHORT_ARRAY:
+		copyArray(stream, 2); break;
+	case PropvalType::LONG_ARRAY:
+	case PropvalType::FLOAT_ARRAY:
+		copyArray(stream, 4); break;
+	case PropvalType::LONGLONG_ARRAY:
+	case PropvalType::CURRENCY_ARRAY:
+	case PropvalType::DOUBLE_ARRAY:
+	case PropvalType::FLOATINGTIME_ARRAY:
+		copyArray(stream, 8); break;
+	case PropvalType::STRING_ARRAY:
+	case PropvalType::WSTRING_ARRAY: {
+		uint32_t count = stream.pop<uint32_t>();
+		scratch.push(count);
+		for(uint32_t i = 0; i < count; ++i)
+			stream.readString(scratch);
+		break;
+	}
+	case PropvalType::BINARY_ARRAY: {
+		uint32_t count = stream.pop<uint32_t>();
+		scratch.push(count);
+		for(uint32_t i = 0; i < count; ++i)
+		{
+			uint32_t length = stream.pop<uint32_t>();
+			if(length > stream.remaining())
+				throw SerializationError("Binary property exceeds response");
+			scratch.push(length);
+			copy(stream, length);
+		}
+		break;
+	}
+	}
+	if(dest)
+		dest->emplace_back(scratch);
+	else
+		handler.propval(TaggedPropval(scratch));
+}
+
+/**
+ * @brief      Copy data from the stream to the scratch buffer
+ *
+ * @param      stream  Stream to read from
+ * @param      length  Number of bytes to copy
+ */
+void MessageReader::copy(ExmdbClient::ResponseStream& stream, size_t length)
+{
+	size_t offset = scratch.size();
+	scratch.resize(offset+length);
+	stream.read(scratch.data()+offset, length);
+}
+
+/**
+ * @brief      Copy array with 32 bit length prefix to the scratch buffer
+ *
+ * @param      stream    Stream to read from
+ * @param      elemSize  Size of a single element
+ */
+void MessageReader::copyArray(ExmdbClient::ResponseStream& stream, size_t elemSize)
+{
+	uint32_t count = stream.pop<uint32_t>();
+	if(count*elemSize > stream.remaining())
+		throw SerializationError("Array property exceeds response");
+	scratch.push(count);
+	copy(stream, count*elemSize);
+}
+
+}
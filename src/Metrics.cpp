@@ -0,0 +1,242 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * SPDX-FileCopyrightText: 2020-2021 grommunio GmbH
+ */
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+
+#include "Metrics.h"
+
+namespace exmdbpp
+{
+
+static constexpr auto relaxed = std::memory_order_relaxed;
+
+/**
+ * @brief      Add value
+ *
+ * @param      value  Value to add
+ */
+void Histogram::add(uint64_t value) noexcept
+{
+	buckets[value > 1? 64-__builtin_clzll(value-1) : 0].fetch_add(1, relaxed);
+	total.fetch_add(value, relaxed);
+}
+
+/**
+ * @brief      Remove all values
+ */
+void Histogram::reset() noexcept
+{
+	for(auto& bucket : buckets)
+		bucket.store(0, relaxed);
+	total.store(0, relaxed);
+}
+
+/**
+ * @brief      Return number of values
+ */
+uint64_t Histogram::count() const noexcept
+{
+	uint64_t count = 0;
+	for(const auto& bucket : buckets)
+		count += bucket.load(relaxed);
+	return count;
+}
+
+/**
+ * @brief      Return sum of all values
+ */
+uint64_t Histogram::sum() const noexcept
+{return total.load(relaxed);}
+
+/**
+ * @brief      Return number of values in bucket
+ *
+ * @param      index  Index of the bucket
+ */
+uint64_t Histogram::bucket(size_t index) const noexcept
+{return index < BUCKETS? buckets[index].load(relaxed) : 0;}
+
+/**
+ * @brief      Estimate quantile
+ *
+ * @param      q     Quantile to compute (between 0 and 1)
+ *
+ * @return     Upper bound of the bucket containing the quantile
+ */
+uint64_t Histogram::quantile(double q) const noexcept
+{
+	uint64_t target = uint64_t(std::ceil(q*count())), seen = 0;
+	for(size_t i = 0; i < BUCKETS; ++i)
+		if((seen += buckets[i].load(relaxed)) >= target && seen)
+			return upperBound(i);
+	return 0;
+}
+
+/**
+ * @brief      Return largest value contained in the bucket
+ *
+ * @param      index  Index of the bucket
+ */
+uint64_t Histogram::upperBound(size_t index) noexcept
+{return index >= 64? UINT64_MAX : uint64_t(1) << index;}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief      Record completed request
+ *
+ * @param      record  Measurements of the request
+ */
+void Metrics::record(const CallRecord& record) noexcept
+{
+	CallStats& stats = calls[record.callId];
+	stats.calls.fetch_add(1, relaxed);
+	stats.requestBytes.fetch_add(record.requestBytes, relaxed);
+	stats.responseBytes.fetch_add(record.responseBytes, relaxed);
+	stats.serialize.add(record.serializeNs);
+	stats.network.add(record.networkNs);
+	if(record.status)
+	{
+		stats.errors.fetch_add(1, relaxed);
+		errorCodes[record.status].fetch_add(1, relaxed);
+	}
+	else
+		stats.deserialize.add(record.deserializeNs);
+}
+
+/**
+ * @brief      Record successful reconnect
+ */
+void Metrics::reconnected() noexcept
+{reconnectCount.fetch_add(1, relaxed);}
+
+/**
+ * @brief      Return statistics of a request type
+ *
+ * @param      callId  ID of the request
+ */
+const Metrics::CallStats& Metrics::stats(uint8_t callId) const noexcept
+{return calls[callId];}
+
+/**
+ * @brief      Return number of errors with given status
+ *
+ * @param      status  Response code (or CallRecord::CONNECTION_ERROR / CallRecord::DECODE_ERROR)
+ */
+uint64_t Metrics::errors(uint8_t status) const noexcept
+{return errorCodes[status].load(relaxed);}
+
+/**
+ * @brief      Return number of reconnects
+ */
+uint64_t Metrics::reconnects() const noexcept
+{return reconnectCount.load(relaxed);}
+
+/**
+ * @brief      Write nanoseconds as exact decimal number of seconds
+ *
+ * @param      out   Stream to write to
+ * @param      ns    Nanoseconds to write
+ */
+static void exportSeconds(std::ostream& out, uint64_t ns)
+{
+	char buff[32];
+	snprintf(buff, sizeof(buff), "%" PRIu64 ".%09" PRIu64, ns/1000000000, ns%1000000000);
+	out << buff;
+}
+
+/**
+ * @brief      Export histogram in Prometheus text format
+ *
+ * @param      out     Stream to write to
+ * @param      name    Metric name
+ * @param      callId  Call ID label
+ * @param      hist    Histogram to export
+ */
+static void exportHistogram(std::ostream& out, const char* name, unsigned callId, const Histogram& hist)
+{
+	uint64_t cumulative = 0;
+	size_t last = Histogram::BUCKETS;
+	while(last > 0 && !hist.bucket(last-1))
+		--last;
+	for(size_t i = 0; i < last; ++i)
+	{
+		cumulative += hist.bucket(i);
+		out << name << "_bucket{call_id=\"" << callId << "\",le=\"";
+		exportSeconds(out, Histogram::upperBound(i));
+		out << "\"} " << cumulative << "\n";
+	}
+	out << name << "_bucket{call_id=\"" << callId << "\",le=\"+Inf\"} " << hist.count() << "\n"
+	    << name << "_sum{call_id=\"" << callId << "\"} ";
+	exportSeconds(out, hist.sum());
+	out << "\n"
+	    << name << "_count{call_id=\"" << callId << "\"} " << hist.count() << "\n";
+}
+
+/**
+ * @brief      Export metrics in Prometheus text format
+ *
+ * Only request types that were used at least once are included.
+ *
+ * @return     Text representation of all metrics
+ */
+std::string Metrics::exportText() const
+{
+	static const std::pair<const char*, Histogram CallStats::*> histograms[] =
+	{{"exmdb_serialize_seconds", &CallStats::serialize},
+	 {"exmdb_network_seconds", &CallStats::network},
+	 {"exmdb_deserialize_seconds", &CallStats::deserialize}};
+	static const std::pair<const char*, std::atomic<uint64_t> CallStats::*> counters[] =
+	{{"exmdb_calls_total", &CallStats::calls},
+	 {"exmdb_call_errors_total", &CallStats::errors},
+	 {"exmdb_request_bytes_total", &CallStats::requestBytes},
+	 {"exmdb_response_bytes_total", &CallStats::responseBytes}};
+	std::ostringstream out;
+	for(const auto& counter : counters)
+	{
+		out << "# TYPE " << counter.first << " counter\n";
+		for(unsigned callId = 0; callId < calls.size(); ++callId)
+			if(calls[callId].calls.load(relaxed))
+				out << counter.first << "{call_id=\"" << callId << "\"} " << (calls[callId].*counter.second).load(relaxed) << "\n";
+	}
+	for(const auto& histogram : histograms)
+	{
+		out << "# TYPE " << histogram.first << " histogram\n";
+		for(unsigned callId = 0; callId < calls.size(); ++callId)
+			if(calls[callId].calls.load(relaxed))
+				exportHistogram(out, histogram.first, callId, calls[callId].*histogram.second);
+	}
+	out << "# TYPE exmdb_errors_total counter\n";
+	for(unsigned status = 1; status < errorCodes.size(); ++status)
+		if(errorCodes[status].load(relaxed))
+			out << "exmdb_errors_total{status=\"" << status << "\"} " << errorCodes[status].load(relaxed) << "\n";
+	out << "# TYPE exmdb_reconnects_total counter\n"
+	    << "exmdb_reconnects_total " << reconnects() << "\n";
+	return out.str();
+}
+
+/**
+ * @brief      Reset all counters
+ */
+void Metrics::reset() noexcept
+{
+	for(CallStats& stats : calls)
+	{
+		stats.calls.store(0, relaxed);
+		stats.errors.store(0, relaxed);
+		stats.requestBytes.store(0, relaxed);
+		stats.responseBytes.store(0, relaxed);
+		stats.serialize.reset();
+		stats.network.reset();
+		stats.deserialize.reset();
+	}
+	for(auto& count : errorCodes)
+		count.store(0, relaxed);
+	reconnectCount.store(0, relaxed);
+}
+
+}
@@ -0,0 +1,185 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * SPDX-FileCopyrightText: 2020-2021 grommunio GmbH
+ */
+#include <algorithm>
+
+#include "IOBufferImpl.h"
+#include "NamedPropCache.h"
+#include "requests.h"
+
+namespace exmdbpp::queries
+{
+
+using namespace requests;
+using namespace structures;
+
+/**
+ * @brief      Resolve named properties
+ *
+ * Names already known (or currently being resolved by another thread) are
+ * taken from the cache, the remaining names are resolved with a single
+ * GetNamedPropIdsRequest sent using the given client.
+ *
+ * If `create` is set, names another thread found to be unresolvable
+ * are requested again.
+ *
+ * @param      client     Client to use for the request
+ * @param      homedir    Home directory of the store
+ * @param      create     Whether to create missing names
+ * @param      propnames  Names to resolve
+ *
+ * @throws     Any exception thrown by ExmdbClient::send
+ *
+ * @return     Property IDs in order of the names (0 if a name could not be resolved)
+ */
+std::vector<uint16_t> NamedPropCache::resolve(ExmdbClient& client, const std::string& homedir, bool create,
+                                              const std::vector<PropertyName>& propnames)
+{
+	std::vector<std::string> keys;
+	keys.reserve(propnames.size());
+	for(const PropertyName& propname : propnames)
+		keys.emplace_back(key(propname));
+	std::vector<Entry> entries(propnames.size());
+	std::vector<size_t> missing;
+	std::vector<std::promise<uint16_t>> promises;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Store& store = stores[homedir];
+		for(size_t i = 0; i < keys.size(); ++i)
+		{
+			auto it = store.find(keys[i]);
+			if(it != store.end())
+			{
+				entries[i] = it->second;
+				continue;
+			}
+			promises.emplace_back();
+			entries[i] = std::make_shared<const std::shared_future<uint16_t>>(promises.back().get_future().share());
+			store.emplace(keys[i], entries[i]);
+			missing.emplace_back(i);
+		}
+	}
+	if(!missing.empty())
+	{
+		std::vector<PropertyName> query;
+		query.reserve(missing.size());
+		for(size_t index : missing)
+			query.emplace_back(propnames[index]);
+		std::vector<uint16_t> propIds;
+		try
+		{
+			propIds = client.send<GetNamedPropIdsRequest>(homedir, create, query).propIds;
+			if(propIds.size() != query.size())
+				throw SerializationError("Invalid response: "+std::to_string(propIds.size())+" IDs for "+
+				                         std::to_string(query.size())+" names");
+		}
+		catch(...)
+		{
+			for(size_t i = 0; i < missing.size(); ++i)
+			{
+				promises[i].set_exception(std::current_exception());
+				forget(homedir, keys[missing[i]], entries[missing[i]]);
+			}
+			throw;
+		}
+		for(size_t i = 0; i < missing.size(); ++i)
+		{
+			promises[i].set_value(propIds[i]);
+			if(!propIds[i])
+				forget(homedir, keys[missing[i]], entries[missing[i]]);
+		}
+	}
+	std::vector<uint16_t> result(propnames.size());
+	std::vector<PropertyName> retry;
+	std::vector<size_t> retryIndices;
+	for(size_t i = 0; i < entries.size(); ++i)
+	{
+		bool failed = false;
+		try {result[i] = entries[i]->get();}
+		catch(...) {failed = true;} // Request of another thread failed
+		bool own = std::any_of(missing.begin(), missing.end(), [&](size_t index){return entries[index] == entries[i];});
+		if(!own && (failed || (create && !result[i])))
+		{
+			retry.emplace_back(propnames[i]);
+			retryIndices.emplace_back(i);
+		}
+	}
+	if(retry.empty())
+		return result;
+	std::vector<uint16_t> retried = resolve(client, homedir, create, retry);
+	for(size_t i = 0; i < retried.size(); ++i)
+		result[retryIndices[i]] = retried[i];
+	return result;
+}
+
+/**
+ * @brief      Remove all cached IDs of a store
+ *
+ * Lookups currently in progress are not affected, but their results are
+ * not cached.
+ *
+ * @param      homedir  Home directory of the store
+ */
+void NamedPropCache::invalidate(const std::string& homedir)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	stores.erase(homedir);
+}
+
+/**
+ * @brief      Remove all cached IDs
+ */
+void NamedPropCache::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	stores.clear();
+}
+
+/**
+ * @brief      Return total number of cached (or pending) IDs
+ */
+size_t NamedPropCache::size() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t count = 0;
+	for(const auto& store : stores)
+		count += store.second.size();
+	return count;
+}
+
+/**
+ * @brief      Remove entry from the cache
+ *
+ * Only removes the entry if it was not replaced in the meantime.
+ *
+ * @param      homedir  Home directory of the store
+ * @param      name     Serialized property name
+ * @param      entry    Entry to remove
+ */
+void NamedPropCache::forget(const std::string& homedir, const std::string& name, const Entry& entry)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto store = stores.find(homedir);
+	if(store == stores.end())
+		return;
+	auto it = store->second.find(name);
+	if(it != store->second.end() && it->second == entry)
+		store->second.erase(it);
+}
+
+/**
+ * @brief      Generate cache key for property name
+ *
+ * @param      propname  Property name
+ *
+ * @return     Serialized property name
+ */
+std::string NamedPropCache::key(const PropertyName& propname)
+{
+	IOBuffer buff;
+	buff.push(propname);
+	return std::string(buff.begin(), buff.end());
+}
+
+}
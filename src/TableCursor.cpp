@@ -0,0 +1,190 @@
+/*
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ * SPDX-FileCopyrightText: 2020-2021 grommunio GmbH
+ */
+#include "TableCursor.h"
+#include "constants.h"
+
+using namespace exmdbpp::constants;
+using namespace exmdbpp::requests;
+using namespace exmdbpp::structures;
+
+namespace exmdbpp::queries
+{
+
+/**
+ * @brief      Create cursor for an already loaded table
+ *
+ * The cursor takes ownership of the table and unloads it on destruction.
+ *
+ * @param      client    Client to use for requests
+ * @param      homedir   Home directory path of the store
+ * @param      tableId   ID of the loaded table
+ * @param      rowCount  Number of rows in the table
+ * @param      proptags  Tags to retrieve
+ * @param      pageSize  Maximum number of rows per request
+ * @param      prefetch  Whether to request the next page in the background
+ */
+TableCursor::TableCursor(ExmdbClient& client, const std::string& homedir, uint32_t tableId, uint32_t rowCount,
+                         const std::vector<uint32_t>& proptags, uint32_t pageSize, bool prefetch) :
+    client(client), homedir(homedir), proptags(proptags), id(tableId), rows(rowCount), pageSize(pageSize? pageSize : 1),
+    prefetch(prefetch)
+{}
+
+/**
+ * @brief      Destructor
+ *
+ * Unloads the table. Errors are silently ignored.
+ */
+TableCursor::~TableCursor()
+{
+	try {close();}
+	catch(...) {}
+}
+
+/**
+ * @brief      Load hierarchy table and create cursor
+ *
+ * @param      client       Client to use for requests
+ * @param      homedir      Home directory path of the store
+ * @param      folderId     ID of the parent folder
+ * @param      proptags     Tags to retrieve
+ * @param      recursive    Whether to include all sub-folders recursively
+ * @param      pageSize     Maximum number of rows per request
+ * @param      prefetch     Whether to request the next page in the background
+ * @param      restriction  Restriction to apply
+ *
+ * @return     Cursor owning the loaded table
+ */
+TableCursor TableCursor::hierarchy(ExmdbClient& client, const std::string& homedir, uint64_t folderId,
+                                   const std::vector<uint32_t>& proptags, bool recursive, uint32_t pageSize, bool prefetch,
+                                   const Restriction& restriction)
+{
+	auto lhtResponse = client.send<LoadHierarchyTableRequest>(homedir, folderId, "", recursive? TableFlags::DEPTH : 0,
+	                                                          restriction);
+	return TableCursor(client, homedir, lhtResponse.tableId, lhtResponse.rowCount, proptags, pageSize, prefetch);
+}
+
+/**
+ * @brief      Load content table and create cursor
+ *
+ * @param      client       Client to use for requests
+ * @param      homedir      Home directory path of the store
+ * @param      folderId     ID of the folder
+ * @param      proptags     Tags to retrieve
+ * @param      tableFlags   Table flags
+ * @param      pageSize     Maximum number of rows per request
+ * @param      prefetch     Whether to request the next page in the background
+ * @param      restriction  Restriction to apply
+ *
+ * @return     Cursor owning the loaded table
+ */
+TableCursor TableCursor::content(ExmdbClient& client, const std::string& homedir, uint64_t folderId,
+                                 const std::vector<uint32_t>& proptags, uint8_t tableFlags, uint32_t pageSize, bool prefetch,
+                                 const Restriction& restriction)
+{
+	auto lctResponse = client.send<LoadContentTableRequest>(homedir, 0, folderId, "", tableFlags, restriction);
+	return TableCursor(client, homedir, lctResponse.tableId, lctResponse.rowCount, proptags, pageSize, prefetch);
+}
+
+/**
+ * @brief      Retrieve next row
+ *
+ * The returned pointer is invalidated by the next call to next(),
+ * nextPage() or close().
+ *
+ * @return     Pointer to the row or nullptr if no more rows are available
+ */
+const TableCursor::PropvalList* TableCursor::next()
+{
+	if(pos >= page.size() && !advance())
+		return nullptr;
+	return &page[pos++];
+}
+
+/**
+ * @brief      Retrieve next page
+ *
+ * If the current page was already partially consumed by next(), only the
+ * remaining rows are returned.
+ *
+ * @return     Rows of the page or empty page if no more rows are available
+ */
+TableCursor::Page TableCursor::nextPage()
+{
+	if(pos >= page.size() && !advance())
+		return Page();
+	Page result = std::move(page);
+	result.erase(result.begin(), result.begin()+pos);
+	page.clear();
+	pos = 0;
+	return result;
+}
+
+/**
+ * @brief      Unload the table
+ *
+ * Waits for pending prefetch requests to complete. Has no effect if the
+ * table was already closed.
+ */
+void TableCursor::close()
+{
+	if(!open)
+		return;
+	open = false;
+	page.clear();
+	pos = 0;
+	if(pending.valid())
+		try {pending.get();}
+		catch(...) {}
+	client.send<UnloadTableRequest>(homedir, id);
+}
+
+/**
+ * @brief      Return number of rows in the table
+ */
+uint32_t TableCursor::rowCount() const noexcept
+{return rows;}
+
+/**
+ * @brief      Return ID of the loaded table
+ */
+uint32_t TableCursor::tableId() const noexcept
+{return id;}
+
+/**
+ * @brief      Load next page
+ *
+ * Schedules prefetching of the following page if enabled.
+ *
+ * @return     true if rows are available, false otherwise
+ */
+bool TableCursor::advance()
+{
+	page.clear();
+	pos = 0;
+	if(!open)
+		return false;
+	if(pending.valid())
+		page = pending.get();
+	else if(offset < rows)
+		page = fetch(offset);
+	else
+		return false;
+	offset = page.size() < pageSize? rows : offset+pageSize;
+	if(prefetch && offset < rows)
+		pending = std::async(std::launch::async, &TableCursor::fetch, this, offset);
+	return !page.empty();
+}
+
+/**
+ * @brief      Request page from server
+ *
+ * @param      start  Index of the first row
+ *
+ * @return     Retrieved rows
+ */
+TableCursor::Page TableCursor::fetch(uint32_t start)
+{return std::move(client.send<QueryTableRequest>(homedir, "", 0, id, proptags, start, pageSize).entries);}
+
+}
@@ -5,9 +5,15 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <optional>
 #include <unordered_set>
 
 #include "queries.h"
+#include "FolderCache.h"
+#include "FolderTree.h"
+#include "MessageReader.h"
+#include "NamedPropCache.h"
+#include "TypedTable.h"
 #include "util.h"
 #include "constants.h"
 #include "IOBufferImpl.h"
@@ -26,6 +32,8 @@ const std::vector<uint32_t> ExmdbQueries::defaultFolderProps =
 
 const uint32_t ExmdbQueries::ownerRights = 0x000007fb;
 
+const size_t ExmdbQueries::batchSize = 256;
+
 /**
  * @brief      Load propvals into predefined fields
  *
@@ -71,6 +79,10 @@ void Folder::init(const std::vector<structures::TaggedPropval>& propvals, uint32
 			container = tp.value.str; break;
 		case PropTag::PARENTFOLDERID:
 			parentId = tp.value.u64; break;
+		case PropTag::CHANGENUMBER:
+			changeNumber = tp.value.u64; break;
+		case PropTag::LASTMODIFICATIONTIME:
+			lastModified = tp.value.u64; break;
 		}
 	}
 }
@@ -96,6 +108,58 @@ FolderList::FolderList(const std::vector<std::vector<structures::TaggedPropval>>
 		 folders.emplace_back(entry, syncToMobileTag);
 }
 
+/**
+ * @brief      Interpret columnar table as folder list
+ *
+ * @param      table     Table to interpret
+ */
+FolderList::FolderList(const ColumnarTableResponse& table, uint32_t syncToMobileTag)
+{
+	folders.resize(table.rows);
+	for(const ColumnarTableResponse::Column& column : table.columns)
+	{
+		if(column.tag == syncToMobileTag && column.kind == ColumnarTableResponse::Column::INTEGER)
+		{
+			for(size_t row = 0; row < table.rows; ++row)
+				folders[row].syncToMobile = column.value(row);
+			continue;
+		}
+		uint64_t Folder::* integer = nullptr;
+		std::string Folder::* string = nullptr;
+		switch(column.tag)
+		{
+		case PropTag::FOLDERID:
+			integer = &Folder::folderId; break;
+		case PropTag::PARENTFOLDERID:
+			integer = &Folder::parentId; break;
+		case PropTag::CREATIONTIME:
+			integer = &Folder::creationTime; break;
+		case PropTag::CHANGENUMBER:
+			integer = &Folder::changeNumber; break;
+		case PropTag::LASTMODIFICATIONTIME:
+			integer = &Folder::lastModified; break;
+		case PropTag::DISPLAYNAME:
+			string = &Folder::displayName; break;
+		case PropTag::COMMENT:
+			string = &Folder::comment; break;
+		case PropTag::CONTAINERCLASS:
+			string = &Folder::container; break;
+		}
+		if(integer)
+			for(size_t row = 0; row < table.rows; ++row)
+				folders[row].*integer = column.value(row);
+		else if(string)
+			for(size_t row = 0; row < table.rows; ++row)
+				folders[row].*string = column.bytes(row);
+	}
+}
+
+/**
+ * @brief      Check whether no changes were applied
+ */
+bool FolderChanges::empty() const noexcept
+{return added.empty() && modified.empty() && removed.empty();}
+
 /**
  * @brief      Interpret query table response as folder member list
  *
@@ -163,9 +227,7 @@ ExmdbQueries::PropvalTable ExmdbQueries::findFolder(const std::string& homedir,
 	parent = parent? parent: util::makeEidEx(1, PrivateFid::ROOT);
 	Restriction res = Restriction::CONTENT(fuzzyLevel, 0, TaggedPropval(PropTag::DISPLAYNAME, name));
 	auto lhtResponse = send<LoadHierarchyTableRequest>(homedir, parent, "", recursive? TableFlags::DEPTH : 0, res);
-	auto qtResponse = send<QueryTableRequest>(homedir, "", 0, lhtResponse.tableId, proptags, 0, lhtResponse.rowCount);
-	send<UnloadTableRequest>(homedir, lhtResponse.tableId);
-	return std::move(qtResponse.entries);
+	return queryAndUnload(homedir, lhtResponse.tableId, proptags, 0, lhtResponse.rowCount);
 }
 
 /**
@@ -206,9 +268,79 @@ ExmdbQueries::PropvalTable ExmdbQueries::listFolders(const std::string& homedir,
 {
 	auto lhtResponse = send<LoadHierarchyTableRequest>(homedir, parent, "", recursive? TableFlags::DEPTH : 0, restriction);
 	limit = offset || limit || lhtResponse.rowCount < limit? limit : lhtResponse.rowCount;
-	auto qtResponse = send<QueryTableRequest>(homedir, "", 0, lhtResponse.tableId, proptags, offset, limit);
-	send<UnloadTableRequest>(homedir, lhtResponse.tableId);
-	return std::move(qtResponse.entries);
+	return queryAndUnload(homedir, lhtResponse.tableId, proptags, offset, limit);
+}
+
+/**
+ * @brief      List sub-folders of a given folder in columnar format
+ *
+ * Same as listFolders(), but returns the result as ColumnarTableResponse.
+ *
+ * @param      homedir      Home directory path of the domain
+ * @param      parent       ID of the parent folder
+ * @param      recursive    Recursively list sub-folders
+ * @param      proptags     Tags to return
+ * @param      offset       Number of results to skip
+ * @param      limit        Limit number of results
+ * @param      restriction  Restriction to apply
+ *
+ * @return     Table columns. Can be converted to FolderList for easier access.
+ */
+ColumnarTableResponse ExmdbQueries::listFoldersColumnar(const std::string& homedir, uint64_t parent, bool recursive,
+                                                        const std::vector<uint32_t>& proptags, uint32_t offset,
+                                                        uint32_t limit, const structures::Restriction& restriction)
+{
+	auto lhtResponse = send<LoadHierarchyTableRequest>(homedir, parent, "", recursive? TableFlags::DEPTH : 0, restriction);
+	limit = offset || limit || lhtResponse.rowCount < limit? limit : lhtResponse.rowCount;
+	Pipeline pipeline(*this);
+	size_t query = pipeline.add<QueryTableRequest>(homedir, "", 0, lhtResponse.tableId, proptags, offset, limit);
+	size_t unload = pipeline.add<UnloadTableRequest>(homedir, lhtResponse.tableId);
+	pipeline.execute();
+	ColumnarTableResponse columns = pipeline.get<QueryTableRequest, ColumnarTableResponse>(query, proptags);
+	pipeline.get<UnloadTableRequest>(unload);
+	return columns;
+}
+
+/**
+ * @brief      Generate properties of a new public folder
+ *
+ * String and binary properties are not copied, `tmpbuff` and the strings
+ * must therefore remain unchanged while the propvals are in use.
+ *
+ * @param      propvals    Vector to store the properties in (previous contents are discarded)
+ * @param      tmpbuff     Buffer to store binary data in (previous contents are discarded)
+ * @param      domainId    Domain ID
+ * @param      changeNum   Change number allocated for the folder
+ * @param      now         Creation time
+ * @param      folderName  Name of the new folder
+ * @param      container   Folder container class
+ * @param      comment     Comment to attach
+ * @param      parentId    Id of the parent folder
+ */
+static void newFolderProps(std::vector<TaggedPropval>& propvals, IOBuffer& tmpbuff, uint32_t domainId, uint64_t changeNum,
+                           uint64_t now, const std::string& folderName, const std::string& container,
+                           const std::string& comment, uint64_t parentId)
+{
+	SizedXID xid(22, GUID::fromDomainId(domainId), util::valueToGc(be64toh(changeNum)));
+	propvals.clear();
+	tmpbuff.clear();
+	propvals.reserve(10);
+	tmpbuff.reserve(128);
+	propvals.emplace_back(PropTag::PARENTFOLDERID, parentId);
+	propvals.emplace_back(PropTag::FOLDERTYPE, FolderType::GENERIC);
+	propvals.emplace_back(PropTag::DISPLAYNAME, folderName, false);
+	propvals.emplace_back(PropTag::COMMENT, comment, false);
+	propvals.emplace_back(PropTag::CREATIONTIME, now);
+	propvals.emplace_back(PropTag::LASTMODIFICATIONTIME, now);
+	propvals.emplace_back(PropTag::CHANGENUMBER, changeNum);
+
+	xid.writeXID(tmpbuff);
+	size_t offset = tmpbuff.size();
+	tmpbuff.push(xid);
+	propvals.emplace_back(PropTag::CHANGEKEY, tmpbuff.data(), uint32_t(offset), false);
+	propvals.emplace_back(PropTag::PREDECESSORCHANGELIST, tmpbuff.data()+offset, uint32_t(tmpbuff.size()-offset), false);
+	if(!container.empty())
+		propvals.emplace_back(PropTag::CONTAINERCLASS, container, false);
 }
 
 /**
@@ -229,29 +361,73 @@ uint64_t ExmdbQueries::createFolder(const std::string& homedir, uint32_t domainI
 {
 	auto acResponse = send<AllocateCnRequest>(homedir);
 	std::vector<TaggedPropval> propvals;
-	uint64_t now = util::ntTime();
-	SizedXID xid(22, GUID::fromDomainId(domainId), util::valueToGc(be64toh(acResponse.changeNum)));
 	IOBuffer tmpbuff;
 	parentId = parentId? parentId : util::makeEidEx(1, PublicFid::IPMSUBTREE);
-	propvals.reserve(10);
-	tmpbuff.reserve(128);
-	propvals.emplace_back(PropTag::PARENTFOLDERID, parentId);
-	propvals.emplace_back(PropTag::FOLDERTYPE, FolderType::GENERIC);
-	propvals.emplace_back(PropTag::DISPLAYNAME, folderName, false);
-	propvals.emplace_back(PropTag::COMMENT, comment, false);
-	propvals.emplace_back(PropTag::CREATIONTIME, now);
-	propvals.emplace_back(PropTag::LASTMODIFICATIONTIME, now);
-	propvals.emplace_back(PropTag::CHANGENUMBER, acResponse.changeNum);
+	newFolderProps(propvals, tmpbuff, domainId, acResponse.changeNum, util::ntTime(), folderName, container, comment, parentId);
+	uint64_t folderId = send<CreateFolderByPropertiesRequest>(homedir, 0, propvals).folderId;
+	if(folderCache)
+		folderCache->invalidateChildren(homedir, parentId);
+	return folderId;
+}
 
-	xid.writeXID(tmpbuff);
-	propvals.emplace_back(PropTag::CHANGEKEY, tmpbuff.data(), uint32_t(tmpbuff.size()));
+/**
+ * @brief      Create multiple public folders
+ *
+ * Uses the `displayName`, `container`, `comment` and `parentId` (0 for
+ * IPM_SUBTREE) fields of each folder. Other fields are ignored.
+ *
+ * Folders are processed in batches of at most `batchSize` folders. For each
+ * batch, change numbers are allocated in a single round trip, followed by a
+ * second round trip creating the folders.
+ * Parent folders must therefore already exist before the call.
+ *
+ * @param      homedir     Home directory path of the domain
+ * @param      domainId    Domain ID
+ * @param      folders     Folders to create
+ *
+ * @throws     ExmdbProtocolError  Change number allocation failed (folders of previous batches are already created)
+ *
+ * @return     IDs of the folders in order of creation (0 for folders that could not be created)
+ */
+std::vector<uint64_t> ExmdbQueries::createFolders(const std::string& homedir, uint32_t domainId,
+                                                  const std::vector<Folder>& folders)
+{
+	std::vector<uint64_t> folderIds(folders.size(), 0);
+	Pipeline pipeline(*this);
+	std::vector<uint64_t> changeNums;
+	std::vector<TaggedPropval> propvals;
+	IOBuffer tmpbuff;
+	uint64_t now = util::ntTime(), ipmSubtree = util::makeEidEx(1, PublicFid::IPMSUBTREE);
+	for(size_t offset = 0; offset < folders.size(); offset += batchSize)
+	{
+		size_t count = std::min(batchSize, folders.size()-offset);
+		pipeline.clear();
+		for(size_t i = 0; i < count; ++i)
+			pipeline.add<AllocateCnRequest>(homedir);
+		pipeline.execute();
+		changeNums.clear();
+		for(size_t i = 0; i < count; ++i)
+			changeNums.emplace_back(pipeline.get<AllocateCnRequest>(i).changeNum);
 
-	size_t offset = tmpbuff.size();
-	tmpbuff.push(xid);
-	propvals.emplace_back(PropTag::PREDECESSORCHANGELIST, tmpbuff.data()+offset, uint32_t(tmpbuff.size()-offset));
-	if(!container.empty())
-		propvals.emplace_back(PropTag::CONTAINERCLASS, container);
-	return send<CreateFolderByPropertiesRequest>(homedir, 0, propvals).folderId;
+		pipeline.clear();
+		for(size_t i = 0; i < count; ++i)
+		{
+			const Folder& folder = folders[offset+i];
+			newFolderProps(propvals, tmpbuff, domainId, changeNums[i], now, folder.displayName, folder.container,
+			               folder.comment, folder.parentId? folder.parentId : ipmSubtree);
+			pipeline.add<CreateFolderByPropertiesRequest>(homedir, 0, propvals);
+		}
+		pipeline.execute();
+		for(size_t i = 0; i < count; ++i)
+		{
+			const Folder& folder = folders[offset+i];
+			try {folderIds[offset+i] = pipeline.get<CreateFolderByPropertiesRequest>(i).folderId;}
+			catch(const ExmdbProtocolError&) {}
+			if(folderCache)
+				folderCache->invalidateChildren(homedir, folder.parentId? folder.parentId : ipmSubtree);
+		}
+	}
+	return folderIds;
 }
 
 /**
@@ -270,7 +446,48 @@ bool ExmdbQueries::deleteFolder(const std::string& homedir, uint64_t folderId, b
 {
 	if(clear)
 		send<EmptyFolderRequest>(homedir, 0, "", folderId, EmptyFolderRequest::ALL);
-	return send<DeleteFolderRequest>(homedir, 0, folderId, true).success;
+	bool success = send<DeleteFolderRequest>(homedir, 0, folderId, true).success;
+	if(folderCache)
+		folderCache->invalidate(homedir, folderId);
+	return success;
+}
+
+/**
+ * @brief      Delete multiple folders
+ *
+ * Same as calling deleteFolder() for each folder, but the requests are
+ * pipelined, requiring one round trip per `batchSize` folders.
+ *
+ * @param      homedir    Home directory path of the domain
+ * @param      folderIds  IDs of the folders to delete
+ * @param      clear      Clear folder contents before deletion
+ *
+ * @return     Number of folders successfully deleted
+ */
+size_t ExmdbQueries::deleteFolders(const std::string& homedir, const std::vector<uint64_t>& folderIds, bool clear)
+{
+	Pipeline pipeline(*this);
+	size_t deleted = 0;
+	for(size_t offset = 0; offset < folderIds.size(); offset += batchSize)
+	{
+		size_t count = std::min(batchSize, folderIds.size()-offset);
+		pipeline.clear();
+		for(size_t i = 0; i < count; ++i)
+		{
+			uint64_t folderId = folderIds[offset+i];
+			if(clear)
+				pipeline.add<EmptyFolderRequest>(homedir, 0, "", folderId, EmptyFolderRequest::ALL);
+			pipeline.add<DeleteFolderRequest>(homedir, 0, folderId, true);
+		}
+		pipeline.execute();
+		for(size_t i = clear? 1 : 0; i < pipeline.size(); i += clear? 2 : 1)
+			try {deleted += pipeline.get<DeleteFolderRequest>(i).success;}
+			catch(const ExmdbProtocolError&) {}
+		if(folderCache)
+			for(size_t i = 0; i < count; ++i)
+				folderCache->invalidate(homedir, folderIds[offset+i]);
+	}
+	return deleted;
 }
 
 /**
@@ -285,32 +502,117 @@ ExmdbQueries::PropvalTable ExmdbQueries::getFolderMemberList(const std::string&
 {
 	auto lptResponse = send<LoadPermissionTableRequest>(homedir, folderId, 0);
 	uint32_t proptags[] = {PropTag::MEMBERID, PropTag::SMTPADDRESS, PropTag::MEMBERNAME, PropTag::MEMBERRIGHTS};
-	auto qtResponse = send<QueryTableRequest>(homedir, "", 0, lptResponse.tableId, proptags, 0, lptResponse.rowCount);
-	send<UnloadTableRequest>(homedir, lptResponse.tableId);
-	return qtResponse.entries;
+	return queryAndUnload(homedir, lptResponse.tableId, proptags, 0, lptResponse.rowCount);
 }
 
+/**
+ * @brief      Get ID of a folder by name
+ *
+ * Uses the folder cache if set. Folders that are not found are not cached.
+ *
+ * @param      homedir   Home directory path of the store
+ * @param      parentId  ID of the parent folder
+ * @param      name      Name of the folder
+ *
+ * @return     ID of the folder or 0 if not found
+ */
+uint64_t ExmdbQueries::folderIdByName(const std::string& homedir, uint64_t parentId, const std::string& name)
+{
+	if(folderCache)
+		if(auto cached = folderCache->findId(homedir, parentId, name))
+			return *cached;
+	uint64_t folderId = send<GetFolderByNameRequest>(homedir, parentId, name).folderId;
+	if(folderCache && folderId)
+		folderCache->storeId(homedir, parentId, name, folderId);
+	return folderId;
+}
 
-uint32_t ExmdbQueries::setFolderMember(const std::string& homedir, uint64_t folderId, const FolderMemberList::Member& existing,
-                                       uint32_t rights, PermissionMode mode)
+/**
+ * @brief      Retrieve table contents and unload the table
+ *
+ * Both requests are pipelined, requiring only a single round trip.
+ *
+ * @param      homedir   Home directory path of the store
+ * @param      tableId   ID of the loaded table
+ * @param      proptags  Tags to return
+ * @param      offset    Number of rows to skip
+ * @param      limit     Maximum number of rows to return
+ *
+ * @return     Table of tagged propvals
+ */
+ExmdbQueries::PropvalTable ExmdbQueries::queryAndUnload(const std::string& homedir, uint32_t tableId,
+                                                        const Collection<uint16_t, uint32_t>& proptags,
+                                                        uint32_t offset, uint32_t limit)
 {
-	if(mode == ADD)
+	Pipeline pipeline(*this);
+	size_t query = pipeline.add<QueryTableRequest>(homedir, "", 0, tableId, proptags, offset, limit);
+	size_t unload = pipeline.add<UnloadTableRequest>(homedir, tableId);
+	pipeline.execute();
+	auto qtResponse = pipeline.get<QueryTableRequest>(query);
+	pipeline.get<UnloadTableRequest>(unload);
+	return std::move(qtResponse.entries);
+}
+
+
+/**
+ * @brief      Compute permission change for a folder member
+ *
+ * String properties reference the member's mail address, which must
+ * therefore remain unchanged while the permission data is in use.
+ *
+ * @param      existing     Current member entry (id 0 if not a member yet)
+ * @param      rights       Bitmask of member rights
+ * @param      mode         Whether to add, remove or overwrite permissions
+ * @param      permission   Permission data to store the change in
+ *
+ * @return     New rights value
+ */
+static uint32_t memberPermission(const FolderMemberList::Member& existing, uint32_t rights, ExmdbQueries::PermissionMode mode,
+                                 PermissionData& permission)
+{
+	if(mode == ExmdbQueries::ADD)
 		rights |= existing.rights;
-	else if(mode == REMOVE)
+	else if(mode == ExmdbQueries::REMOVE)
 		rights = existing.rights & ~rights;
 	if(rights == existing.rights)
 		return rights;
-	PermissionData permissions[1];
 	if(rights == 0)
-		permissions[0] = PermissionData(PermissionData::REMOVE_ROW, {TaggedPropval(PropTag::MEMBERID, existing.id)});
+		permission = PermissionData(PermissionData::REMOVE_ROW, {TaggedPropval(PropTag::MEMBERID, existing.id)});
 	else if(!existing.id)
-		permissions[0] = PermissionData(PermissionData::ADD_ROW, {TaggedPropval(PropTag::SMTPADDRESS, existing.mail, false),
+		permission = PermissionData(PermissionData::ADD_ROW, {TaggedPropval(PropTag::SMTPADDRESS, existing.mail, false),
 		                            TaggedPropval(PropTag::MEMBERRIGHTS, rights)});
 	else
-		permissions[0] = PermissionData(PermissionData::MODIFY_ROW, {TaggedPropval(PropTag::SMTPADDRESS, existing.mail, false),
+		permission = PermissionData(PermissionData::MODIFY_ROW, {TaggedPropval(PropTag::SMTPADDRESS, existing.mail, false),
 		                            TaggedPropval(PropTag::MEMBERRIGHTS, rights),
 		                            TaggedPropval(PropTag::MEMBERID, existing.id)});
-	send<UpdateFolderPermissionRequest>(homedir, folderId, false, permissions);
+	return rights;
+}
+
+/**
+ * @brief      Find member by mail address
+ *
+ * @param      members   Member list to search
+ * @param      username  Mail address of the member
+ *
+ * @return     Member entry, or empty entry with mail address set if not found
+ */
+static FolderMemberList::Member findMember(const FolderMemberList& members, const std::string& username)
+{
+	auto it = std::find_if(members.members.begin(), members.members.end(),
+	                       [&username](const FolderMemberList::Member& m)
+	                       {return !strcasecmp(m.mail.c_str(), username.c_str());});
+	FolderMemberList::Member existing = it == members.members.end()? FolderMemberList::Member() : *it;
+	existing.mail = username;
+	return existing;
+}
+
+uint32_t ExmdbQueries::setFolderMember(const std::string& homedir, uint64_t folderId, const FolderMemberList::Member& existing,
+                                       uint32_t rights, PermissionMode mode)
+{
+	PermissionData permissions[1];
+	rights = memberPermission(existing, rights, mode, permissions[0]);
+	if(rights != existing.rights)
+		send<UpdateFolderPermissionRequest>(homedir, folderId, false, permissions);
 	return rights;
 }
 
@@ -328,13 +630,136 @@ uint32_t ExmdbQueries::setFolderMember(const std::string& homedir, uint64_t fold
 uint32_t ExmdbQueries::setFolderMember(const std::string& homedir, uint64_t folderId, const std::string& username,
                                        uint32_t rights, PermissionMode mode)
 {
-	FolderMemberList members = getFolderMemberList(homedir, folderId);
-	auto it = std::find_if(members.members.begin(), members.members.end(),
-	                       [&username](const FolderMemberList::Member& m)
-	                       {return !strcasecmp(m.mail.c_str(), username.c_str());});
-	FolderMemberList::Member existing = it == members.members.end()? FolderMemberList::Member() : *it;
-	existing.mail = username;
-	return setFolderMember(homedir, folderId, existing, rights, mode);
+	return setFolderMember(homedir, folderId, findMember(getFolderMemberList(homedir, folderId), username), rights, mode);
+}
+
+/**
+ * @brief      Modify member rights of a user for multiple folders
+ *
+ * Folders are processed in batches of at most `batchSize` folders. For each
+ * batch, the permission tables are loaded and all updates are sent
+ * pipelined, requiring three round trips per batch.
+ *
+ * If requests for some folders fail, the remaining folders are still
+ * updated before the first error is reported.
+ *
+ * @param      homedir    Home directory path of the domain
+ * @param      folderIds  IDs of the folders
+ * @param      username   Username to modify
+ * @param      rights     Bitmask of member rights
+ * @param      mode       Whether to add, remove or overwrite permissions
+ *
+ * @throws     ExmdbProtocolError  Loading or updating the permissions of a folder failed
+ *
+ * @return     Number of folders modified
+ */
+size_t ExmdbQueries::setFolderMemberBatch(const std::string& homedir, const std::vector<uint64_t>& folderIds,
+                                          const std::string& username, uint32_t rights, PermissionMode mode)
+{
+	static const uint32_t proptags[] = {PropTag::MEMBERID, PropTag::SMTPADDRESS, PropTag::MEMBERNAME, PropTag::MEMBERRIGHTS};
+	struct Target
+	{
+		uint64_t folderId;
+		uint32_t tableId;
+		uint32_t rowCount;
+		FolderMemberList::Member existing;
+		PermissionData permission[1];
+	};
+	std::exception_ptr error;
+	Pipeline pipeline(*this);
+	std::vector<Target> targets;
+	std::vector<Target*> modified;
+	size_t count = 0;
+	for(size_t offset = 0; offset < folderIds.size(); offset += batchSize)
+	{
+		size_t chunk = std::min(batchSize, folderIds.size()-offset);
+		pipeline.clear();
+		for(size_t i = 0; i < chunk; ++i)
+			pipeline.add<LoadPermissionTableRequest>(homedir, folderIds[offset+i], 0);
+		pipeline.execute();
+		targets.clear();
+		for(size_t i = 0; i < chunk; ++i)
+			try
+			{
+				auto table = pipeline.get<LoadPermissionTableRequest>(i);
+				targets.emplace_back(Target{folderIds[offset+i], table.tableId, table.rowCount, {}, {}});
+			}
+			catch(const ExmdbProtocolError&)
+			{error = error? error : std::current_exception();}
+
+		pipeline.clear();
+		for(const Target& target : targets)
+		{
+			pipeline.add<QueryTableRequest>(homedir, "", 0, target.tableId, proptags, 0, target.rowCount);
+			pipeline.add<UnloadTableRequest>(homedir, target.tableId);
+		}
+		pipeline.execute();
+		modified.clear();
+		for(size_t i = 0; i < targets.size(); ++i)
+			try
+			{
+				FolderMemberList members(pipeline.get<QueryTableRequest>(2*i));
+				pipeline.get<UnloadTableRequest>(2*i+1);
+				targets[i].existing = findMember(members, username);
+				if(memberPermission(targets[i].existing, rights, mode, targets[i].permission[0]) != targets[i].existing.rights)
+					modified.emplace_back(&targets[i]);
+			}
+			catch(const ExmdbProtocolError&)
+			{error = error? error : std::current_exception();}
+
+		pipeline.clear();
+		for(const Target* target : modified)
+			pipeline.add<UpdateFolderPermissionRequest>(homedir, target->folderId, false, target->permission);
+		pipeline.execute();
+		for(size_t i = 0; i < modified.size(); ++i)
+			try
+			{
+				pipeline.get<UpdateFolderPermissionRequest>(i);
+				++count;
+			}
+			catch(const ExmdbProtocolError&)
+			{error = error? error : std::current_exception();}
+	}
+	if(error)
+		std::rethrow_exception(error);
+	return count;
+}
+
+/**
+ * @brief      Modify member rights of a user for a folder and all its sub-folders
+ *
+ * Sub-folders are determined with a single recursive hierarchy table, the
+ * permissions are then updated with setFolderMemberBatch().
+ *
+ * @param      homedir    Home directory path of the domain
+ * @param      folderId   ID of the root folder
+ * @param      username   Username to modify
+ * @param      rights     Bitmask of member rights
+ * @param      mode       Whether to add, remove or overwrite permissions
+ *
+ * @throws     ExmdbProtocolError  Loading or updating the permissions of a folder failed
+ *
+ * @return     Number of folders modified
+ */
+size_t ExmdbQueries::setSubtreeMember(const std::string& homedir, uint64_t folderId, const std::string& username,
+                                      uint32_t rights, PermissionMode mode)
+{
+	using SubfolderTable = TypedTable<Field<PropTag::FOLDERID, uint64_t>>;
+	auto subfolders = send<LoadHierarchyTableRequest>(homedir, folderId, "", TableFlags::DEPTH);
+	Pipeline pipeline(*this);
+	size_t query = pipeline.add<QueryTableRequest>(homedir, "", 0, subfolders.tableId, SubfolderTable::proptags, 0,
+	                                               subfolders.rowCount);
+	size_t unload = pipeline.add<UnloadTableRequest>(homedir, subfolders.tableId);
+	pipeline.execute();
+	SubfolderTable table = pipeline.get<QueryTableRequest, SubfolderTable>(query);
+	pipeline.get<UnloadTableRequest>(unload);
+	std::vector<uint64_t> folderIds;
+	folderIds.reserve(table.size()+1);
+	folderIds.emplace_back(folderId);
+	for(const auto& subfolder : table)
+		if(subfolder.has<PropTag::FOLDERID>())
+			folderIds.emplace_back(subfolder.get<PropTag::FOLDERID>());
+	return setFolderMemberBatch(homedir, folderIds, username, rights, mode);
 }
 
 /**
@@ -413,13 +838,54 @@ ExmdbQueries::ProblemList ExmdbQueries::setStoreProperties(const std::string& ho
                                                            const std::vector<TaggedPropval>& propvals)
 {return send<SetStorePropertiesRequest>(homedir, cpid, propvals).problems;}
 
+/**
+ * @brief      Set folder cache
+ *
+ * If set, folder lookups by name and getFolder() use cached results where
+ * possible. Folder modifications made through this client invalidate the
+ * affected entries. The cache can be shared between multiple clients.
+ *
+ * @param      cache  Cache to use or nullptr to disable caching
+ */
+void ExmdbQueries::setFolderCache(std::shared_ptr<FolderCache> cache) noexcept
+{folderCache = std::move(cache);}
+
+/**
+ * @brief      Return folder cache
+ */
+const std::shared_ptr<FolderCache>& ExmdbQueries::getFolderCache() const noexcept
+{return folderCache;}
+
+/**
+ * @brief      Set named property cache
+ *
+ * If set, resolveNamedProperties() only queries names not found in the cache.
+ * The cache can be shared between multiple clients.
+ *
+ * @param      cache  Cache to use or nullptr to disable caching
+ */
+void ExmdbQueries::setNamedPropCache(std::shared_ptr<NamedPropCache> cache) noexcept
+{namedPropCache = std::move(cache);}
+
+/**
+ * @brief      Return named property cache
+ */
+const std::shared_ptr<NamedPropCache>& ExmdbQueries::getNamedPropCache() const noexcept
+{return namedPropCache;}
+
 /**
  * @brief      Unload the users store
  *
  * @param      homedir   Home directory path of the user
  */
 void ExmdbQueries::unloadStore(const std::string& homedir)
-{send<UnloadStoreRequest>(homedir);}
+{
+	send<UnloadStoreRequest>(homedir);
+	if(folderCache)
+		folderCache->invalidate(homedir);
+	if(namedPropCache)
+		namedPropCache->invalidate(homedir);
+}
 
 
 /**
@@ -434,7 +900,12 @@ void ExmdbQueries::unloadStore(const std::string& homedir)
  */
 ExmdbQueries::ProblemList ExmdbQueries::setFolderProperties(const std::string& homedir, uint32_t cpid, uint64_t folderId,
                                                             const std::vector<TaggedPropval>& propvals)
-{return send<SetFolderPropertiesRequest>(homedir, cpid, folderId, propvals).problems;}
+{
+	auto response = send<SetFolderPropertiesRequest>(homedir, cpid, folderId, propvals);
+	if(folderCache)
+		folderCache->invalidate(homedir, folderId);
+	return std::move(response.problems);
+}
 
 /**
  * @brief      Get folder properties
@@ -450,6 +921,27 @@ ExmdbQueries::PropvalList ExmdbQueries::getFolderProperties(const std::string& h
                                                             const std::vector<uint32_t>& proptags)
 {return send<GetFolderPropertiesRequest>(homedir, cpid, folderId, proptags).propvals;}
 
+/**
+ * @brief      Get basic folder properties
+ *
+ * Uses the folder cache if set.
+ *
+ * @param      homedir   Home directory path of the domain
+ * @param      folderId  ID of the folder
+ *
+ * @return     Folder object with default folder properties
+ */
+Folder ExmdbQueries::getFolder(const std::string& homedir, uint64_t folderId)
+{
+	if(folderCache)
+		if(auto cached = folderCache->findFolder(homedir, folderId))
+			return *std::move(cached);
+	Folder folder(send<GetFolderPropertiesRequest>(homedir, 0, folderId, defaultFolderProps));
+	if(folderCache && folder.folderId)
+		folderCache->storeFolder(homedir, folder);
+	return folder;
+}
+
 /**
  * @brief      Get store properties
  *
@@ -486,6 +978,9 @@ void ExmdbQueries::removeStoreProperties(const std::string& homedir, const std::
 /**
  * @brief       Get grommunio-sync state for user
  *
+ * Requests for all device folders are pipelined stage by stage, so the
+ * number of round trips does not depend on the number of devices.
+ *
  * @param       homedir     Home directory path of the user
  * @param       folderName  Name of the folder containing sync data
  *
@@ -493,37 +988,92 @@ void ExmdbQueries::removeStoreProperties(const std::string& homedir, const std::
  */
 ExmdbQueries::SyncData ExmdbQueries::getSyncData(const std::string& homedir, const std::string& folderName)
 {
+	using SubfolderTable = TypedTable<Field<PropTag::FOLDERID, uint64_t>, Field<PropTag::DISPLAYNAME, std::string_view>>;
+	using MessageTable = TypedTable<Field<PropTag::MID, uint64_t>>;
+	struct Device
+	{
+		std::string_view name;
+		uint64_t folderId;
+		uint32_t tableId;
+		uint32_t rowCount;
+		uint64_t messageId;
+	};
 	uint64_t parentFolderID = util::makeEidEx(1, PublicFid::ROOT);
-	uint32_t fidTags[] = {PropTag::FOLDERID, PropTag::DISPLAYNAME};
 	uint32_t bodyTag[] = {PropTag::BODY};
-	uint32_t midTag[] = {PropTag::MID};
-	Restriction ddFilter =
+	static const Restriction ddFilter =
 	        Restriction::AND({Restriction::PROPERTY(Restriction::EQ, 0, TaggedPropval(PropTag::DISPLAYNAME, "devicedata")),
 	                          Restriction::PROPERTY(Restriction::EQ, 0, TaggedPropval(PropTag::MESSAGECLASS, "IPM.Note.GrommunioState"))});
 
 	SyncData data;
+	Pipeline pipeline(*this);
+
+	uint64_t folderId = folderIdByName(homedir, parentFolderID, folderName);
+	auto subfolders = send<LoadHierarchyTableRequest>(homedir, folderId, "", 0);
+	size_t query = pipeline.add<QueryTableRequest>(homedir, "", 0, subfolders.tableId, SubfolderTable::proptags, 0,
+	                                               subfolders.rowCount);
+	size_t unload = pipeline.add<UnloadTableRequest>(homedir, subfolders.tableId);
+	pipeline.execute();
+	SubfolderTable subfolderIDs = pipeline.get<QueryTableRequest, SubfolderTable>(query);
+	pipeline.get<UnloadTableRequest>(unload);
+
+	std::vector<Device> devices;
+	devices.reserve(subfolderIDs.size());
+	for(const auto& subfolder : subfolderIDs)
+		if(subfolder.has<PropTag::FOLDERID>() && subfolder.has<PropTag::DISPLAYNAME>())
+			devices.emplace_back(Device{subfolder.get<PropTag::DISPLAYNAME>(), subfolder.get<PropTag::FOLDERID>(), 0, 0, 0});
+	if(devices.empty())
+		return data;
 
-	auto folder = send<GetFolderByNameRequest>(homedir, parentFolderID, folderName);
-	auto subfolders = send<LoadHierarchyTableRequest>(homedir, folder.folderId, "", 0);
-	data.reserve(subfolders.rowCount);
-	auto subfolderIDs = send<QueryTableRequest>(homedir, "", 0, subfolders.tableId, fidTags, 0, subfolders.rowCount);
-	send<UnloadTableRequest>(homedir, subfolders.tableId);
-	for(const auto& subfolder: subfolderIDs.entries)
+	pipeline.clear();
+	for(const Device& device : devices)
+		pipeline.add<LoadContentTableRequest>(homedir, 0, device.folderId, "", 2, ddFilter);
+	pipeline.execute();
+	std::exception_ptr error;
+	std::vector<Device*> loaded;
+	loaded.reserve(devices.size());
+	for(size_t i = 0; i < devices.size(); ++i)
+		try
+		{
+			auto content = pipeline.get<LoadContentTableRequest>(i);
+			devices[i].tableId = content.tableId;
+			devices[i].rowCount = content.rowCount;
+			loaded.emplace_back(&devices[i]);
+		}
+		catch(const ExmdbProtocolError&)
+		{error = error? error : std::current_exception();}
+
+	pipeline.clear();
+	for(const Device* device : loaded)
 	{
-		if(subfolder.size() != 2 || subfolder[0].tag != PropTag::FOLDERID || subfolder[1].tag != PropTag::DISPLAYNAME)
-			continue;
-		auto content = send<LoadContentTableRequest>(homedir, 0, subfolder[0].value.u64, "", 2, ddFilter);
-		auto table = send<QueryTableRequest>(homedir, "", 0, content.tableId, midTag, 0, content.rowCount);
-		send<UnloadTableRequest>(homedir, content.tableId);
-		if(table.entries.empty())
-			continue;
-		auto& msgobject = table.entries[0];
-		if(msgobject.size() != 1 || msgobject[0].tag != PropTag::MID)
+		pipeline.add<QueryTableRequest>(homedir, "", 0, device->tableId, MessageTable::proptags, 0, device->rowCount);
+		pipeline.add<UnloadTableRequest>(homedir, device->tableId);
+	}
+	pipeline.execute();
+	if(error)
+		std::rethrow_exception(error);
+	std::vector<Device*> found;
+	found.reserve(loaded.size());
+	for(size_t i = 0; i < loaded.size(); ++i)
+	{
+		MessageTable table = pipeline.get<QueryTableRequest, MessageTable>(2*i);
+		pipeline.get<UnloadTableRequest>(2*i+1);
+		if(!table.size() || !table[0].has<PropTag::MID>())
 			continue;
-		auto message = send<GetMessagePropertiesRequest>(homedir, "", 0, msgobject[0].value.u64, bodyTag);
+		loaded[i]->messageId = table[0].get<PropTag::MID>();
+		found.emplace_back(loaded[i]);
+	}
+
+	pipeline.clear();
+	for(const Device* device : found)
+		pipeline.add<GetMessagePropertiesRequest>(homedir, "", 0, device->messageId, bodyTag);
+	pipeline.execute();
+	data.reserve(found.size());
+	for(size_t i = 0; i < found.size(); ++i)
+	{
+		auto message = pipeline.get<GetMessagePropertiesRequest>(i);
 		if(message.propvals.size() != 1 || message.propvals[0].tag != PropTag::BODY)
 			continue;
-		data.emplace(subfolder[1].value.str, message.propvals[0].value.str);
+		data.emplace(found[i]->name, message.propvals[0].value.str);
 	}
 	return data;
 }
@@ -542,14 +1092,17 @@ bool ExmdbQueries::removeDevice(const std::string& homedir, const std::string& f
 {
 	using Flags = EmptyFolderRequest::DeleteFlags;
 	uint64_t rootFolderId = util::makeEidEx(1, PublicFid::ROOT);
-	auto syncFolder = send<GetFolderByNameRequest>(homedir, rootFolderId, folderName);
-	if(!syncFolder.folderId)
+	uint64_t syncFolderId = folderIdByName(homedir, rootFolderId, folderName);
+	if(!syncFolderId)
 		return true;
-	auto deviceFolder = send<GetFolderByNameRequest>(homedir, syncFolder.folderId, deviceId);
-	if(!deviceFolder.folderId)
+	uint64_t deviceFolderId = folderIdByName(homedir, syncFolderId, deviceId);
+	if(!deviceFolderId)
 		return true;
-	send<EmptyFolderRequest>(homedir, 0, "", deviceFolder.folderId, Flags::HARD_DELETE | Flags::DEL_ASSOCIATED);
-	return send<DeleteFolderRequest>(homedir, 0, deviceFolder.folderId, true).success;
+	send<EmptyFolderRequest>(homedir, 0, "", deviceFolderId, Flags::HARD_DELETE | Flags::DEL_ASSOCIATED);
+	bool success = send<DeleteFolderRequest>(homedir, 0, deviceFolderId, true).success;
+	if(folderCache)
+		folderCache->invalidate(homedir, deviceFolderId);
+	return success;
 }
 
 /**
@@ -565,12 +1118,53 @@ bool ExmdbQueries::removeSyncStates(const std::string& homedir, const std::strin
 {
 	using Flags = EmptyFolderRequest::DeleteFlags;
 	uint64_t rootFolderId = util::makeEidEx(1, PublicFid::ROOT);
-	auto syncFolder = send<GetFolderByNameRequest>(homedir, rootFolderId, folderName);
-	if(!syncFolder.folderId)
+	uint64_t syncFolderId = folderIdByName(homedir, rootFolderId, folderName);
+	if(!syncFolderId)
 		return true;
-	send<EmptyFolderRequest>(homedir, 0, "", syncFolder.folderId,
+	send<EmptyFolderRequest>(homedir, 0, "", syncFolderId,
 	                         Flags::HARD_DELETE | Flags::DEL_ASSOCIATED | Flags::DEL_FOLDERS);
-	return send<DeleteFolderRequest>(homedir, 0, syncFolder.folderId, true).success;
+	bool success = send<DeleteFolderRequest>(homedir, 0, syncFolderId, true).success;
+	if(folderCache)
+		folderCache->invalidate(homedir, syncFolderId);
+	return success;
+}
+
+/**
+ * @brief      Read message content incrementally
+ *
+ * The message is parsed while it is received and reported to the handler,
+ * large binary properties (e.g. attachment data) are passed in chunks.
+ *
+ * @param      homedir    Home directory path of the store
+ * @param      messageId  ID of the message
+ * @param      handler    Handler receiving the message contents
+ * @param      cpid       Code page ID
+ *
+ * @return     true if the message was read, false if it does not exist
+ */
+bool ExmdbQueries::readMessage(const std::string& homedir, uint64_t messageId, MessageHandler& handler, uint32_t cpid)
+{
+	auto response = stream<ReadMessageRequest>(homedir, std::string(), cpid, messageId);
+	if(!response.pop<uint8_t>())
+		return false;
+	MessageReader(handler).read(response);
+	return true;
+}
+
+/**
+ * @brief      Read message instance content incrementally
+ *
+ * Same as readMessage(), but reads a message instance loaded with
+ * LoadMessageInstanceRequest.
+ *
+ * @param      homedir     Home directory path of the store
+ * @param      instanceId  ID of the message instance
+ * @param      handler     Handler receiving the message contents
+ */
+void ExmdbQueries::readMessageInstance(const std::string& homedir, uint32_t instanceId, MessageHandler& handler)
+{
+	auto response = stream<ReadMessageInstanceRequest>(homedir, instanceId);
+	MessageReader(handler).read(response);
 }
 
 /**
@@ -584,7 +1178,11 @@ bool ExmdbQueries::removeSyncStates(const std::string& homedir, const std::strin
  */
 std::vector<uint16_t> ExmdbQueries::resolveNamedProperties(const std::string& homedir, bool create,
                                                            const std::vector<PropertyName>& propnames)
-{return send<GetNamedPropIdsRequest>(homedir, create, propnames).propIds;}
+{
+	if(namedPropCache)
+		return namedPropCache->resolve(*this, homedir, create, propnames);
+	return send<GetNamedPropIdsRequest>(homedir, create, propnames).propIds;
+}
 
 /**
  * @brief        Resync device
@@ -604,18 +1202,108 @@ bool ExmdbQueries::resyncDevice(const std::string& homedir, const std::string& f
 	static const Restriction noDD = Restriction::PROPERTY(Restriction::NE, 0, TaggedPropval(PropTag::DISPLAYNAME, "devicedata"));
 	static const uint32_t midTag[] = {PropTag::MID};
 	uint64_t rootFolderId = util::makeEidEx(1, PublicFid::ROOT);
-	auto syncFolder = send<GetFolderByNameRequest>(homedir, rootFolderId, folderName);
-	auto deviceFolder = send<GetFolderByNameRequest>(homedir, syncFolder.folderId, deviceId);
-	auto content = send<LoadContentTableRequest>(homedir, 0, deviceFolder.folderId, "", 2, noDD);
-	auto table = send<QueryTableRequest>(homedir, "", 0, content.tableId, midTag, 0, content.rowCount);
-	send<UnloadTableRequest>(homedir, content.tableId);
+	uint64_t syncFolderId = folderIdByName(homedir, rootFolderId, folderName);
+	uint64_t deviceFolderId = folderIdByName(homedir, syncFolderId, deviceId);
+	auto content = send<LoadContentTableRequest>(homedir, 0, deviceFolderId, "", 2, noDD);
+	PropvalTable table = queryAndUnload(homedir, content.tableId, midTag, 0, content.rowCount);
 	std::vector<uint64_t> mids;
-	mids.reserve(table.entries.size());
-	for(const auto& row : table.entries)
+	mids.reserve(table.size());
+	for(const auto& row : table)
 		for(const auto& tag : row)
 			if(tag.tag == PropTag::MID)
 				mids.emplace_back(tag.value.u64);
-	return !send<DeleteMessagesRequest>(homedir, userId, 0, "", deviceFolder.folderId, mids, true).partial;
+	return !send<DeleteMessagesRequest>(homedir, userId, 0, "", deviceFolderId, mids, true).partial;
+}
+
+/**
+ * @brief      Update folder tree with changes from the server
+ *
+ * An empty tree is filled with the complete hierarchy. Otherwise, only
+ * folders modified since the latest modification time in the tree are
+ * transferred and merged.
+ *
+ * Deleted folders are detected by comparing the number of folders on the
+ * server with the size of the tree. Only if they differ, the IDs of all
+ * folders are retrieved to determine which folders to remove.
+ *
+ * A synchronization takes three round trips. Tables loaded on the server
+ * are unloaded again if the synchronization fails.
+ *
+ * @param      homedir  Home directory path of the domain
+ * @param      tree     Tree to update
+ *
+ * @return     IDs of added, modified and removed folders
+ */
+FolderChanges ExmdbQueries::syncFolderTree(const std::string& homedir, FolderTree& tree)
+{
+	static const std::vector<uint32_t> syncProps = [] {
+		std::vector<uint32_t> tags = defaultFolderProps;
+		tags.emplace_back(PropTag::CHANGENUMBER);
+		tags.emplace_back(PropTag::LASTMODIFICATIONTIME);
+		return tags;
+	}();
+	static const std::vector<uint32_t> fidTag = {PropTag::FOLDERID};
+	FolderChanges changes;
+	if(tree.empty())
+	{
+		tree.merge(std::move(FolderList(listFolders(homedir, tree.root(), true, syncProps)).folders), changes);
+		return changes;
+	}
+	Restriction modified = Restriction::PROPERTY(Restriction::GE, 0,
+	                                             TaggedPropval(PropTag::LASTMODIFICATIONTIME, tree.modifiedSince()));
+	std::optional<LoadTableResponse> allTable, deltaTable;
+	Pipeline pipeline(*this);
+	try
+	{
+		size_t all = pipeline.add<LoadHierarchyTableRequest>(homedir, tree.root(), "", TableFlags::DEPTH, Restriction::XNULL());
+		size_t delta = pipeline.add<LoadHierarchyTableRequest>(homedir, tree.root(), "", TableFlags::DEPTH, modified);
+		pipeline.execute();
+		std::exception_ptr error;
+		try
+		{allTable.emplace(pipeline.get<LoadHierarchyTableRequest>(all));}
+		catch(const ExmdbProtocolError&)
+		{error = std::current_exception();}
+		deltaTable.emplace(pipeline.get<LoadHierarchyTableRequest>(delta));
+		if(error)
+			std::rethrow_exception(error);
+
+		pipeline.clear();
+		size_t query = pipeline.add<QueryTableRequest>(homedir, "", 0, deltaTable->tableId, syncProps, 0, deltaTable->rowCount);
+		size_t unload = pipeline.add<UnloadTableRequest>(homedir, deltaTable->tableId);
+		pipeline.execute();
+		pipeline.get<UnloadTableRequest>(unload);
+		deltaTable.reset();
+		tree.merge(std::move(FolderList(pipeline.get<QueryTableRequest>(query)).folders), changes);
+
+		bool complete = tree.size() == allTable->rowCount;
+		pipeline.clear();
+		query = complete? 0 : pipeline.add<QueryTableRequest>(homedir, "", 0, allTable->tableId, fidTag, 0, allTable->rowCount);
+		unload = pipeline.add<UnloadTableRequest>(homedir, allTable->tableId);
+		pipeline.execute();
+		pipeline.get<UnloadTableRequest>(unload);
+		allTable.reset();
+		if(complete)
+			return changes;
+		auto qtResponse = pipeline.get<QueryTableRequest>(query);
+		std::vector<uint64_t> existing;
+		existing.reserve(qtResponse.entries.size());
+		for(const auto& row : qtResponse.entries)
+			for(const auto& tag : row)
+				if(tag.tag == PropTag::FOLDERID)
+					existing.emplace_back(tag.value.u64);
+		tree.retain(existing, changes);
+	}
+	catch(...)
+	{
+		for(const auto& table : {allTable, deltaTable})
+			if(table)
+				try
+				{send<UnloadTableRequest>(homedir, table->tableId);}
+				catch(...)
+				{}
+		throw;
+	}
+	return changes;
 }
 
 }
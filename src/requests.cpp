@@ -54,6 +54,14 @@ namespace exmdbpp::requests
 FolderResponse::FolderResponse(IOBuffer& buff) : folderId(buff.pop<uint64_t>())
 {}
 
+/**
+ * @brief      Deserialize message content response
+ *
+ * @param      buff  Buffer containing the data
+ */
+MessageContentResponse::MessageContentResponse(IOBuffer& buff) : content(buff)
+{}
+
 /**
  * @brief      Deserialize load table response
  *
@@ -125,6 +133,289 @@ TableResponse::TableResponse(IOBuffer& buff)
 	}
 }
 
+/**
+ * @brief      Deserialize table without copying values
+ *
+ * @param      buff  Buffer containing the response data (moved into the response)
+ */
+BorrowedTableResponse::BorrowedTableResponse(IOBuffer&& buff) : buffer(std::move(buff))
+{
+	uint32_t rowCount = buffer.pop<uint32_t>();
+	rows.reserve(rowCount+1);
+	for(uint32_t row = 0; row < rowCount; ++row)
+	{
+		uint16_t count = buffer.pop<uint16_t>();
+		if(row == 0)
+			propvals.reserve(size_t(rowCount)*count);
+		rows.emplace_back(propvals.size());
+		for(uint16_t i = 0; i < count; ++i)
+			propvals.emplace_back(buffer, arena);
+	}
+	rows.emplace_back(propvals.size());
+}
+
+/**
+ * @brief      Access table row
+ *
+ * @param      index  Index of the row
+ *
+ * @throws     std::out_of_range  Index is out of range
+ *
+ * @return     View of the propvals in the row
+ */
+BorrowedTableResponse::Row BorrowedTableResponse::operator[](size_t index) const
+{
+	if(index >= size())
+		throw std::out_of_range("Row index "+std::to_string(index)+" out of range");
+	return Row(propvals.data()+rows[index], uint32_t(rows[index+1]-rows[index]));
+}
+
+/**
+ * @brief      Return number of rows
+ */
+size_t BorrowedTableResponse::size() const noexcept
+{return rows.empty()? 0 : rows.size()-1;}
+
+/**
+ * @brief      Read tag of the next propval without advancing the read cursor
+ *
+ * @param      buff  Buffer to read from
+ *
+ * @return     Tag identifier
+ */
+static uint32_t peekTag(const IOBuffer& buff)
+{
+	uint32_t tag;
+	if(buff.tell()+sizeof(tag) > buff.size())
+		throw std::out_of_range("Read past the end of buffer.");
+	memcpy(&tag, buff.data()+buff.tell(), sizeof(tag));
+	return le32toh(tag);
+}
+
+/**
+ * @brief      Create empty column
+ *
+ * @param      tag   Tag of the column
+ */
+ColumnarTableResponse::Column::Column(uint32_t tag) : tag(tag)
+{
+	switch(PropvalType::tagType(tag))
+	{
+	case PropvalType::BYTE:
+	case PropvalType::SHORT:
+	case PropvalType::LONG:
+	case PropvalType::ERROR:
+	case PropvalType::LONGLONG:
+	case PropvalType::CURRENCY:
+	case PropvalType::FILETIME:
+		kind = INTEGER; break;
+	case PropvalType::FLOAT:
+	case PropvalType::DOUBLE:
+	case PropvalType::FLOATINGTIME:
+		kind = REAL; break;
+	case PropvalType::STRING:
+	case PropvalType::WSTRING:
+	case PropvalType::BINARY:
+		kind = BYTES; break;
+	default:
+		kind = GENERIC;
+	}
+}
+
+/**
+ * @brief      Check whether a row contains a value for this column
+ *
+ * @param      row   Row index
+ *
+ * @return     true if a value is present, false otherwise
+ */
+bool ColumnarTableResponse::Column::present(size_t row) const
+{return presence[row/64] & (uint64_t(1) << row%64);}
+
+/**
+ * @brief      Return integer value
+ *
+ * Only valid for INTEGER columns. Missing values are returned as 0.
+ *
+ * @param      row   Row index
+ *
+ * @return     Value zero-extended to 64 bit
+ */
+uint64_t ColumnarTableResponse::Column::value(size_t row) const
+{return values[row];}
+
+/**
+ * @brief      Return floating point value
+ *
+ * Only valid for REAL columns. Missing values are returned as 0.
+ *
+ * @param      row   Row index
+ *
+ * @return     Value converted to double
+ */
+double ColumnarTableResponse::Column::real(size_t row) const
+{
+	double value;
+	memcpy(&value, &values[row], sizeof(value));
+	return value;
+}
+
+/**
+ * @brief      Return string or binary data
+ *
+ * Only valid for BYTES columns. The terminating null character of strings
+ * is not included.
+ *
+ * @param      row   Row index
+ *
+ * @return     View of the data (empty for missing values)
+ */
+std::string_view ColumnarTableResponse::Column::bytes(size_t row) const
+{
+	uint32_t length = offsets[row+1]-offsets[row];
+	if(length && PropvalType::tagType(tag) != PropvalType::BINARY)
+		--length;
+	return std::string_view(data.data()+offsets[row], length);
+}
+
+/**
+ * @brief      Return string value
+ *
+ * Only valid for string columns.
+ *
+ * @param      row   Row index
+ *
+ * @return     Pointer to null-terminated string or nullptr if the value is missing
+ */
+const char* ColumnarTableResponse::Column::str(size_t row) const
+{return offsets[row] == offsets[row+1]? nullptr : data.data()+offsets[row];}
+
+/**
+ * @brief      Return array value
+ *
+ * Only valid for GENERIC columns.
+ *
+ * @param      row   Row index
+ *
+ * @return     Value (empty TaggedPropval for missing values)
+ */
+const TaggedPropval& ColumnarTableResponse::Column::propval(size_t row) const
+{return propvals[row];}
+
+/**
+ * @brief      Decode table into columns
+ *
+ * @param      buff      Buffer containing the response data
+ * @param      proptags  Tags requested by the QueryTableRequest
+ */
+ColumnarTableResponse::ColumnarTableResponse(IOBuffer& buff, const std::vector<uint32_t>& proptags)
+{
+	rows = buff.pop<uint32_t>();
+	columns.reserve(proptags.size());
+	for(uint32_t tag : proptags)
+	{
+		Column& column = columns.emplace_back(tag);
+		column.presence.resize((rows+63)/64);
+		if(column.kind == Column::BYTES)
+			column.offsets.resize(rows+1);
+		else if(column.kind == Column::GENERIC)
+			column.propvals.resize(rows);
+		else
+			column.values.resize(rows);
+	}
+	auto find = [this](uint32_t tag, size_t hint)
+	{ // Values are usually returned in the requested order, start searching behind the last match
+		for(size_t i = 0; i < columns.size(); ++i)
+			if(columns[(hint+i)%columns.size()].tag == tag)
+				return (hint+i)%columns.size();
+		return columns.size();
+	};
+	for(size_t row = 0; row < rows; ++row)
+	{
+		uint16_t count = buff.pop<uint16_t>();
+		size_t hint = 0;
+		for(uint16_t i = 0; i < count; ++i)
+		{
+			uint32_t tag = peekTag(buff);
+			size_t index = find(tag, hint);
+			if(index == columns.size())
+			{
+				TaggedPropval skipped(buff);
+				continue;
+			}
+			hint = index+1;
+			Column& column = columns[index];
+			column.presence[row/64] |= uint64_t(1) << row%64;
+			if(column.kind == Column::GENERIC)
+			{
+				column.propvals[row] = TaggedPropval(buff);
+				continue;
+			}
+			buff.pop<uint32_t>();
+			switch(PropvalType::tagType(tag))
+			{
+			case PropvalType::BYTE:
+				column.values[row] = buff.pop<uint8_t>(); break;
+			case PropvalType::SHORT:
+				column.values[row] = buff.pop<uint16_t>(); break;
+			case PropvalType::LONG:
+			case PropvalType::ERROR:
+				column.values[row] = buff.pop<uint32_t>(); break;
+			case PropvalType::LONGLONG:
+			case PropvalType::CURRENCY:
+			case PropvalType::FILETIME:
+				column.values[row] = buff.pop<uint64_t>(); break;
+			case PropvalType::FLOAT:
+			{
+				double value = buff.pop<float>();
+				memcpy(&column.values[row], &value, sizeof(value));
+				break;
+			}
+			case PropvalType::DOUBLE:
+			case PropvalType::FLOATINGTIME:
+			{
+				double value = buff.pop<double>();
+				memcpy(&column.values[row], &value, sizeof(value));
+				break;
+			}
+			case PropvalType::STRING:
+			case PropvalType::WSTRING:
+			{
+				size_t length;
+				const char* str = buff.pop_str(length);
+				column.data.insert(column.data.end(), str, str+length+1);
+				break;
+			}
+			case PropvalType::BINARY:
+			{
+				uint32_t length = buff.pop<uint32_t>();
+				const char* data = static_cast<const char*>(buff.pop_raw(length));
+				column.data.insert(column.data.end(), data, data+length);
+				break;
+			}
+			}
+		}
+		for(Column& column : columns)
+			if(column.kind == Column::BYTES)
+				column.offsets[row+1] = uint32_t(column.data.size());
+	}
+}
+
+/**
+ * @brief      Find column by tag
+ *
+ * @param      tag   Tag to search for
+ *
+ * @return     Pointer to the column or nullptr if no column for the tag exists
+ */
+const ColumnarTableResponse::Column* ColumnarTableResponse::column(uint32_t tag) const
+{
+	for(const Column& column : columns)
+		if(column.tag == tag)
+			return &column;
+	return nullptr;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 /**
@@ -227,6 +518,17 @@ Response<EmptyFolderRequest::callId>::Response(IOBuffer& buff) : partial(buff.po
 Response<LoadMessageInstanceRequest::callId>::Response(IOBuffer& buff) : instanceId(buff.pop<uint32_t>())
 {}
 
+/**
+ * @brief      Deserialize read message response
+ *
+ * @param      buff  Buffer containing the data
+ */
+Response<ReadMessageRequest::callId>::Response(IOBuffer& buff) : found(buff.pop<uint8_t>())
+{
+	if(found)
+		content = MessageContent(buff);
+}
+
 /**
  * @brief      Deserialize list of property IDs
  *
@@ -262,6 +564,8 @@ template struct Request<constants::CallId::LOAD_PERMISSION_TABLE, uint64_t, uint
 template struct Request<constants::CallId::QUERY_FOLDER_MESSAGES, uint64_t>;
 template struct Request<constants::CallId::QUERY_MESSAGE_INSTANCE_ATTACHMENT_TABLE, uint32_t, Collection<uint16_t, uint32_t>, uint32_t, uint32_t>;
 template struct Request<constants::CallId::QUERY_TABLE, std::string, uint32_t, uint32_t, Collection<uint16_t, uint32_t>, uint32_t, uint32_t>;
+template struct Request<constants::CallId::READ_MESSAGE, std::string, uint32_t, uint64_t>;
+template struct Request<constants::CallId::READ_MESSAGE_INSTANCE, uint32_t>;
 template struct Request<constants::CallId::REMOVE_STORE_PROPERTIES, Collection<uint16_t, uint32_t>>;
 template struct Request<constants::CallId::SET_FOLDER_PROPERTIES, uint32_t, uint64_t, Collection<uint16_t, structures::TaggedPropval>>;
 template struct Request<constants::CallId::SET_STORE_PROPERTIES, uint32_t, Collection<uint16_t, structures::TaggedPropval>>;
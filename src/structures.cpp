@@ -5,8 +5,13 @@
 #include <cstdint>
 #include <cstring>
 #include <cstddef>
+#include <algorithm>
+#include <atomic>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <type_traits>
+#include <variant>
 
 #include "constants.h"
 #include "exceptions.h"
@@ -29,12 +34,105 @@ TaggedPropval::Value& TaggedPropval::Value::operator=(const Value& v)
 
 ///////////////////////////////////////////////////////////////////////////////
 
+/**
+ * @brief      Construct arena
+ *
+ * @param      blockSize  Minimum size of allocated memory blocks
+ */
+Arena::Arena(size_t blockSize) noexcept : blockSize(blockSize)
+{}
+
+/**
+ * @brief      Allocate uninitialized memory
+ *
+ * @param      bytes      Number of bytes to allocate
+ * @param      alignment  Alignment of the memory (must be a power of two)
+ *
+ * @return     Pointer to allocated memory
+ */
+void* Arena::allocate(size_t bytes, size_t alignment)
+{
+	if(!blocks.empty())
+	{
+		Block& block = blocks.back();
+		uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+		size_t offset = ((base+used+alignment-1) & ~(alignment-1))-base;
+		if(offset+bytes <= block.size)
+		{
+			used = offset+bytes;
+			return block.data.get()+offset;
+		}
+	}
+	size_t size = std::max(blockSize, bytes+alignment);
+	blocks.emplace_back(Block{std::make_unique<uint8_t[]>(size), size});
+	uintptr_t base = reinterpret_cast<uintptr_t>(blocks.back().data.get());
+	size_t offset = ((base+alignment-1) & ~(alignment-1))-base;
+	used = offset+bytes;
+	return blocks.back().data.get()+offset;
+}
+
+/**
+ * @brief      Release all allocations
+ *
+ * The first block is kept for reuse.
+ */
+void Arena::clear() noexcept
+{
+	if(blocks.size() > 1)
+		blocks.erase(blocks.begin()+1, blocks.end());
+	used = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief      Read array with arena allocated storage
+ *
+ * @param      buff   Buffer to read from
+ * @param      arena  Arena to allocate memory from
+ * @param      va     Array to read into
+ *
+ * @tparam     T      Element type
+ */
+template<typename T>
+static void popArray(IOBuffer& buff, Arena& arena, TaggedPropval::VArray<T>& va)
+{
+	uint32_t count = buff.pop<uint32_t>();
+	va = TaggedPropval::VArray<T>(arena.allocate<T>(count), count);
+	buff.pop_array(va.first, count);
+}
+
 /**
  * @brief      Deserialize PropTag from buffer
  *
  * @param      buff  Buffer containing serialized PropTag
  */
 TaggedPropval::TaggedPropval(IOBuffer& buff) : value()
+{read(buff, nullptr);}
+
+/**
+ * @brief      Deserialize PropTag from buffer without copying
+ *
+ * String and binary values reference the buffer directly, remaining array
+ * values are allocated from the arena. The resulting TaggedPropval does not
+ * own its data and is only valid as long as neither the buffer nor the arena
+ * are modified or destroyed.
+ *
+ * @param      buff   Buffer containing serialized PropTag
+ * @param      arena  Arena to allocate array values from
+ */
+TaggedPropval::TaggedPropval(IOBuffer& buff, Arena& arena) : value(), owned(false)
+{read(buff, &arena);}
+
+/**
+ * @brief      Deserialize PropTag
+ *
+ * If no arena is given, all data is copied into newly allocated memory.
+ *
+ * @param      buff   Buffer containing serialized PropTag
+ * @param      arena  Arena to allocate from or nullptr
+ */
+void TaggedPropval::read(IOBuffer& buff, Arena* arena)
 {
 	tag = buff.pop<uint32_t>();
 	type = tag == PropvalType::UNSPECIFIED? buff.pop<uint16_t>() : tag&0xFFFF;
@@ -60,33 +158,86 @@ TaggedPropval::TaggedPropval(IOBuffer& buff) : value()
 		buff >> value.d; break;
 	case PropvalType::STRING:
 	case PropvalType::WSTRING:
-		value.str = copyStr(buff.pop<const char*>()); break;
+		if(arena)
+			value.str = const_cast<char*>(buff.pop<const char*>());
+		else
+		{
+			size_t length;
+			const char* str = buff.pop_str(length);
+			value.str = copyStr(str, length);
+		}
+		break;
 	case PropvalType::BINARY:
-		buff >> value.data; break;
+		if(arena)
+		{
+			uint32_t count = buff.pop<uint32_t>();
+			value.data = VArray<uint8_t>(static_cast<uint8_t*>(const_cast<void*>(buff.pop_raw(count))), count);
+		}
+		else
+			buff >> value.data;
+		break;
 	case PropvalType::SHORT_ARRAY:
-		buff >> value.a16; break;
+		if(arena)
+			popArray(buff, *arena, value.a16);
+		else
+			buff >> value.a16;
+		break;
 	case PropvalType::LONG_ARRAY:
-		buff >> value.a32; break;
+		if(arena)
+			popArray(buff, *arena, value.a32);
+		else
+			buff >> value.a32;
+		break;
 	case PropvalType::LONGLONG_ARRAY:
 	case PropvalType::CURRENCY_ARRAY:
-		buff >> value.a64; break;
+		if(arena)
+			popArray(buff, *arena, value.a64);
+		else
+			buff >> value.a64;
+		break;
 	case PropvalType::FLOAT_ARRAY:
-		buff >> value.af; break;
+		if(arena)
+			popArray(buff, *arena, value.af);
+		else
+			buff >> value.af;
+		break;
 	case PropvalType::DOUBLE_ARRAY:
 	case PropvalType::FLOATINGTIME_ARRAY:
-		buff >> value.ad; break;
+		if(arena)
+			popArray(buff, *arena, value.ad);
+		else
+			buff >> value.ad;
+		break;
 	case PropvalType::STRING_ARRAY:
 	case PropvalType::WSTRING_ARRAY:
+		if(arena)
+		{
+			uint32_t count = buff.pop<uint32_t>();
+			value.astr = VArray<char*>(arena->allocate<char*>(count), count);
+			for(char*& str : value.astr)
+				str = const_cast<char*>(buff.pop<const char*>());
+			break;
+		}
 		buff >> value.astr;
 		for(char*& str : value.astr)
 		{
-			const char* temp = buff.pop<const char*>();
-			size_t len = strlen(temp);
-			str = new char[len+1];
-			strcpy(str, temp);
+			size_t length;
+			const char* temp = buff.pop_str(length);
+			str = copyStr(temp, length);
 		}
 		break;
 	case PropvalType::BINARY_ARRAY:
+		if(arena)
+		{
+			uint32_t count = buff.pop<uint32_t>();
+			value.adata = VArray<VArray<uint8_t>>(arena->allocate<VArray<uint8_t>>(count), count);
+			for(VArray<uint8_t>& bin : value.adata)
+			{
+				uint32_t len = buff.pop<uint32_t>();
+				bin = VArray<uint8_t>(static_cast<uint8_t*>(const_cast<void*>(buff.pop_raw(len))), len);
+			}
+			break;
+		}
 		buff >> value.adata; break;
 	}
 }
@@ -277,7 +428,7 @@ TaggedPropval::TaggedPropval(uint32_t tag, const uint16_t* val, uint32_t len, bo
 	if(type != PropvalType::SHORT_ARRAY)
 		throw std::invalid_argument(std::string("Cannot construct ")+typeName()+" tag from 16 bit unsigned array");
 	if(copy)
-		copyData(val, len*sizeof(uint16_t), alignof(uint16_t));
+		copyData(val, len*sizeof(uint16_t));
 	else
 		value.a16 = VArray<uint16_t>(const_cast<uint16_t*>(val), len);
 }
@@ -300,7 +451,7 @@ TaggedPropval::TaggedPropval(uint32_t tag, const uint32_t* val, uint32_t len, bo
 	if(type != PropvalType::LONG_ARRAY)
 		throw std::invalid_argument(std::string("Cannot construct ")+typeName()+" tag from 32 bit unsigned array");
 	if(copy)
-		copyData(val, len*sizeof(uint32_t), alignof(uint32_t));
+		copyData(val, len*sizeof(uint32_t));
 	else
 		value.a32 = VArray<uint32_t>(const_cast<uint32_t*>(val), len);
 }
@@ -323,7 +474,7 @@ TaggedPropval::TaggedPropval(uint32_t tag, const uint64_t* val, uint32_t len, bo
 	if(type != PropvalType::LONGLONG_ARRAY && type != PropvalType::CURRENCY_ARRAY)
 		throw std::invalid_argument(std::string("Cannot construct ")+typeName()+" tag from 64 bit unsigned array");
 	if(copy)
-		copyData(val, len*sizeof(uint64_t), alignof(uint64_t));
+		copyData(val, len*sizeof(uint64_t));
 	else
 		value.a64 = VArray<uint64_t>(const_cast<uint64_t*>(val), len);
 }
@@ -346,7 +497,7 @@ TaggedPropval::TaggedPropval(uint32_t tag, const float* val, uint32_t len, bool
 	if(type != PropvalType::FLOAT_ARRAY)
 		throw std::invalid_argument(std::string("Cannot construct ")+typeName()+" tag from 32 bit float array");
 	if(copy)
-		copyData(val, len*sizeof(float), alignof(float));
+		copyData(val, len*sizeof(float));
 	else
 		value.af = VArray<float>(const_cast<float*>(val), len);
 }
@@ -369,7 +520,7 @@ TaggedPropval::TaggedPropval(uint32_t tag, const double* val, uint32_t len, bool
 	if(type != PropvalType::DOUBLE_ARRAY && type != PropvalType::FLOATINGTIME_ARRAY)
 		throw std::invalid_argument(std::string("Cannot construct ")+typeName()+" tag from 64 bit float array");
 	if(copy)
-		copyData(val, len*sizeof(double), alignof(double));
+		copyData(val, len*sizeof(double));
 	else
 		value.ad = VArray<double>(const_cast<double*>(val), len);
 }
@@ -393,7 +544,7 @@ TaggedPropval::TaggedPropval(uint32_t tag, const char** val, uint32_t len, bool
 		throw std::invalid_argument(std::string("Cannot construct ")+typeName()+" tag from string array");
 	if(copy)
 	{
-		copyData(val, len*sizeof(char*), alignof(char*));
+		copyData(val, len*sizeof(char*));
 		if(val)
 			for(char*& str : value.astr)
 				str = copyStr(str);
@@ -464,6 +615,23 @@ TaggedPropval& TaggedPropval::operator=(TaggedPropval&& tp) noexcept
 TaggedPropval::~TaggedPropval()
 {free();}
 
+/**
+ * @brief      Create owning copy
+ *
+ * In contrast to the copy constructor, referenced data is copied even if it
+ * is not owned by this object.
+ *
+ * @return     TaggedPropval owning a copy of the data
+ */
+TaggedPropval TaggedPropval::materialize() const
+{
+	TaggedPropval tp;
+	tp.tag = tag;
+	tp.type = type;
+	tp.copyValue(*this, true);
+	return tp;
+}
+
 /**
  * @brief      Generate string representation of contained value
  *
@@ -574,9 +742,20 @@ const void* TaggedPropval::binaryData() const
  * @return     Newly allocated string buffer
  */
 char* TaggedPropval::copyStr(const char* str)
+{return copyStr(str, strlen(str));}
+
+/**
+ * @brief      Copy string of known length to new buffer
+ *
+ * @param      str     String to copy
+ * @param      length  Length of the string (excluding the terminator)
+ *
+ * @return     Newly allocated string buffer
+ */
+char* TaggedPropval::copyStr(const char* str, size_t length)
 {
-	char* copy = new char[strlen(str)+1];
-	strcpy(copy, str);
+	char* copy = new char[length+1];
+	memcpy(copy, str, length+1);
 	return copy;
 }
 
@@ -588,32 +767,33 @@ char* TaggedPropval::copyStr(const char* str)
  *
  * Previously held data must be freed manually before calling copyValue.
  *
- * @param      TaggedPropval to copy data from
+ * @param      tp     TaggedPropval to copy data from
+ * @param      deep   Copy data even if it is not owned by tp
  */
-void TaggedPropval::copyValue(const TaggedPropval& tp)
+void TaggedPropval::copyValue(const TaggedPropval& tp, bool deep)
 {
-	if(tp.value.data.first == nullptr || !tp.owned)
+	if(tp.value.data.first == nullptr || (!tp.owned && !deep))
 		value.data = tp.value.data;
 	else if((type == PropvalType::STRING || type == PropvalType::WSTRING))
 		value.str = copyStr(tp.value.str);
 	else if(type == PropvalType::STRING_ARRAY || type == PropvalType::WSTRING_ARRAY)
 	{
-		copyData(tp.value.astr.first, tp.value.astr.count()*sizeof(char*), alignof(char*));
+		copyData(tp.value.astr.first, tp.value.astr.count()*sizeof(char*));
 		for(char*& str : value.astr)
 			str = copyStr(str);
 	}
 	else if(type == PropvalType::BINARY_ARRAY)
 	{
-		copyData(nullptr, tp.value.data.count(), alignof(VArray<uint8_t>));
+		copyData(nullptr, tp.value.data.count());
 		for(uint32_t i = 0; i < value.adata.count(); ++i)
 		{
-			uint32_t len = value.adata.first[i].count();
+			uint32_t len = tp.value.adata.first[i].count();
 			value.adata.first[i] = VArray<uint8_t>(new uint8_t[len], len);
 			memcpy(value.adata.first[i].first, tp.value.adata.first[i].first, len);
 		}
 	}
 	else if(PropvalType::isArray(type))
-		copyData(tp.value.data.first, tp.value.data.count(), alignof(std::max_align_t));
+		copyData(tp.value.data.first, tp.value.data.count());
 	else
 		value = tp.value;
 }
@@ -621,12 +801,15 @@ void TaggedPropval::copyValue(const TaggedPropval& tp)
 /**
  * @brief      Copy data to internal buffer
  *
+ * Memory is allocated with plain new[], which is suitably aligned for all
+ * element types and matches the delete[] in free().
+ *
  * @param      data  Data to copy
  * @param      len   Number of bytes
  */
-void TaggedPropval::copyData(const void* data, uint32_t len, size_t alignment)
+void TaggedPropval::copyData(const void* data, uint32_t len)
 {
-	value.data.first = new(std::align_val_t(alignment)) uint8_t[len];
+	value.data.first = new uint8_t[len];
 	value.data.second = value.data.first+len;
 	if(data)
 		memcpy(value.data.first, data, len);
@@ -828,23 +1011,114 @@ PropertyProblem::PropertyProblem(IOBuffer& buff)
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-inline Restriction::RChain::RChain(std::vector<Restriction>&& ress) : elements(std::move(ress)) {}
-inline Restriction::RNot::RNot(Restriction&& res) : res(new Restriction(std::move(res))) {}
-inline Restriction::RContent::RContent(uint32_t fl, uint32_t pt, TaggedPropval&& tp) : fuzzyLevel(fl), proptag(pt != 0? pt : tp.tag), propval(std::move(tp)) {}
-inline Restriction::RProp::RProp(Op op, uint32_t pt, TaggedPropval&& tp) : op(op), proptag(pt != 0? pt : tp.tag), propval(std::move(tp)) {}
-inline Restriction::RPropComp::RPropComp(Op op, uint32_t pt1, uint32_t pt2) : op(op), proptag1(pt1), proptag2(pt2) {}
-inline Restriction::RBitMask::RBitMask(bool all, uint32_t pt, uint32_t mask): all(all), proptag(pt), mask(mask) {}
-inline Restriction::RSize::RSize(Op op, uint32_t pt, uint32_t size) : op(op), proptag(pt), size(size) {}
-inline Restriction::RExist::RExist(uint32_t pt) : proptag(pt) {}
-inline Restriction::RSubObj::RSubObj(uint32_t so, Restriction&& res) : subobject(so), res(new Restriction(std::move(res))) {}
-inline Restriction::RComment::RComment(std::vector<TaggedPropval>&& tvs, Restriction&& res) : propvals(std::move(tvs)), res(res.res.index() == size_t(Type::iXNULL)? new Restriction(std::move(res)) : nullptr) {}
-inline Restriction::RCount::RCount(uint32_t count, Restriction&& res) : count(count), subres(new Restriction(std::move(res))) {}
+struct Restriction::RChain
+{
+	explicit RChain(std::vector<Restriction>&& ress) : elements(std::move(ress)) {}
+	std::vector<Restriction> elements;
+};
+
+struct Restriction::RNot
+{
+	explicit RNot(Restriction&& res) : res(std::move(res)) {}
+	Restriction res;
+};
+
+struct Restriction::RContent
+{
+	RContent(uint32_t fl, uint32_t pt, TaggedPropval&& tp) : fuzzyLevel(fl), proptag(pt != 0? pt : tp.tag), propval(std::move(tp)) {}
+	uint32_t fuzzyLevel;
+	uint32_t proptag;
+	TaggedPropval propval;
+};
+
+struct Restriction::RProp
+{
+	RProp(Op op, uint32_t pt, TaggedPropval&& tp) : op(op), proptag(pt != 0? pt : tp.tag), propval(std::move(tp)) {}
+	Op op;
+	uint32_t proptag;
+	TaggedPropval propval;
+};
+
+struct Restriction::RPropComp
+{
+	RPropComp(Op op, uint32_t pt1, uint32_t pt2) : op(op), proptag1(pt1), proptag2(pt2) {}
+	Op op;
+	uint32_t proptag1;
+	uint32_t proptag2;
+};
+
+struct Restriction::RBitMask
+{
+	RBitMask(bool all, uint32_t pt, uint32_t mask): all(all), proptag(pt), mask(mask) {}
+	bool all;
+	uint32_t proptag;
+	uint32_t mask;
+};
+
+struct Restriction::RSize
+{
+	RSize(Op op, uint32_t pt, uint32_t size) : op(op), proptag(pt), size(size) {}
+	Op op;
+	uint32_t proptag;
+	uint32_t size;
+};
+
+struct Restriction::RExist
+{
+	explicit RExist(uint32_t pt) : proptag(pt) {}
+	uint32_t proptag;
+};
+
+struct Restriction::RSubObj
+{
+	RSubObj(uint32_t so, Restriction&& res) : subobject(so), res(std::move(res)) {}
+	uint32_t subobject;
+	Restriction res;
+};
+
+struct Restriction::RComment
+{
+	RComment(std::vector<TaggedPropval>&& tvs, Restriction&& res) : propvals(std::move(tvs)), res(std::move(res)) {}
+	std::vector<TaggedPropval> propvals;
+	Restriction res;
+};
+
+struct Restriction::RCount
+{
+	RCount(uint32_t count, Restriction&& res) : count(count), subres(std::move(res)) {}
+	uint32_t count;
+	Restriction subres;
+};
+
+/**
+ * @brief      Restriction tree node
+ *
+ * Nodes are never modified after construction, except for the lazily
+ * computed serialized form, which is only created for restrictions that
+ * are serialized more than once or explicitly requested.
+ */
+struct Restriction::Node
+{
+	template<size_t I, typename... Args>
+	explicit Node(std::in_place_index_t<I> index, Args&&... args) : res(index, std::forward<Args>(args)...) {}
+
+	void write(IOBuffer&) const;
+
+	static void write(IOBuffer&, const Restriction&);
+
+	std::variant<RChain, RChain, RNot, RContent, RProp, RPropComp, RBitMask, RSize, RExist, RSubObj, RComment, RCount> res;
+
+	mutable std::once_flag once; ///< Guard for computing the serialized form
+	mutable std::atomic<bool> cached{false}; ///< Whether `bytes` is available
+	mutable std::atomic<bool> used{false}; ///< Whether the restriction was serialized before
+	mutable std::vector<uint8_t> bytes; ///< Serialized form
+};
 
 template<Restriction::Type I, typename... Args>
 inline Restriction Restriction::create(Args&&... args)
 {
 	Restriction r;
-	r.res.emplace<size_t(I)>(std::forward<Args>(args)...);
+	r.node = std::make_shared<const Node>(std::in_place_index<size_t(I)>, std::forward<Args>(args)...);
 	return r;
 }
 
@@ -1032,13 +1306,76 @@ Restriction Restriction::XNULL()
 /**
  * @brief       Serialize Restriction into IOBuffer
  *
+ * The first call writes the restriction directly into the buffer. If the
+ * restriction is serialized again (by any copy), the serialized form is
+ * cached and subsequent calls only copy the cached data, or reference it if
+ * the buffer has a sufficiently low reference threshold. In that case, the
+ * restriction must outlive the transmission of the buffer (see
+ * IOBuffer::setReferenceThreshold()).
+ *
  * @param       buff    Buffer to write serialized data to
  */
 void Restriction::serialize(IOBuffer& buff) const
 {
-	Type type = Type(res.index());
-	if(type == Type::iXNULL)
+	if(!node)
+		return;
+	if(!node->cached.load(std::memory_order_acquire) && !node->used.exchange(true, std::memory_order_relaxed))
+		return node->write(buff);
+	const std::vector<uint8_t>& data = serialized();
+	buff.push_ref(data.data(), data.size());
+}
+
+/**
+ * @brief       Get serialized form of the restriction
+ *
+ * The data is computed on first call and cached, so restrictions that are
+ * reused for many requests can be serialized ahead of time. The cache is
+ * shared by all copies of the restriction, references to it remain valid
+ * as long as any copy of the restriction exists.
+ *
+ * @return      Serialized restriction (empty for NULL restriction)
+ */
+const std::vector<uint8_t>& Restriction::serialized() const
+{
+	static const std::vector<uint8_t> empty;
+	if(!node)
+		return empty;
+	std::call_once(node->once, [this]
+	{
+		IOBuffer buff;
+		node->write(buff);
+		node->bytes.assign(buff.begin(), buff.end());
+		node->cached.store(true, std::memory_order_release);
+	});
+	return node->bytes;
+}
+
+/**
+ * @brief       Serialize sub-restriction
+ *
+ * Reuses the cached serialized form if available, but does not create one
+ * to avoid storing the data of every sub-tree.
+ *
+ * @param       buff    Buffer to write serialized data to
+ * @param       res     Restriction to serialize
+ */
+void Restriction::Node::write(IOBuffer& buff, const Restriction& res)
+{
+	if(!res.node)
 		return;
+	if(res.node->cached.load(std::memory_order_acquire))
+		return buff.push_raw(res.node->bytes.data(), res.node->bytes.size());
+	res.node->write(buff);
+}
+
+/**
+ * @brief       Serialize restriction tree
+ *
+ * @param       buff    Buffer to write serialized data to
+ */
+void Restriction::Node::write(IOBuffer& buff) const
+{
+	Type type = Type(res.index());
 	buff.push(uint8_t(type));
 	switch(type)
 	{
@@ -1049,11 +1386,11 @@ void Restriction::serialize(IOBuffer& buff) const
 			throw SerializationError("Too many sub-restrictions ("+std::to_string(ress->size())+")");
 		buff.push(uint32_t(ress->size()));
 		for(const Restriction& r : *ress)
-			buff.push(r);
+			write(buff, r);
 		return;
 	}
 	case Type::NOT:
-		return buff.push(*std::get<size_t(Type::NOT)>(res).res);
+		return write(buff, std::get<size_t(Type::NOT)>(res).res);
 	case Type::CONTENT: {
 		const RContent& r = std::get<size_t(Type::CONTENT)>(res);
 		return buff.push(r.fuzzyLevel, r.proptag, r.propval);
@@ -1080,7 +1417,8 @@ void Restriction::serialize(IOBuffer& buff) const
 	}
 	case Type::SUBRES: {
 		const RSubObj& r = std::get<size_t(Type::SUBRES)>(res);
-		return buff.push(r.subobject, *r.res);
+		buff.push(r.subobject);
+		return write(buff, r.res);
 	}
 	case Type::COMMENT: {
 		const RComment& r = std::get<size_t(Type::COMMENT)>(res);
@@ -1089,11 +1427,13 @@ void Restriction::serialize(IOBuffer& buff) const
 		buff.push(uint8_t(r.propvals.size()));
 		for(const TaggedPropval& tp : r.propvals)
 			buff.push(tp);
-		return r.res? buff.push(uint8_t(1), *r.res) : buff.push(uint8_t(0));
+		buff.push(uint8_t(bool(r.res)));
+		return write(buff, r.res);
 	}
 	case Type::COUNT: {
 		const RCount& r = std::get<size_t(Type::COUNT)>(res);
-		return buff.push(r.count, *r.subres);
+		buff.push(r.count);
+		return write(buff, r.subres);
 	}
 	default:
 		throw SerializationError("Invalid restriction type "+std::to_string(uint8_t(type)));
@@ -1104,7 +1444,75 @@ void Restriction::serialize(IOBuffer& buff) const
  * @brief       Check whether the restriction is non-empty
  */
 Restriction::operator bool() const
-{return res.index() != size_t(Type::iXNULL);}
+{return bool(node);}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief      Read list of TaggedPropvals with 16 bit length prefix
+ *
+ * @param      buff      Buffer to read data from
+ * @param      propvals  List to store propvals in
+ */
+static void popPropvals(IOBuffer& buff, std::vector<TaggedPropval>& propvals)
+{
+	uint16_t count = buff.pop<uint16_t>();
+	propvals.reserve(count);
+	for(uint16_t i = 0; i < count; ++i)
+		propvals.emplace_back(buff);
+}
+
+/**
+ * @brief      Load attachment from buffer
+ *
+ * @param      buff     Buffer to read data from
+ * @param      depth    Nesting level of the message containing the attachment
+ *
+ * @throws     SerializationError  Buffer does not contain a valid attachment
+ */
+MessageContent::AttachmentContent::AttachmentContent(IOBuffer& buff, unsigned depth)
+{
+	popPropvals(buff, propvals);
+	if(buff.pop<uint8_t>())
+		embedded.reset(new MessageContent(buff, depth+1));
+}
+
+/**
+ * @brief      Load message content from buffer
+ *
+ * Wire format (shared with MessageReader): propvals, optional recipient
+ * list (presence byte, 32 bit count, propvals per recipient) and optional
+ * attachment list (presence byte, 16 bit count, attachments).
+ *
+ * Embedded messages nested deeper than MAX_DEPTH are rejected.
+ *
+ * @param      buff     Buffer to read data from
+ * @param      depth    Nesting level of the message
+ *
+ * @throws     SerializationError  Buffer does not contain a valid message
+ */
+MessageContent::MessageContent(IOBuffer& buff, unsigned depth)
+{
+	if(depth > MAX_DEPTH)
+		throw SerializationError("Maximum message nesting depth exceeded");
+	popPropvals(buff, propvals);
+	if(buff.pop<uint8_t>())
+	{
+		uint32_t count = buff.pop<uint32_t>();
+		if(count > (buff.size()-buff.tell())/sizeof(uint16_t)) // Each recipient has at least a propval count
+			throw SerializationError("Invalid recipient count "+std::to_string(count));
+		recipients.resize(count);
+		for(auto& recipient : recipients)
+			popPropvals(buff, recipient);
+	}
+	if(buff.pop<uint8_t>())
+	{
+		uint16_t count = buff.pop<uint16_t>();
+		attachments.reserve(count);
+		for(uint16_t i = 0; i < count; ++i)
+			attachments.emplace_back(buff, depth);
+	}
+}
 
 
 }
@@ -1130,7 +1538,7 @@ struct IOBuffer::Serialize<TaggedPropval::VArray<T>>
 	{
 		buff << va.count();
 		if constexpr(sizeof(T) == 1)
-		    return buff.push_raw(va.first, va.count());
+		    return buff.push_ref(va.first, va.count());
 		for(T v : va)
 			buff << v;
 	}
@@ -1144,13 +1552,13 @@ struct IOBuffer::Serialize<TaggedPropval::VArray<T>>
 	static void pop(IOBuffer& buff, TaggedPropval::VArray<T>& va)
 	{
 		uint32_t count = buff.pop<uint32_t>();
-		va.first = new T[count];
-		va.second = va.first+count;
-		if constexpr(sizeof(T) == 1)
-		    memcpy(va.first, buff.pop_raw(count), count);
+		std::unique_ptr<T[]> data(new T[count]);
+		if constexpr(std::is_arithmetic_v<T>)
+		    buff.pop_array(data.get(), count);
 		else if constexpr(!std::is_pointer_v<T>)
-		    for(T& v : va)
+		    for(T& v : TaggedPropval::VArray<T>(data.get(), count))
 		        buff >> v;
+		va = TaggedPropval::VArray<T>(data.release(), count);
 	}
 };
 